@@ -1,9 +1,21 @@
 #ifndef AI_ENGINE_HPP
 #define AI_ENGINE_HPP
 
+#include "EmbeddingCache.hpp"
 #include "HTTPClient.hpp"
+#include "MemoryMetadata.hpp"
+#include "PromptTemplate.hpp"
+#include "WriteAheadLog.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <thread>
 #include <vector>
 
 // 前向声明
@@ -14,16 +26,44 @@ class ConfigManager;
 class AIEngine {
 public:
     AIEngine(ConfigManager& config, MemoryManager& memory_manager);
-    
-    std::string processPlayerInput(const std::string& user_input, SessionManager& session);
+    ~AIEngine();
+
+    /**
+     * @brief 生成对玩家输入的回复。
+     * @param on_delta 可选：STREAM_RESPONSE 开启时，回复在生成过程中每收到一段新文本就调用一次；
+     *                 返回值仍是完整的回复。
+     */
+    std::string processPlayerInput(const std::string& user_input, SessionManager& session,
+                                   const std::function<void(const std::string&)>& on_delta = {});
     std::string synthesizeSpeech(const std::string& text_jp, 
                                  const std::string& voice_api_url);
 
+    // embedding缓存的命中统计 (用于 /metrics)
+    EmbeddingCache::Stats embeddingCacheStats() const { return embedding_cache_.stats(); }
+
 private:
     // 私有辅助方法
-    std::string generateResponse(const nlohmann::json& messages_payload);
-    std::vector<float> getEmbeddings(const std::string& text);
+    // on_delta 非空且 STREAM_RESPONSE 开启时以流式 (SSE) 请求，边生成边回调
+    std::string generateResponse(HTTPClient& client, const nlohmann::json& messages_payload,
+                                 const std::function<void(const std::string&)>& on_delta = {});
+    // 先查 embedding_cache_，未命中时才请求接口；失败时返回零向量
+    std::vector<float> getEmbeddings(HTTPClient& client, const std::string& text);
+    // 一次请求为多段文本生成向量 (按输入顺序返回)，失败时抛出 std::runtime_error
+    std::vector<std::vector<float>> requestEmbeddings(HTTPClient& client, const std::vector<std::string>& texts);
+    // 接口调用成功后调用：从不可用恢复时唤醒后台重新生成向量
+    void markEmbeddingHealthy();
+    // 后台任务：embedding接口可用时，分批为向量无效的记忆重新生成向量
+    void reembedLoop();
+    // 后台任务：为每轮对话生成记忆摘要与向量并写入记忆库，不占用回复的时间
+    void writebackLoop();
+    // 后台任务：定期把相似的旧记忆交给LLM整合为一条摘要，替换原来的多条记忆
+    void consolidateLoop();
+    // 整合一轮：挑选若干簇旧记忆，逐簇请求LLM (两次请求之间留出间隔)，再批量生成向量并替换
+    void runConsolidation();
     std::string createMemorySummary(const std::string& input, const std::string& response);
+    // 记录前端切换场景/设置时间的指令，用于填充提示词中的 [SCENE] / [TIME]
+    void trackSceneCommand(const std::string& user_input);
+    std::string renderSystemPrompt(std::string_view memory_section);
 
     // 依赖
     ConfigManager& config_;
@@ -32,6 +72,15 @@ private:
     // HTTP客户端：现在有两个，分别用于不同的服务
     HTTPClient llmHttpClient_;
     HTTPClient embeddingHttpClient_;
+    HTTPClient reembedHttpClient_; // 后台重新生成向量专用 (HTTPClient 不能跨线程共用)
+    HTTPClient consolidateLlmClient_;       // 后台整合记忆专用
+    HTTPClient consolidateEmbeddingClient_;
+    HTTPClient writebackEmbeddingClient_;   // 后台写入对话记忆专用
+
+    // 系统提示词模板 (PROMPT_FILE)，以及最近一次指令设置的场景与时间
+    PromptTemplate prompt_template_;
+    std::string scene_;
+    std::string time_;
 
     // API URL：同样分离
     std::string llm_api_url_;
@@ -40,8 +89,52 @@ private:
     // 其他配置参数
     std::string llm_model_;
     std::string embedding_model_;
+    size_t embedding_dimension_ = 1024; // EMBEDDING_VECTOR_DIMENSION，接口返回的向量应有的维度
+    EmbeddingCache embedding_cache_; // 按 (模型, 文本) 缓存接口返回的向量 (EMBEDDING_CACHE_MB 为0时禁用)
     float temperature_;
     bool rag_enabled_ = false;
+    bool stream_enabled_ = true;
+
+    // 新记忆记录所属角色 (CHARACTER_NAME)；MEMORY_SCOPE = "character" 时只检索当前角色的记忆
+    std::string character_name_;
+    bool memory_scoped_ = false;
+
+    // 待重新生成向量的记忆的后台处理
+    size_t reembed_batch_size_ = 16;
+    unsigned reembed_interval_seconds_ = 60;
+    std::atomic<bool> embedding_healthy_{true};
+    std::mutex reembed_mutex_;
+    std::condition_variable reembed_cv_;
+    bool reembed_wakeup_ = false;
+    bool stopping_ = false;
+    std::thread reembed_thread_;
+
+    // 旧记忆的后台整合 (间隔为0时不启动)；与重新生成向量的任务共用 reembed_mutex_ 与 stopping_
+    unsigned consolidation_interval_minutes_ = 0;
+    unsigned consolidation_min_age_hours_ = 168;
+    float consolidation_similarity_ = 0.8f;
+    size_t consolidation_min_cluster_ = 4;
+    size_t consolidation_max_cluster_ = 16;
+    size_t consolidation_max_per_run_ = 8;
+    size_t consolidation_cursor_ = 0; // 下一轮挑选种子的起始行
+    std::condition_variable consolidate_cv_;
+    std::thread consolidate_thread_;
+
+    // 待写入记忆库的对话 (RAG启用时)；同样由 reembed_mutex_ 保护。
+    // 入队前先追加到 writeback_journal_，确认已写入记忆库的WAL后 (队列清空时批量) 才从中删除；
+    // 停止时至多再写 WRITEBACK_DRAIN_SECONDS 秒，崩溃或超时未写完的对话在下次启动时重新入队
+    struct WritebackItem {
+        std::string summary;
+        MemoryMetadata::Attributes attributes;
+        uint64_t seq = 0; // 在 writeback_journal_ 中的序号，0 表示没有记录
+    };
+    std::deque<WritebackItem> writeback_queue_;
+    size_t writeback_queue_max_ = 256;
+    unsigned writeback_drain_seconds_ = 10;
+    std::chrono::steady_clock::time_point writeback_deadline_;
+    std::unique_ptr<WriteAheadLog> writeback_journal_;
+    std::condition_variable writeback_cv_;
+    std::thread writeback_thread_;
 };
 
 #endif // AI_ENGINE_HPP
\ No newline at end of file
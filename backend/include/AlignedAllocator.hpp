@@ -0,0 +1,51 @@
+#ifndef ALIGNED_ALLOCATOR_HPP
+#define ALIGNED_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <new>
+
+/**
+ * @brief 按固定字节边界对齐的分配器，供 std::vector 存放向量矩阵使用。
+ * 对齐到缓存行 (64字节) 后，每次扫描都能从整齐的地址开始连续读取。
+ */
+template <typename T, std::size_t Alignment = 64>
+class AlignedAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() noexcept = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (n > (std::numeric_limits<std::size_t>::max() - Alignment) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        // 分配大小向上取整为对齐值的整数倍 (aligned_alloc 的要求)
+        std::size_t bytes = ((n * sizeof(T) + Alignment - 1) / Alignment) * Alignment;
+        if (bytes == 0) bytes = Alignment;
+#if defined(__ANDROID__)
+        // bionic 直到 API 28 才提供 aligned_alloc，posix_memalign 在所有API级别都可用
+        void* p = nullptr;
+        if (posix_memalign(&p, Alignment, bytes) != 0) p = nullptr;
+#else
+        void* p = std::aligned_alloc(Alignment, bytes);
+#endif
+        if (!p) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t) noexcept { std::free(p); }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+#endif // ALIGNED_ALLOCATOR_HPP
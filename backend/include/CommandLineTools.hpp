@@ -0,0 +1,37 @@
+#ifndef COMMAND_LINE_TOOLS_HPP
+#define COMMAND_LINE_TOOLS_HPP
+
+/**
+ * @brief 离线维护与基准测试命令。
+ * 以 `./backend_server --<命令> [参数...]` 的形式运行，执行完毕后直接退出，不会启动服务器。
+ */
+class CommandLineTools {
+public:
+    /**
+     * @brief 执行 argv[1] 指定的命令。
+     * @return 进程退出码。
+     */
+    static int run(int argc, char* argv[]);
+
+private:
+    static void printUsage();
+
+    // HNSW 召回率与延迟对比精确扫描：--bench-hnsw [记忆条数] [维度]
+    static int benchHnsw(int argc, char* argv[]);
+    // 旧版 memory.json 转换为二进制记忆库：--import-json [json路径] [记忆库路径]
+    static int importJson(int argc, char* argv[]);
+    // 旧版JSON加载耗时与峰值内存 (流式 vs DOM)，以及二进制记忆库的映射耗时：--bench-load [文件MB] [维度]
+    static int benchLoad(int argc, char* argv[]);
+    // 在记忆库的全部向量上训练IVF-PQ索引并写入索引文件：--train-ivfpq [nlist] [m]
+    static int trainIvfpq(int argc, char* argv[]);
+    // IVF-PQ 在不同 nprobe 下的召回率与延迟 (含全精度重排)：--bench-ivfpq [记忆条数] [维度]
+    static int benchIvfpq(int argc, char* argv[]);
+    // 在记忆库的原始向量上学习PCA投影并写入 EMBEDDING_PCA_PATH：--train-pca [维度]
+    static int trainPca(int argc, char* argv[]);
+    // 回复片段解析：增量解析器 (按流式小块输入) 对比原先的 std::regex 整段解析：--bench-segments [回复条数]
+    static int benchSegments(int argc, char* argv[]);
+    // 副本修改的异常安全：在新增与合并的两个阶段注入故障，检查两份副本随后仍与预期一致：--selftest-publish [记忆条数]
+    static int selftestPublish(int argc, char* argv[]);
+};
+
+#endif // COMMAND_LINE_TOOLS_HPP
@@ -0,0 +1,113 @@
+#ifndef EMBEDDING_CACHE_HPP
+#define EMBEDDING_CACHE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief 按 (模型, 维度, 文本) 内容寻址的embedding缓存。
+ * 内存中是按总字节数限制大小的LRU；每条新向量同时追加到磁盘文件，重启后按原来的新旧顺序恢复。
+ * 文件增长到容量的两倍时由后台线程用内存中的内容重写 (查询线程只追加一条记录，不等待重写)，
+ * 启动时与关闭时也会重写，以丢弃被淘汰的记录并保存命中带来的顺序变化。
+ *
+ * 记录帧与WAL相同：[u32 负载长度][u32 负载CRC32][负载] (见 FileUtil)
+ * 负载：    [u64 键][u32 标识字节数][模型名 '\0' 维度 '\0' 文本][u32 维度][维度个 float32]
+ * 键是标识的64位哈希；查找时再比较完整的标识，哈希冲突不会返回错误的向量。
+ * 维度是标识的一部分：更换 EMBEDDING_VECTOR_DIMENSION 后不会取到旧维度的向量，旧记录随LRU淘汰。
+ */
+class EmbeddingCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t capacity_bytes = 0;
+    };
+
+    /**
+     * @param path 缓存文件路径，为空时只缓存在内存中。
+     * @param capacity_bytes 内存中缓存的大小上限，为0时禁用缓存。
+     * @param dimension 向量应有的维度；维度不符的向量不会被缓存，文件中这样的记录在载入时丢弃。
+     */
+    EmbeddingCache(std::string path, size_t capacity_bytes, size_t dimension);
+    ~EmbeddingCache();
+
+    EmbeddingCache(const EmbeddingCache&) = delete;
+    EmbeddingCache& operator=(const EmbeddingCache&) = delete;
+
+    bool enabled() const { return capacity_bytes_ > 0; }
+
+    /**
+     * @brief 查找缓存的向量，命中时写入 embedding 并返回 true。
+     */
+    bool get(std::string_view model, std::string_view text, std::vector<float>& embedding);
+
+    /**
+     * @brief 缓存一条向量并追加到文件；写文件失败只记录日志，不影响调用方。
+     * 维度不符、含 NaN/Inf 或全为0的向量 (接口出错时的占位) 不缓存。
+     */
+    void put(std::string_view model, std::string_view text, const std::vector<float>& embedding);
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        uint64_t key;
+        std::string identity; // 模型名 '\0' 向量维度 '\0' 文本 (见 make_identity)
+        std::vector<float> embedding;
+    };
+
+    std::string make_identity(std::string_view model, std::string_view text) const;
+    static size_t entry_bytes(const Entry& entry);
+    bool valid(const std::vector<float>& embedding) const;
+
+    // 以下函数调用时须持有 mutex_
+    void insert(uint64_t key, std::string identity, std::vector<float> embedding);
+    void evict();
+    void load();
+    void append(const Entry& entry);
+    // 按从旧到新的顺序编码内存中的全部记录
+    std::string snapshot() const;
+    // 用内存中的内容同步重写文件 (启动与关闭时)
+    void rewrite();
+    // 用临时文件替换缓存文件，之后以追加方式继续写入 fd；失败时抛出异常，fd 由调用方关闭
+    void install(int fd, uint64_t bytes);
+    void close_file();
+
+    // 后台重写：编码在锁内完成，写临时文件时不持有锁；期间追加的记录同时暂存在 backlog_，
+    // 替换前补写到新文件末尾
+    void compactor_loop();
+    // 把 content 写入新建的临时文件，返回其描述符 (不持有锁也可调用)
+    int write_temp(const std::string& content) const;
+    void discard_temp(int fd) const;
+
+    std::string path_;
+    size_t capacity_bytes_;
+    size_t dimension_;
+    int fd_ = -1;
+    uint64_t file_bytes_ = 0;
+
+    std::thread compactor_;
+    std::condition_variable compactor_cv_;
+    bool compact_requested_ = false;
+    bool rewriting_ = false;
+    bool stopping_ = false;
+    std::string backlog_;
+
+    mutable std::mutex mutex_;
+    std::list<Entry> lru_; // 头部是最近使用的
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+    size_t bytes_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+#endif // EMBEDDING_CACHE_HPP
@@ -0,0 +1,97 @@
+#ifndef EMBEDDING_REDUCER_HPP
+#define EMBEDDING_REDUCER_HPP
+
+#include "MappedColumn.hpp"
+#include "MemoryStoreFile.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class ThreadPool;
+
+/**
+ * @brief 把embedding接口返回的向量降到较低的维度后再存储与检索，扫描与存储的开销随维度成比例下降。
+ *
+ * - truncate：直接截取前 N 维，适用于按 Matryoshka 方式训练的模型 (例如 Qwen3-Embedding)，
+ *   这类模型的前若干维本身就是一个完整的低维表示。
+ * - pca：在现有记忆库的向量上离线学习 (--train-pca) 一个 N×D 的正交投影。
+ *   投影不减去均值 (取二阶矩矩阵而不是协方差的主成分)，使投影后的内积直接逼近原向量的内积，
+ *   即余弦相似度的排序；投影以与记忆库相同格式的文件保存，启动时映射。
+ * 降维后的向量由调用方重新归一化。
+ */
+class EmbeddingReducer {
+public:
+    enum class Mode { None, Truncate, Pca };
+
+    /**
+     * @brief 解析 EMBEDDING_REDUCTION 配置值 ("none" / "truncate" / "pca")，无法识别时返回 None。
+     */
+    static Mode parseMode(const std::string& value);
+    static const char* modeName(Mode mode);
+
+    /**
+     * @brief 不降维 (None) 或截断 (Truncate) 到 output_dimension 维。截断时 output_dimension 必须小于 input_dimension。
+     */
+    EmbeddingReducer(Mode mode, size_t input_dimension, size_t output_dimension);
+
+    /**
+     * @brief 在 rows 条已归一化的向量上学习前 output_dimension 个主成分 (均匀抽样至多 kTrainSamples 条)。
+     * @param pool 可选的线程池，用于并行计算二阶矩矩阵与子空间迭代。
+     */
+    static std::unique_ptr<EmbeddingReducer> trainPca(const float* data, size_t rows, size_t input_dimension,
+                                                      size_t output_dimension, ThreadPool* pool = nullptr);
+
+    /**
+     * @brief 映射 savePca() 写出的投影文件。文件不存在或格式错误时抛出 std::runtime_error。
+     */
+    static std::unique_ptr<EmbeddingReducer> loadPca(const std::string& path);
+
+    /**
+     * @brief 写入投影文件 (先写临时文件再原子替换)。
+     */
+    void savePca(const std::string& path) const;
+
+    Mode mode() const { return mode_; }
+    bool enabled() const { return mode_ != Mode::None; }
+    size_t inputDimension() const { return input_dimension_; }
+    size_t outputDimension() const { return output_dimension_; }
+    /**
+     * @brief PCA 训练集的二阶矩中被保留的比例 (0 ~ 1)，衡量降维损失了多少信息；其他模式为1。
+     */
+    float retainedEnergy() const { return retained_energy_; }
+
+    /**
+     * @brief 把 input_dimension 维的 input 降为 output_dimension 维写入 output (未归一化)。
+     */
+    void reduce(const float* input, float* output) const;
+
+    /**
+     * @brief 记忆库文件中的向量是否正是按本降维方式生成的 (维度相同且投影一致)。
+     * 没有降维标记的文件视为未降维。
+     */
+    bool matches(const MemoryStoreFile& store) const;
+
+    /**
+     * @brief 把降维方式的标记作为附加分段写入记忆库文件；未降维时不写。
+     */
+    void writeSections(MemoryStoreWriter& writer) const;
+
+    static constexpr size_t kTrainSamples = 20000;
+
+private:
+    EmbeddingReducer() = default;
+    // 投影矩阵的指纹：更换了投影 (重新训练) 的记忆库需要重新投影
+    void compute_fingerprint();
+
+    Mode mode_ = Mode::None;
+    size_t input_dimension_ = 0;
+    size_t output_dimension_ = 0;
+    float retained_energy_ = 1.0f;
+    uint64_t fingerprint_ = 0;
+
+    MemoryStoreFile file_;          // loadPca() 映射的投影文件
+    MappedColumn<float> components_; // output_dimension 行，每行 input_dimension 维，两两正交的单位向量
+};
+
+#endif // EMBEDDING_REDUCER_HPP
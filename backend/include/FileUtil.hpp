@@ -0,0 +1,80 @@
+#ifndef FILE_UTIL_HPP
+#define FILE_UTIL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 记忆库文件、WAL 与embedding缓存共用的文件读写操作、记录帧与校验函数。
+ *
+ * 追加写的日志文件 (WAL、embedding缓存) 由连续的记录帧组成：[u32 负载长度][u32 负载CRC32][负载]，
+ * 负载的内容由各自的调用方编码。写到一半的帧 (例如崩溃时) 在读取时被识别为不完整并丢弃。
+ */
+class FileUtil {
+public:
+    static constexpr size_t kFrameHeaderSize = 8;                    // 负载长度 + CRC32
+    static constexpr uint32_t kMaxFramePayload = 64u * 1024u * 1024u; // 超过此长度的“记录”视为损坏
+    static constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+
+    /**
+     * @brief 把 data 完整写入 fd (处理部分写入与 EINTR)。
+     * 失败时抛出 std::runtime_error，消息为 "写入<what>失败: <错误原因>"。
+     */
+    static void writeFully(int fd, const char* data, size_t size, const char* what);
+
+    /**
+     * @brief 读取整个文件；文件不存在或无法打开时返回空内容。
+     */
+    static std::vector<char> readFile(const std::string& path);
+
+    /**
+     * @brief rename 之后同步所在目录，保证新的目录项也已落盘 (否则断电后可能仍是旧文件)。
+     */
+    static void fsyncParentDir(const std::string& path);
+
+    /**
+     * @brief 在 out 末尾预留一个帧头，返回帧的起始偏移；随后把负载追加到 out，再调用 finishFrame 填写帧头。
+     */
+    static size_t beginFrame(std::string& out);
+    static void finishFrame(std::string& out, size_t frame_start);
+
+    /**
+     * @brief 依次校验 [data, data + size) 中的记录帧，把每帧的负载交给 on_payload (offset 为帧的起始偏移)。
+     * 遇到不完整或校验失败的帧，或 on_payload 返回 false (负载格式错误) 时停止。
+     * @return 最后一个有效帧之后的偏移。
+     */
+    static size_t scanFrames(const char* data, size_t size,
+                             const std::function<bool(size_t offset, const char* payload, size_t payload_size)>& on_payload);
+
+    /**
+     * @brief 标准 CRC-32 (IEEE 802.3，与 zlib 相同)。
+     */
+    static uint32_t crc32(const char* data, size_t size);
+
+    /**
+     * @brief 64位 FNV-1a 哈希，可以分段累加 (首段传入 kFnvOffset)。
+     */
+    static uint64_t fnv1a(uint64_t hash, const void* data, size_t bytes);
+
+    template <typename T>
+    static void put(std::string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /**
+     * @brief 从 cursor 读取一个定长值并前移；剩余字节不足时返回 false。
+     */
+    template <typename T>
+    static bool take(const char*& cursor, const char* end, T& value) {
+        if (static_cast<size_t>(end - cursor) < sizeof(T)) return false;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+};
+
+#endif // FILE_UTIL_HPP
@@ -0,0 +1,74 @@
+#ifndef HNSW_INDEX_HPP
+#define HNSW_INDEX_HPP
+
+#include "TopK.hpp"
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+/**
+ * @brief 分层可导航小世界图 (HNSW) 近似最近邻索引。
+ * 索引本身不保存向量，只保存图结构；向量通过 row_fn 从记忆矩阵中按行号读取，
+ * 并且要求已经L2归一化 (相似度即点积)。
+ */
+class HNSWIndex {
+public:
+    struct Params {
+        size_t M = 16;                // 每层每个节点的邻居上限 (第0层为 2*M)
+        size_t ef_construction = 200; // 插入时的候选集大小
+        size_t ef_search = 64;        // 查询时的候选集大小，越大召回越高、延迟越高
+    };
+
+    using RowFn = std::function<const float*(size_t)>;
+    using Filter = std::function<bool(size_t)>;
+
+    HNSWIndex(size_t dimension, const Params& params, RowFn row_fn);
+
+    /**
+     * @brief 将矩阵中的第 id 行插入图中。id 必须按 0,1,2... 的顺序递增插入。
+     */
+    void insert(size_t id);
+
+    /**
+     * @brief 检索与 query 最相似的 k 个节点，按得分降序返回。
+     * @param ef 本次查询的候选集大小，为0时使用 Params::ef_search。
+     * @param accept 可选的过滤条件：不满足的节点仍然参与图上的遍历 (保持连通)，但不会进入结果。
+     */
+    std::vector<ScoredIndex> search(const float* query, size_t k, size_t ef = 0, const Filter& accept = nullptr) const;
+
+    size_t size() const { return levels_.size(); }
+    const Params& params() const { return params_; }
+    void set_ef_search(size_t ef) { params_.ef_search = ef; }
+
+private:
+    float similarity(const float* query, size_t id) const;
+    int random_level();
+
+    // 第 level 层上节点 id 的邻居表：[0] 是邻居数量，其后是邻居编号
+    uint32_t* links(size_t id, int level);
+    const uint32_t* links(size_t id, int level) const;
+
+    // 在单层上做贪心的最佳优先搜索，返回至多 ef 个候选 (未排序)；accept 非空时只有满足它的节点进入结果
+    std::vector<ScoredIndex> search_layer(const float* query, size_t entry, size_t ef, int level,
+                                          const Filter* accept = nullptr) const;
+    // 启发式邻居选择：优先保留彼此分散的邻居，避免图在密集簇内部“抱团”
+    std::vector<ScoredIndex> select_neighbors(std::vector<ScoredIndex> candidates, size_t max_count) const;
+    void connect(size_t id, size_t neighbor, int level);
+
+    size_t dimension_;
+    Params params_;
+    RowFn row_fn_;
+    size_t max_links0_;
+    size_t max_links_;
+    double level_mult_;
+
+    std::vector<int> levels_;
+    std::vector<uint32_t> links0_;                    // 第0层邻居表，定长连续存放
+    std::vector<std::vector<uint32_t>> upper_links_;  // 第1层及以上的邻居表，按节点存放
+    size_t entry_point_ = 0;
+    int max_level_ = -1;
+    std::mt19937 rng_{42};
+};
+
+#endif // HNSW_INDEX_HPP
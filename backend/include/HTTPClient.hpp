@@ -1,7 +1,9 @@
 #ifndef HTTP_CLIENT_HPP
 #define HTTP_CLIENT_HPP
 
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <curl/curl.h>
 
@@ -20,16 +22,35 @@ public:
                   const std::vector<std::string>& headers = {});
     std::string get(const std::string& url, 
                  const std::vector<std::string>& headers = {});
+    /**
+     * @brief 发送POST请求，响应体不汇总返回，而是每收到一块数据就交给 on_data (例如SSE流式响应)。
+     * on_data 在cURL回调中执行，不能抛出异常。请求失败时抛出 std::runtime_error。
+     */
+    void postStream(const std::string& url,
+                    const std::string& data,
+                    const std::function<void(std::string_view)>& on_data,
+                    const std::vector<std::string>& headers = {});
+    /**
+     * @brief 设置之后每个请求的总超时 (秒)，超时后请求失败并抛出异常；0 表示不限 (默认)。
+     */
+    void setTimeout(long seconds) { timeout_seconds_ = seconds; }
 
 private:
     std::string sendRequest(const std::string& url, 
                           const std::string& method, 
                           const std::string& data, 
                           const std::vector<std::string>& additional_headers);
+    // 执行请求，响应体逐块交给 on_data
+    void perform(const std::string& url,
+                 const std::string& method,
+                 const std::string& data,
+                 const std::vector<std::string>& additional_headers,
+                 const std::function<void(std::string_view)>& on_data);
     static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp);
     
     CURL* curl_;
     std::string api_key_;
+    long timeout_seconds_ = 0;
 };
 
 #endif // HTTP_CLIENT_HPP
\ No newline at end of file
@@ -0,0 +1,110 @@
+#ifndef IVFPQ_INDEX_HPP
+#define IVFPQ_INDEX_HPP
+
+#include "MappedColumn.hpp"
+#include "MemoryStoreFile.hpp"
+#include "TopK.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+/**
+ * @brief 倒排文件 + 乘积量化 (IVF-PQ) 近似索引，用于百万条以上的记忆库。
+ *
+ * 粗量化：k-means 得到 nlist 个中心，每条向量归入最近的中心所在的倒排列表。
+ * 细量化：向量减去其中心后的残差切成 m 段，每段用 256 个中心的码本编码为1字节，
+ * 每条记忆只占 m 字节编码 + 4 字节行号 (1024维 float32 需要 4096 字节)。
+ *
+ * 查询时只扫描与查询最相似的 nprobe 个列表；对内积相似度有
+ *   q·x ≈ q·c + Σ_j q_j·codebook_j[code_j]
+ * 其中第二项按查询预先算好一张 m×256 的查找表 (非对称距离计算，ADC)，扫描时每条记忆只需 m 次查表相加。
+ * 索引不保存原始向量，近似得分应再用全精度向量重排。
+ *
+ * 码本由离线命令 (--train-ivfpq) 训练，与倒排列表一起保存为与记忆库相同格式的分段文件；
+ * 服务器启动时直接映射该文件，之后新增的记忆追加在各列表的内存尾部，合并记忆库时一并写回。
+ */
+class IVFPQIndex {
+public:
+    struct Params {
+        size_t nlist = 1024;            // 倒排列表 (粗量化中心) 数量
+        size_t m = 64;                  // 残差的分段数，即每条记忆的编码字节数；必须整除维度
+        size_t iterations = 20;         // k-means 迭代次数
+        size_t train_samples = 100000;  // 参与训练的最多向量数 (均匀抽样)
+    };
+
+    static constexpr size_t kCodebookSize = 256;
+
+    /**
+     * @brief 在 rows 条已归一化的向量上训练粗量化中心与残差码本 (索引中尚无任何记忆)。
+     * @param pool 可选的线程池，用于并行计算 k-means 的分配步骤。
+     */
+    static std::unique_ptr<IVFPQIndex> train(const float* data, size_t rows, size_t dimension, const Params& params,
+                                             ThreadPool* pool = nullptr);
+
+    /**
+     * @brief 映射 save() 写出的索引文件。文件不存在或格式错误时抛出 std::runtime_error。
+     */
+    static std::unique_ptr<IVFPQIndex> load(const std::string& path);
+
+    /**
+     * @brief 写入索引文件 (先写临时文件再原子替换)。当前映射的旧文件在本对象销毁前保持有效。
+     */
+    void save(const std::string& path) const;
+
+    /**
+     * @brief 编码第 id 行并加入对应的倒排列表。id 必须按 0,1,2... 的顺序递增加入。
+     */
+    void add(size_t id, const float* vector);
+
+    /**
+     * @brief 近似检索前 k 个，按近似得分降序返回。
+     * @param nprobe 扫描的倒排列表数。
+     * @param accept 可选的过滤条件，不满足的行在扫描时跳过。
+     */
+    std::vector<ScoredIndex> search(const float* query, size_t k, size_t nprobe,
+                                    const std::function<bool(size_t)>& accept = nullptr) const;
+
+    /**
+     * @brief 清空所有倒排列表，保留中心与码本；用于行号整体变化 (例如淘汰记忆) 后重新加入。
+     */
+    void clear();
+
+    size_t size() const { return rows_; }
+    size_t dimension() const { return dimension_; }
+    size_t nlist() const { return nlist_; }
+    size_t subquantizers() const { return m_; }
+
+private:
+    IVFPQIndex() = default;
+    IVFPQIndex(size_t dimension, size_t nlist, size_t m) { configure(dimension, nlist, m); }
+
+    // 设置维度与列表数，并按此重建 (清空) 中心、码本与倒排列表
+    void configure(size_t dimension, size_t nlist, size_t m);
+    // 中心与码本就绪后计算它们模长平方的一半 (x 的最近中心即 x·c - |c|²/2 最大者)，并转置码本
+    void compute_norms();
+    size_t nearest_centroid(const float* vector) const;
+    void encode_residual(const float* vector, size_t list, uint8_t* code) const;
+
+    size_t dimension_ = 0;
+    size_t nlist_ = 0;
+    size_t m_ = 0;
+    size_t sub_dimension_ = 0;
+    size_t rows_ = 0;
+
+    MemoryStoreFile file_;                  // load() 映射的索引文件
+    MappedColumn<float> centroids_;         // nlist 行，每行 dimension 维
+    MappedColumn<float> codebooks_;         // m × 256 行，每行 sub_dimension 维，第 j 段码本连续存放
+    std::vector<float> centroid_norms_;
+    std::vector<float> codebook_norms_;
+    std::vector<float> codebooks_transposed_; // 每段码本转置为 sub_dimension × 256，查找表与编码按列累加
+    std::vector<float> zero_bias_;
+    std::vector<MappedColumn<uint32_t>> list_ids_;  // 每个倒排列表中的行号
+    std::vector<MappedColumn<uint8_t>> list_codes_; // 与行号一一对应，每行 m 字节
+};
+
+#endif // IVFPQ_INDEX_HPP
@@ -0,0 +1,62 @@
+#ifndef LEXICAL_INDEX_HPP
+#define LEXICAL_INDEX_HPP
+
+#include "TopK.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief 记忆摘要的增量倒排索引，按 BM25 打分。
+ * 用于补足向量检索对专有名词、人名等精确字面匹配不敏感的问题，也在embedding接口不可用时
+ * 单独承担检索 (不需要任何网络请求)。文档编号与记忆矩阵的行号一致。
+ */
+class LexicalIndex {
+public:
+    struct Params {
+        float k1 = 1.2f; // 词频饱和参数
+        float b = 0.75f; // 文档长度归一化强度
+    };
+
+    LexicalIndex() = default;
+    explicit LexicalIndex(const Params& params) : params_(params) {}
+
+    /**
+     * @brief 分词：连续的汉字/假名/谚文按重叠的二元组 (bigram) 切分，单独一个字时保留单字；
+     * 连续的字母数字 (含全角) 作为一个词并转为小写；标点与空白只起分隔作用。
+     */
+    static std::vector<std::string> tokenize(std::string_view text);
+
+    /**
+     * @brief 将下一条记忆的摘要加入索引。文档必须按 0,1,2... 的顺序加入。
+     */
+    void add(std::string_view text);
+
+    /**
+     * @brief 检索与 query 字面最相关的至多 k 条文档，按 BM25 得分降序返回 (得分为0的文档不会出现)。
+     * @param accept 可选的过滤条件，不满足的文档在选取前 k 名之前就被排除。
+     */
+    std::vector<ScoredIndex> search(std::string_view query, size_t k,
+                                    const std::function<bool(size_t)>& accept = nullptr) const;
+
+    size_t size() const { return doc_lengths_.size(); }
+    size_t termCount() const { return postings_.size(); }
+    void clear();
+
+private:
+    struct Posting {
+        uint32_t doc;
+        uint32_t tf;
+    };
+
+    Params params_;
+    std::unordered_map<std::string, uint32_t> term_ids_;
+    std::vector<std::vector<Posting>> postings_; // 按词编号；每个列表按文档编号递增
+    std::vector<uint32_t> doc_lengths_;          // 每条文档的词数
+    uint64_t total_length_ = 0;
+};
+
+#endif // LEXICAL_INDEX_HPP
@@ -0,0 +1,100 @@
+#ifndef MAPPED_COLUMN_HPP
+#define MAPPED_COLUMN_HPP
+
+#include "AlignedAllocator.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief 定宽行组成的列：前半部分是只读映射的文件内容，后半部分是内存中追加的新行。
+ * 每行 width 个元素。row(i) 对调用方屏蔽了两段存储的区别；扫描时用 for_each_block
+ * 按连续块遍历，保证内层循环始终在一段连续内存上进行。
+ */
+template <typename T>
+class MappedColumn {
+public:
+    explicit MappedColumn(size_t width = 1) : width_(width) {}
+
+    /**
+     * @brief 挂接一段只读映射的数据作为前 rows 行，原有的追加行被清空。
+     */
+    void attach(const T* data, size_t rows) {
+        mapped_ = data;
+        mapped_rows_ = rows;
+        tail_.clear();
+    }
+
+    void clear() {
+        mapped_ = nullptr;
+        mapped_rows_ = 0;
+        tail_.clear();
+    }
+
+    /**
+     * @brief 在末尾追加一行未初始化的空间，返回其起始地址 (下一次追加前有效)。
+     */
+    T* append_row() {
+        size_t offset = tail_.size();
+        tail_.resize(offset + width_);
+        return tail_.data() + offset;
+    }
+
+    void append(const T* values) {
+        tail_.insert(tail_.end(), values, values + width_);
+    }
+
+    void reserve_tail(size_t rows) { tail_.reserve(rows * width_); }
+
+    const T* row(size_t index) const {
+        if (index < mapped_rows_) return mapped_ + index * width_;
+        return tail_.data() + (index - mapped_rows_) * width_;
+    }
+
+    size_t rows() const { return mapped_rows_ + tail_.size() / width_; }
+    size_t mapped_rows() const { return mapped_rows_; }
+    size_t width() const { return width_; }
+
+    /**
+     * @brief 按连续块遍历 [begin, end) 行：fn(首行号, 块起始地址, 行数)。
+     */
+    template <typename Fn>
+    void for_each_block(size_t begin, size_t end, Fn&& fn) const {
+        end = std::min(end, rows());
+        if (begin < std::min(end, mapped_rows_)) {
+            size_t stop = std::min(end, mapped_rows_);
+            fn(begin, mapped_ + begin * width_, stop - begin);
+            begin = stop;
+        }
+        if (begin < end) {
+            fn(begin, tail_.data() + (begin - mapped_rows_) * width_, end - begin);
+        }
+    }
+
+    /**
+     * @brief 写文件时使用：keep 为空指针时按块遍历前 rows 行，否则只遍历 keep 中列出的行 (行号递增)，
+     * 连续的行号合并为一次回调。
+     */
+    template <typename Fn>
+    void for_each_kept_block(size_t rows, const std::vector<uint32_t>* keep, Fn&& fn) const {
+        if (!keep) {
+            for_each_block(0, rows, fn);
+            return;
+        }
+        for (size_t i = 0; i < keep->size();) {
+            size_t j = i + 1;
+            while (j < keep->size() && (*keep)[j] == (*keep)[j - 1] + 1) ++j;
+            for_each_block((*keep)[i], size_t{(*keep)[j - 1]} + 1, fn);
+            i = j;
+        }
+    }
+
+private:
+    size_t width_;
+    const T* mapped_ = nullptr;
+    size_t mapped_rows_ = 0;
+    std::vector<T, AlignedAllocator<T>> tail_;
+};
+
+#endif // MAPPED_COLUMN_HPP
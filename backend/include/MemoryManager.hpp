@@ -1,40 +1,442 @@
 #ifndef MEMORY_MANAGER_HPP
 #define MEMORY_MANAGER_HPP
 
+#include "EmbeddingReducer.hpp"
+#include "HNSWIndex.hpp"
+#include "IVFPQIndex.hpp"
+#include "LexicalIndex.hpp"
+#include "MappedColumn.hpp"
+#include "MemoryMetadata.hpp"
+#include "MemoryStoreFile.hpp"
+#include "QuantizedVectors.hpp"
+#include "ThreadPool.hpp"
+#include "WriteAheadLog.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
-#include <nlohmann/json.hpp> // <-- 我们唯一的“数据库”
+
+class ConfigManager;
+
+/**
+ * @brief 批量检索中的一条查询。
+ */
+struct MemoryQuery {
+    std::string text;             // 查询的原始文本，用于字面检索
+    std::vector<float> embedding; // 查询向量，可以为空
+};
+
+/**
+ * @brief 挑选待整合记忆的条件 (见 MemoryManager::findConsolidationClusters)。
+ */
+struct ConsolidationOptions {
+    int64_t created_before = 0;  // 只整合在此之前创建的记忆 (Unix 秒)
+    float similarity = 0.8f;     // 簇中每条记忆与种子记忆的余弦相似度下限
+    size_t min_size = 4;         // 少于这么多条的簇不整合
+    size_t max_size = 16;        // 每个簇最多的记忆条数
+    size_t max_clusters = 8;     // 本次最多返回的簇数
+    size_t max_seeds = 256;      // 本次最多尝试的种子数，限制一次挑选的扫描次数
+    size_t first_row = 0;        // 从该行开始挑选种子，配合 next_row 让每次挑选接着上一次继续
+};
+
+/**
+ * @brief 一组相似的旧记忆，以及 (由调用方填写的) 整合后替代它们的一条记忆。
+ */
+struct MemoryCluster {
+    std::vector<size_t> rows;            // 热层行号 (递增)
+    std::vector<std::string> summaries;  // 与 rows 一一对应；替换前据此确认这些行没有被合并改变
+    std::string summary;                 // 整合后的摘要
+    std::vector<float> embedding;        // 整合后摘要的向量
+};
 
 class MemoryManager {
 public:
     /**
-     * @brief 构造函数，从一个JSON文件加载或创建记忆库。
-     * @param memory_file_path 用于存储记忆的JSON文件路径。
+     * @brief 构造函数，按 [Database] 节的配置打开或创建记忆库。
+     * MEMORY_STORE_PATH 为二进制记忆库文件 (mmap 打开)；若它不存在而 MEMORY_DB_PATH 指向旧的
+     * memory.json，则先一次性导入。随后回放 MEMORY_WAL_PATH 中尚未合并的记录。
+     * VECTOR_INDEX = "hnsw" 时额外维护一个HNSW近似索引；为 "ivfpq" 时映射 IVFPQ_INDEX_PATH 处
+     * 由 --train-ivfpq 离线训练的索引，文件不存在或与记忆库不符时退回暴力扫描。
+     * MAX_MEMORIES 大于0时记忆库 (热层) 有容量上限，超出的记忆在合并时移入 COLD_STORE_PATH 处的冷层。
+     * [API_EMBEDDING] 节的 EMBEDDING_REDUCTION 不为 "none" 时，向量降维后再存储与检索；
+     * 记忆库由其他降维方式 (或未降维) 写出时，启动时用其中保存的原始向量重新投影。
+     * @param config 配置管理器的引用。
      */
-    explicit MemoryManager(const std::string& memory_file_path);
-    ~MemoryManager();
+    explicit MemoryManager(ConfigManager& config);
+    virtual ~MemoryManager();
 
     /**
-     * @brief 将一条新的记忆存入内存，并将在程序结束时保存到文件。
+     * @brief 将一条新的记忆存入内存，并立即追加到WAL中持久化。
+     * 向量为零、含 NaN/Inf 或维度不符时 (通常是embedding接口调用失败)，记忆不进入检索，
+     * 而是放入待重新生成向量的队列；之后以相同摘要和有效向量再次调用时会从队列中移除，
+     * 此时若未指定创建时间，沿用入队时记录的全部属性。
+     * 与同一会话、同一角色下已有记忆的余弦相似度不低于 DEDUP_THRESHOLD 时视为重复：不新增行，
+     * 而是累加那条记忆的合并次数；其访问记录不变，重复的内容不会因此在淘汰与时间衰减中显得刚被检索过。
      * @param text_summary 记忆的文本内容。
-     * @param embedding 记忆的向量表示。
+     * @param embedding 记忆的向量表示 (embedding接口返回的原始维度，降维在内部完成)。
+     * @param attributes 重要度 (检索时按 IMPORTANCE_WEIGHT 加权)、所属会话/角色与标签；创建时间为0时取当前时间。
+     * @return 是否已持久化 (写入WAL，或合并进已有记忆)；WAL写入失败时记忆只保存在内存中，返回 false。
      */
-    void addMemory(const std::string& text_summary, const std::vector<float>& embedding);
+    bool addMemory(const std::string& text_summary, const std::vector<float>& embedding,
+                   MemoryMetadata::Attributes attributes = {});
 
     /**
-     * @brief 根据查询向量，检索最相关的K条记忆。
-     * @param query_embedding 用于查询的向量。
+     * @brief 检索最相关的K条记忆。
+     * RETRIEVAL_MODE = "hybrid" (默认) 时，向量检索与BM25字面检索的结果按倒数排名融合 (RRF)；
+     * 查询向量无效 (embedding接口不可用) 时只使用字面检索。向量检索的得分在扫描时
+     * 就叠加了时间衰减与重要度 (见 MemoryMetadata)；命中的记忆会更新最近访问时间与访问次数。
+     * 过滤条件在扫描、HNSW遍历与BM25选取的过程中逐行判断，返回的是满足条件的记忆中最相关的 top_k 条；
+     * 按会话或角色过滤且命中行较少时，只扫描这些行。
+     * 热层的最高得分低于 COLD_SEARCH_THRESHOLD 时，再精确扫描一遍冷层，两层的结果按得分合并。
+     * 检索不加锁，也不等待同时进行的新增、整合或合并，读到的是调用时已公开的状态。
+     * @param query_text 查询的原始文本，用于字面检索。
+     * @param query_embedding 用于查询的向量，可以为空。
      * @param top_k 需要检索的记忆数量。
+     * @param filter 过滤条件，默认不过滤。
      * @return 一个包含相关记忆文本的向量。
      */
-    std::vector<std::string> retrieveMemories(const std::vector<float>& query_embedding, int top_k);
+    std::vector<std::string> retrieveMemories(const std::string& query_text, const std::vector<float>& query_embedding,
+                                              int top_k, const MemoryFilter& filter = {});
+
+    /**
+     * @brief 一次检索多条查询 (例如同一轮对话的原始输入、改写后的查询与上一条回复，或多个会话的并发查询)，
+     * 语义与逐条调用 retrieveMemories 相同。暴力扫描时矩阵按能留在缓存中的小片与所有查询依次计算，
+     * 整个矩阵只从内存读取一遍，而不是每条查询一遍。
+     * @return 与 queries 一一对应的检索结果。
+     */
+    std::vector<std::vector<std::string>> retrieveMemoriesBatch(const std::vector<MemoryQuery>& queries, int top_k,
+                                                                const MemoryFilter& filter = {});
+
+    /**
+     * @brief 从 first_row 起依次以创建时间早于 created_before 的记忆为种子，把与种子相似度不低于 similarity、
+     * 会话与角色都相同的旧记忆归为一簇 (每条记忆至多属于一簇)，供后台任务整合为一条摘要。
+     * @param next_row 可选，写入下次挑选应开始的行号。
+     */
+    std::vector<MemoryCluster> findConsolidationClusters(const ConsolidationOptions& options,
+                                                         size_t* next_row = nullptr) const;
+
+    /**
+     * @brief 用各簇整合后的记忆替换簇中的记忆。替换在一次 publish 中完成：之后的检索、去重与整合只看到新记忆，
+     * 被替换的行留在矩阵中，由随即请求的合并从记忆库文件中移除。整合结果不写WAL：合并之前进程崩溃时，
+     * 这一轮整合 (含LLM生成的摘要) 丢失，重启后原记忆照常可见，之后的整合任务会重新挑选它们。
+     * 新记忆的创建时间取簇中最早的，重要度取最高的，标签取并集，并继承访问记录与合并次数。
+     * 簇中的行已被移除或改变 (期间发生过淘汰或整合)、或新向量无效的簇会被跳过。
+     * @return 被替换的记忆条数。
+     */
+    size_t consolidateMemories(const std::vector<MemoryCluster>& clusters);
+
+    /**
+     * @brief 是否维护了字面倒排索引 (RETRIEVAL_MODE 不为 "vector")。
+     */
+    bool lexicalEnabled() const { return lexical_enabled_; }
+
+    /**
+     * @brief 热层 (参与常规检索的) 记忆条数，不含冷层。
+     */
+    size_t size() const;
+
+    /**
+     * @brief 已淘汰到冷层的记忆条数。
+     */
+    size_t coldSize() const;
+
+    /**
+     * @brief 待重新生成向量的记忆数量。
+     */
+    size_t pendingCount() const;
+
+    /**
+     * @brief 取出队首至多 max_count 条待重新生成向量的记忆摘要 (不会从队列中移除)。
+     */
+    std::vector<std::string> pendingSummaries(size_t max_count) const;
+
+    /**
+     * @brief 重新生成向量失败 (例如embedding接口拒绝这段文本) 时，把该摘要移到待处理队列末尾并累加其失败次数，
+     * 使排在后面的记忆不被它挡住。
+     * @return 累计失败次数；队列中已没有该摘要时返回0。
+     */
+    uint32_t deferPending(const std::string& summary);
+
+    /**
+     * @brief 判断向量能否参与检索：非空、维度正确、不含 NaN/Inf 且不是零向量。
+     */
+    static bool isValidEmbedding(const float* data, size_t dim, size_t expected_dim);
+
+    /**
+     * @brief 立即把尚未合并的记忆写入记忆库文件并截断WAL (通常由后台线程自动完成)。
+     */
+    void compact();
+
+    /**
+     * @brief 将旧版 memory.json 一次性转换为二进制记忆库文件。
+     * @return 成功导入的记忆条数。
+     */
+    static size_t importLegacyJson(const std::string& json_path, const std::string& store_path, size_t dimension);
+
+protected:
+    /**
+     * @brief 每次对一份副本应用修改之后调用 (replay 为 true 表示对旧副本的重放)，默认什么也不做。
+     * 抛出的异常按这次修改失败处理；供 --selftest-publish 在派生类中注入故障。
+     */
+    virtual void afterApply(bool replay) {}
 
 private:
-    std::string file_path_;
-    nlohmann::json memory_db_; // 在内存中持有一个JSON对象作为我们的数据库
+    /**
+     * @brief 检索需要读取的全部可变状态。MemoryManager 持有两份内容相同的副本，同一时刻只有一份对检索公开，
+     * 写入方只修改另一份 (见 publish)，因此副本内部的各个结构都不需要考虑并发修改。
+     */
+    struct Replica {
+        Replica(size_t dimension, size_t full_dimension, QuantizedVectors::Mode mode,
+                const MemoryMetadata::Weights& weights);
+
+        // 所有记忆的向量按行存放在定长行距的 float32 矩阵中 (行优先，每行 dimension 个元素，已归一化)。
+        // 前 store.count() 行直接映射自记忆库文件，其后是尚未合并进文件的行 (它们已记录在WAL中)；
+        // tail_summaries 与这些行一一对应
+        MemoryStoreFile store;
+        MappedColumn<float> vectors;
+        std::vector<std::string> tail_summaries;
+        // 降维存储且 KEEP_FULL_VECTORS 时保存的原始向量 (已归一化)，与 vectors 逐行对应；
+        // 文件中没有原始向量时为空，此时不做全精度重排
+        MappedColumn<float> full_vectors;
+
+        // 可选的int8/fp16量化副本：暴力扫描先在编码上粗排，再对 RERANK_CANDIDATES 个候选用全精度重排
+        QuantizedVectors quantized;
+        // 每行的创建/访问时间、访问次数与重要度
+        MemoryMetadata metadata;
+        // 摘要的BM25倒排索引 (文档编号即行号)
+        LexicalIndex lexical;
+        // 可选的HNSW / IVF-PQ近似索引；都为空时检索走精确的暴力扫描
+        std::unique_ptr<HNSWIndex> hnsw;
+        std::unique_ptr<IVFPQIndex> ivfpq;
+
+        // 冷层：与记忆库同一格式的只读文件，平时不参与检索，热层得分都低于 COLD_SEARCH_THRESHOLD 时才精确扫描
+        MemoryStoreFile cold_store;
+        MappedColumn<float> cold_vectors;
+        MappedColumn<float> cold_full_vectors;
+        MemoryMetadata cold_metadata;
+
+        // 行号整体改变 (淘汰或移除被整合的行) 的次数，用于丢弃按旧行号排队的命中记录
+        uint64_t generation = 0;
+
+        size_t rows() const { return vectors.rows(); }
+        const float* row(size_t index) const { return vectors.row(index); }
+        std::string_view summary(size_t index) const;
+        // 检索结果中一行 (热层或带 kColdRow 标记的冷层) 的摘要
+        std::string_view hit_summary(size_t index) const;
+        // 已被整合、等待下次合并移除的行 (检索与去重通过 MemoryMetadata::Selection 排除它们)
+        bool is_retired(size_t index) const { return metadata.retired(index); }
+    };
+
+    /**
+     * @brief 检索期间对公开副本的登记 (RAII)。登记之后写入方不会修改这份副本，直到登记撤销。
+     */
+    class ReadSnapshot {
+    public:
+        explicit ReadSnapshot(const MemoryManager& owner);
+        ~ReadSnapshot();
+        ReadSnapshot(const ReadSnapshot&) = delete;
+        ReadSnapshot& operator=(const ReadSnapshot&) = delete;
+
+        const Replica& operator*() const { return *replica_; }
+        const Replica* operator->() const { return replica_; }
+
+    private:
+        const MemoryManager& owner_;
+        size_t slot_ = 0;
+        const Replica* replica_ = nullptr;
+    };
+
+    // 检索结果中冷层行号带有的标记
+    static constexpr size_t kColdRow = size_t{1} << (sizeof(size_t) * 8 - 1);
+
+    std::string legacy_json_path_;
+    std::string store_path_;
+    // embedding接口返回的向量维度、降维方式，以及降维后实际存储与扫描的维度 (未降维时二者相同)
+    size_t embedding_dimension_ = 0;
+    std::unique_ptr<EmbeddingReducer> reducer_;
+    size_t dimension_ = 0;
+    // 降维时是否在记忆库中同时保存原始向量 (KEEP_FULL_VECTORS)
+    bool keep_full_vectors_ = false;
+
+    // 两份副本与当前公开的一份。检索不加锁：先在 active_ 所指副本的 readers_ 上登记，再确认 active_ 没有变化；
+    // 写入方切换 active_ 之后，等旧副本的登记数归零 (宽限期) 才修改它。
+    // 写入方之间由 write_mutex_ 串行化，持有它的线程可以直接读取公开副本
+    std::unique_ptr<Replica> replicas_[2];
+    std::atomic<size_t> active_{0};
+    struct alignas(64) ReaderCount {
+        std::atomic<size_t> count{0};
+    };
+    mutable ReaderCount readers_[2];
+    mutable std::mutex write_mutex_;
+    // 第二份副本重放同一修改期间为 true，避免重复输出日志、重复写索引文件
+    bool replaying_ = false;
+    // 修改到一半抛出异常的副本：内容已不可信，下次修改它之前从公开副本重建 (见 resync)
+    bool poisoned_[2] = {false, false};
+
+    // 检索命中的记录：检索线程只把它们排入队列，由下一次修改副本的写入方 (或后台线程) 一并应用，
+    // 更新访问时间与次数，并原地写入文件
+    struct Touch {
+        size_t index;        // 热层行号，或带 kColdRow 标记的冷层行号
+        int64_t when;
+        uint64_t generation; // 检索时副本的 generation，行号改变后作废
+    };
+    std::mutex touch_mutex_;
+    std::vector<Touch> touches_;
+
+    // 记忆库文件缺少当前需要的内容 (例如量化编码或访问记录)，下次合并时即使没有新增记忆也要重写
+    bool store_stale_ = false;
+
+    // 向量无效、不参与检索的记忆，等待后台重新生成embedding (按加入顺序)；由 write_mutex_ 保护
+    struct PendingEntry {
+        std::string summary;
+        MemoryMetadata::Attributes attributes;
+        uint32_t failures = 0; // 重新生成向量连续失败的次数 (不写入文件，重启后从0计)
+    };
+    std::vector<PendingEntry> pending_;
+
+    // 追加写日志，以及把它合并进记忆库文件的后台线程
+    std::unique_ptr<WriteAheadLog> wal_;
+    uint64_t compact_threshold_bytes_ = 0;
+    std::mutex compactor_mutex_;
+    std::condition_variable compactor_cv_;
+    bool compact_requested_ = false;
+    bool touches_requested_ = false; // 有排队的命中记录，由后台线程应用到副本
+    bool stopping_ = false;
+    std::thread compactor_;
+
+    // VECTOR_INDEX = "hnsw" 时的图参数
+    HNSWIndex::Params hnsw_params_;
+
+    // IVF-PQ索引 (码本离线训练，启动时映射)；ivfpq_saved_rows_ 为索引文件中已有的行数
+    std::string ivfpq_path_;
+    size_t ivfpq_nprobe_ = 16;
+    size_t ivfpq_saved_rows_ = 0;
+
+    size_t rerank_candidates_ = 64;
+
+    // 混合检索的参数
+    enum class RetrievalMode { Vector, Lexical, Hybrid };
+    RetrievalMode retrieval_mode_ = RetrievalMode::Hybrid;
+    bool lexical_enabled_ = true;
+    size_t fusion_candidates_ = 50; // 每一路参与融合的候选数
+    float rrf_k_ = 60.0f;           // RRF 平滑常数：得分为 1 / (rrf_k + 名次)
+
+    // 入库去重的相似度阈值；不在 (0, 1] 内时不去重
+    float dedup_threshold_ = 0.97f;
+
+    // 热层容量上限 (0 表示不限)：超出时由合并把 eviction_policy_ 排在最后的记忆移入冷层，
+    // 一次淘汰到上限的 90%，避免每次合并都要重建索引
+    enum class EvictionPolicy { Lru, Importance };
+    size_t capacity_ = 0;
+    EvictionPolicy eviction_policy_ = EvictionPolicy::Lru;
+    std::string cold_path_;
+    float cold_threshold_ = 0.5f;
+
+    // 暴力扫描 (含量化粗排) 的并行分片：行数不少于 parallel_scan_min_rows_ 时按线程数切分矩阵；
+    // 为空表示只用请求线程扫描
+    std::unique_ptr<ThreadPool> scan_pool_;
+    size_t parallel_scan_min_rows_ = 20000;
+
+    // 写入方修改副本 (调用方持有 write_mutex_，或仍在构造中)：先对后台副本应用排队的命中记录与 apply，
+    // 把它切换为公开副本，等旧副本上的检索全部结束后再对旧副本做同样的修改。
+    // apply 对两份副本各调用一次，只能依赖副本自身的状态与调用前就确定的参数。
+    // apply 抛出异常时：发生在切换之前则不公开任何修改、后台副本从公开副本重建，异常交给调用方；
+    // 发生在重放时修改已经公开，只重建旧副本并记录日志
+    void publish(const std::function<void(Replica&)>& apply);
+    // 丢弃 slot 号副本，按另一份 (公开副本) 的内容重建：映射同一个文件，复制尚未合并的行与内存中的元数据，重建索引
+    void resync(size_t slot);
+    void copy_replica(const Replica& source, Replica& target);
+    // 写入方读取当前公开的副本 (调用方持有 write_mutex_)
+    const Replica& current() const { return *replicas_[active_.load()]; }
+    // 检索线程：把命中记录排入队列，并唤醒后台线程应用 (检索线程自己从不等待写入方)
+    void record_touches(std::vector<Touch> touches);
+    void apply_touches(Replica& replica, const std::vector<Touch>& touches) const;
+    // 把已应用的命中记录原地写入记忆库与冷层文件 (publish 末尾调用)，不必为此重写整个文件
+    void persist_touches(const std::vector<Touch>& touches);
+
+    // 校验embedding接口返回的向量，写出归一化的原始向量与降维后归一化的向量；向量无效时返回 false
+    bool prepare_embedding(const float* data, size_t dim, std::vector<float>& full, std::vector<float>& reduced) const;
+    // 把 prepare_embedding 得到的一行追加到矩阵末尾 (需要时同时追加原始向量)
+    void append_row(Replica& replica, const std::string& summary, const float* reduced, const float* full,
+                    const MemoryMetadata::Attributes& attributes);
+    // 副本中是否有与每一行对应的原始向量
+    bool has_full_vectors(const Replica& replica) const {
+        return keep_full_vectors_ && replica.full_vectors.rows() == replica.rows();
+    }
+    enum class InsertResult { Appended, Pending, Merged };
+    // 有效向量入库 (并移出待处理队列)，无效向量放入待处理队列。
+    // attributes 未指定创建时间时，改为沿用队列中同一摘要的属性，否则取当前时间。
+    // deduplicate 为 true 且找到重复的记忆时，合并进该记忆并把其行号写入 *merged_into
+    InsertResult insert_entry(const std::string& summary, const float* data, size_t dim,
+                              MemoryMetadata::Attributes& attributes, bool deduplicate = false,
+                              size_t* merged_into = nullptr);
+    // 查找与新记忆余弦相似度不低于 dedup_threshold_ 且会话、角色都相同的记忆，没有时返回 rows()；
+    // 有原始向量时相似度按原始向量计算
+    size_t find_duplicate(const Replica& replica, const float* reduced, const float* full,
+                          const MemoryMetadata::Attributes& attributes) const;
+
+    // 记忆库文件的向量不是按当前降维方式生成时，用文件中的原始向量重新投影并重写文件
+    void convert_store(const std::string& path) const;
+    // 保存原始向量时挂接文件中的原始向量分段；没有该分段时 column 为空
+    void attach_full_vectors(const MemoryStoreFile& store, MappedColumn<float>& column, const std::string& path) const;
+    // 映射记忆库文件，并让向量列与量化编码直接指向文件内容
+    void open_store(Replica& replica);
+    // open_store 的后半部分：replica.store 已打开时挂接其中的向量、量化编码与元数据
+    void attach_store(Replica& replica);
+    // 读取文件中的待处理队列；旧版本写出的文件没有该分段，此时把其中的无效向量挪出并重写文件
+    void load_pending();
+    void compactor_loop();
+    void request_compaction();
+
+    // 映射IVF-PQ索引文件，并补编码文件之后新增的行；失败时记录错误并保持索引为空
+    void open_ivfpq(Replica& replica);
+    // 映射冷层文件 (不存在时冷层为空)
+    void open_cold_store(Replica& replica);
+    void attach_cold_store(Replica& replica);
+    // 按淘汰策略从 candidates (递增的行号) 中选出应保留的 target 行，返回递增的行号表
+    std::vector<uint32_t> select_survivors(const Replica& replica, std::vector<uint32_t> candidates,
+                                           size_t target) const;
+    // 把 victims 行与现有冷层写成新的冷层文件 (原子替换)
+    void write_cold_store(const Replica& replica, const std::vector<uint32_t>& victims) const;
+    // 为副本的全部行重新构建HNSW图
+    void build_hnsw(Replica& replica);
+    // 行号整体变化后重建字面倒排索引、HNSW与IVF-PQ索引
+    void rebuild_indexes(Replica& replica);
+    // 用原始向量为热层的候选重新计算得分 (叠加相同的附加得分)，保留前 k 条
+    void rerank_full(const Replica& replica, const float* query, std::vector<ScoredIndex>& hits, size_t k,
+                     int64_t when) const;
+    // 在冷层上精确检索前 k 条，行号带有 kColdRow 标记
+    std::vector<ScoredIndex> cold_search(const Replica& replica, const float* query, size_t k, int64_t when,
+                                         const MemoryMetadata::Selection& selection) const;
+
+    // 只用向量为 count 条查询各检索出前 k 条 (HNSW / IVF-PQ / 量化粗排+重排 / 暴力扫描)；
+    // queries 为 count 行已归一化的查询向量，只返回满足 selection 的行。
+    // with_bonus 为 true 时得分叠加 when 时刻的时间衰减与重要度，否则为纯余弦相似度
+    std::vector<std::vector<ScoredIndex>> vector_search(const Replica& replica, const float* queries, size_t count,
+                                                        size_t k, int64_t when,
+                                                        const MemoryMetadata::Selection& selection,
+                                                        bool with_bonus = true) const;
 
-    // 辅助函数，用于将内存中的DB写入文件
-    void save_memories_to_file();
+    // 逐条读取旧版JSON记忆文件，每条调用一次 on_entry(摘要, 向量)
+    static void read_legacy_json(const std::string& path,
+                                 const std::function<void(const std::string&, const std::vector<float>&)>& on_entry);
+    // 读取记忆库文件中的待处理队列；文件没有该分段 (旧版本写出) 时返回 false
+    static bool read_pending(const MemoryStoreFile& store, const std::string& path, std::vector<PendingEntry>& out);
+    // 将前 count 行与待处理队列写成新的记忆库文件 (原子替换)，wal_checkpoint 为对应的最后一条WAL序号；
+    // reducer 非空时写入降维标记，full_vectors 非空时同时写入原始向量；
+    // keep 非空时只写入其中列出的行 (行号递增)，新文件中的行号按 keep 中的顺序重新编排
+    static void write_store(const std::string& path, size_t dimension, const MappedColumn<float>& vectors, size_t count,
+                            const std::function<std::string_view(size_t)>& summary_at,
+                            const QuantizedVectors* quantized, const MemoryMetadata* metadata,
+                            const std::vector<PendingEntry>& pending, uint64_t wal_checkpoint,
+                            const EmbeddingReducer* reducer, const MappedColumn<float>* full_vectors,
+                            const std::vector<uint32_t>* keep = nullptr);
 };
 
-#endif // MEMORY_MANAGER_HPP
\ No newline at end of file
+#endif // MEMORY_MANAGER_HPP
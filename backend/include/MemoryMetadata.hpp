@@ -0,0 +1,210 @@
+#ifndef MEMORY_METADATA_HPP
+#define MEMORY_METADATA_HPP
+
+#include "MappedColumn.hpp"
+#include <cstdint>
+#include <string>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class MemoryStoreFile;
+class MemoryStoreWriter;
+
+/**
+ * @brief 检索时的过滤条件；各项之间为“与”关系，取默认值的项不参与过滤。
+ */
+struct MemoryFilter {
+    std::string session;                                            // 只检索该会话的记忆
+    std::string character;                                          // 只检索该角色的记忆
+    int64_t created_after = std::numeric_limits<int64_t>::min();    // 创建时间下限 (含)
+    int64_t created_before = std::numeric_limits<int64_t>::max();   // 创建时间上限 (不含)
+    uint64_t tags_all = 0;                                          // 必须同时带有的标签位
+    uint64_t tags_any = 0;                                          // 至少带有其中一个的标签位
+};
+
+/**
+ * @brief 每条记忆的元数据列，与向量矩阵按行号一一对应。
+ * 创建时间与重要度写入后不再改变，直接映射自记忆库文件；最近访问时间与访问次数随检索更新，
+ * 合并次数随入库去重更新，三者启动时复制到内存中维护，由 MemoryManager 原地改写文件中的对应元素
+ * (合并时也会整列写出)。
+ *
+ * 检索时的附加得分：recency_weight * 0.5^(距上次访问的时长 / 半衰期) + importance_weight * 重要度，
+ * 与余弦相似度相加后参与排序。
+ *
+ * 会话与角色以字符串登记在一个只增不减的标签字典中，列里只存编号；每个编号还维护一份
+ * 按行号递增的行表，按会话或角色过滤时只需访问这一部分行，而不是扫描全部记忆。
+ */
+class MemoryMetadata {
+public:
+    /**
+     * @brief 入库时确定、之后不变的记忆属性；随WAL记录一起持久化。
+     */
+    struct Attributes {
+        int64_t created = 0;      // 创建时间 (Unix 秒)
+        float importance = 0.5f;  // 重要度，0 ~ 1
+        uint64_t tags = 0;        // 标签位图，含义由调用方约定
+        std::string session;      // 所属会话，为空表示不属于任何会话
+        std::string character;    // 所属角色，为空表示不区分角色
+
+        /**
+         * @brief 编码为WAL附加数据。解码时缺少的字段保持默认值，以便日后追加新字段。
+         */
+        std::string encode() const;
+        static Attributes decode(std::string_view data);
+    };
+
+    struct Row {
+        int64_t created;
+        int64_t last_access;
+        uint32_t access_count;
+        float importance;
+        uint64_t tags = 0;
+        uint32_t session = 0;   // 标签字典中的编号，0 表示空
+        uint32_t character = 0;
+        uint32_t merge_count = 0; // 入库时被判为重复、合并进这条记忆的次数
+    };
+
+    struct Weights {
+        float recency = 0.0f;
+        float importance = 0.0f;
+        float half_life_hours = 168.0f;
+    };
+
+    /**
+     * @brief 编译后的过滤条件，只在所引用的元数据不被修改期间有效 (引用了元数据列与行表)。
+     */
+    class Selection {
+    public:
+        /**
+         * @brief 不可能有任何行满足 (例如指定的会话从未出现过)。
+         */
+        bool empty() const { return impossible_; }
+        /**
+         * @brief 没有任何过滤条件，也没有被整合替换、等待移除的行。
+         */
+        bool unrestricted() const { return unrestricted_; }
+        /**
+         * @brief 满足会话/角色条件的行表 (行号递增)，是所有可能命中行的超集；没有这两项条件时为 nullptr。
+         */
+        const std::vector<uint32_t>* candidates() const { return candidates_; }
+
+        bool matches(size_t index) const;
+        /**
+         * @brief 为 [begin, begin + count) 行生成位图：bits 的第 i 位为1表示第 begin + i 行满足条件。
+         * @return 是否至少有一行满足。
+         */
+        bool mask(size_t begin, size_t count, uint64_t* bits) const;
+
+    private:
+        friend class MemoryMetadata;
+        bool retired(size_t index) const;
+        // 从第 index 行起的64行中被整合替换的行的位图
+        uint64_t retired_word(size_t index) const;
+
+        const MemoryMetadata* metadata_ = nullptr;
+        bool unrestricted_ = true;
+        bool only_retired_ = false; // 唯一的条件是排除被整合替换的行
+        bool impossible_ = false;
+        uint32_t session_ = 0;
+        uint32_t character_ = 0;
+        int64_t created_after_ = 0;
+        int64_t created_before_ = 0;
+        uint64_t tags_all_ = 0;
+        uint64_t tags_any_ = 0;
+        const std::vector<uint32_t>* candidates_ = nullptr;
+    };
+
+    explicit MemoryMetadata(const Weights& weights);
+
+    static int64_t now();
+
+    /**
+     * @brief 是否需要为检索计算附加得分 (两个权重都为0时可以跳过)。
+     */
+    bool scoring() const { return weights_.recency != 0.0f || weights_.importance != 0.0f; }
+    const Weights& weights() const { return weights_; }
+
+    size_t size() const { return created_.rows(); }
+    void append(const Row& row);
+    void append(const Attributes& attributes);
+    /**
+     * @brief 追加另一份元数据中的一行 (含访问时间与次数)，会话与角色按字符串在本字典中重新登记。
+     */
+    void appendFrom(const MemoryMetadata& other, size_t index);
+    Row row(size_t index) const;
+    Attributes attributes(size_t index) const;
+    /**
+     * @brief 清空所有行；标签字典保留，使合并前后同一标签的编号不变。
+     */
+    void clear();
+
+    /**
+     * @brief 将过滤条件中的会话、角色解析为编号，供扫描与索引遍历时逐行判断。
+     */
+    Selection select(const MemoryFilter& filter) const;
+
+    /**
+     * @brief 记录一次被检索命中：更新最近访问时间并累加访问次数。
+     */
+    void touch(size_t index, int64_t when);
+    /**
+     * @brief 直接设置最近访问时间与访问次数 (例如整合后的记忆继承被替换记忆的访问记录)。
+     */
+    void setAccess(size_t index, int64_t last_access, uint32_t access_count);
+    /**
+     * @brief 记录一次入库去重：累加合并次数。不改变访问记录，重复的内容不会因此显得刚被检索过。
+     */
+    void merge(size_t index);
+    void setMergeCount(size_t index, uint32_t merge_count);
+
+    /**
+     * @brief 标记一行已被整合替换：之后编译的过滤条件 (Selection) 都会排除它，检索、去重与整合都不再看到它，
+     * 直到合并把它从文件中移除 (clear / attach 时清空标记)。
+     */
+    void retire(size_t index);
+    bool retired(size_t index) const;
+    size_t retiredCount() const { return retired_count_; }
+    /**
+     * @brief 计算 [begin, begin + count) 行的附加得分，写入 out[0 .. count)。
+     */
+    void bonuses(size_t begin, size_t count, int64_t when, float* out) const;
+    float bonus(size_t index, int64_t when) const;
+
+    /**
+     * @brief 挂接记忆库文件中的元数据分段。缺少会话/角色/标签分段的文件按“未设置”处理，缺少合并次数时按0处理。
+     * @return 文件中没有元数据 (旧版本写出的文件) 时返回 false，调用方应为每行追加默认值。
+     */
+    bool attach(const MemoryStoreFile& store);
+    /**
+     * @brief 写入前 rows 行的元数据分段；keep 非空时只写入其中列出的行 (行号递增)，标签字典总是完整写入。
+     */
+    void writeSections(MemoryStoreWriter& writer, size_t rows, const std::vector<uint32_t>* keep = nullptr) const;
+
+private:
+    uint32_t intern(const std::string& label);
+    uint32_t find_label(const std::string& label) const;
+    void index_row(size_t index, uint32_t session, uint32_t character);
+
+    Weights weights_;
+    MappedColumn<int64_t> created_;
+    MappedColumn<float> importance_;
+    MappedColumn<uint64_t> tags_;
+    MappedColumn<uint32_t> session_;
+    MappedColumn<uint32_t> character_;
+    std::vector<int64_t> last_access_;
+    std::vector<uint32_t> access_count_;
+    std::vector<uint32_t> merge_count_;
+    // 被整合替换的行的位图 (按需增长) 与行数
+    std::vector<uint64_t> retired_bits_;
+    size_t retired_count_ = 0;
+
+    // 标签字典 (编号0固定为空字符串)，以及每个编号对应的会话行表与角色行表
+    std::vector<std::string> labels_;
+    std::unordered_map<std::string, uint32_t> label_ids_;
+    std::vector<std::vector<uint32_t>> session_rows_;
+    std::vector<std::vector<uint32_t>> character_rows_;
+};
+
+#endif // MEMORY_METADATA_HPP
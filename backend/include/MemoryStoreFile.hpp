@@ -0,0 +1,185 @@
+#ifndef MEMORY_STORE_FILE_HPP
+#define MEMORY_STORE_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @brief 记忆库的二进制文件格式 (只读映射)。
+ *
+ * 布局：
+ *   [文件头] 魔数 "LINGMEM\0"、格式版本、向量维度、记忆条数、分段目录 (写入时预留 kMaxSections 项)
+ *   [分段]   每段按64字节对齐，目录中记录 (段ID, 偏移, 字节数)
+ *            - Vectors:        count * dimension 个 float32，定长行距，已L2归一化
+ *            - SummaryOffsets: count + 1 个 uint64，第 i 条摘要位于 [offsets[i], offsets[i+1])
+ *            - SummaryHeap:    所有摘要的 UTF-8 字节首尾相接
+ *            - WalCheckpoint:  一个 uint64，已合并进本文件的最后一条WAL记录的序号
+ *            - PendingSummaries: 向量无效、等待重新生成embedding的记忆，每条为 [u32 字节数][摘要]
+ *            - CreatedAt / LastAccess / AccessCount / Importance / Tags / SessionIds / CharacterIds:
+ *                              每条记忆的元数据列 (见 MemoryMetadata)
+ *            - Labels:         会话与角色的标签字典，每项为 [u32 字节数][UTF-8]，编号从1开始
+ *            - PendingAttributes: 与待处理队列一一对应的属性，每条为 [u32 字节数][编码后的属性]
+ *            - Reduction:      向量经过降维时的降维方式标记，此时文件头中的维度为降维后的维度
+ *            - FullVectors:    可选，降维前的原始向量 (已L2归一化)，用于全精度重排与更换降维方式时重新投影
+ *            - 其余可选段 (量化编码等) 由各自的模块解释，读取时不认识的段会被忽略
+ * 所有整数按本机字节序 (小端) 存放。
+ *
+ * 文件通过 mmap 打开，启动时只读取文件头，向量按需由操作系统换入，且在多次重启之间共享页缓存。
+ */
+class MemoryStoreFile {
+public:
+    enum SectionId : uint32_t {
+        Vectors = 1,
+        SummaryOffsets = 2,
+        SummaryHeap = 3,
+        Int8Codes = 4,
+        Int8Scales = 5,
+        HalfCodes = 6,
+        WalCheckpoint = 7,
+        PendingSummaries = 8,
+        CreatedAt = 9,
+        LastAccess = 10,
+        AccessCount = 11,
+        Importance = 12,
+        Tags = 13,
+        SessionIds = 14,
+        CharacterIds = 15,
+        Labels = 16,
+        PendingAttributes = 17,
+        // IVF-PQ 索引文件 (与记忆库同一格式的独立文件，见 IVFPQIndex)
+        IvfParams = 18,
+        IvfCentroids = 19,
+        IvfCodebooks = 20,
+        IvfListOffsets = 21,
+        IvfListIds = 22,
+        IvfListCodes = 23,
+        // 降维存储 (见 EmbeddingReducer)：记忆库中的降维标记与原始向量，以及独立的PCA投影文件
+        Reduction = 24,
+        FullVectors = 25,
+        PcaParams = 26,
+        PcaComponents = 27,
+        MergeCount = 28,
+    };
+
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kMaxSections = 32;
+
+    MemoryStoreFile() = default;
+    ~MemoryStoreFile();
+
+    MemoryStoreFile(const MemoryStoreFile&) = delete;
+    MemoryStoreFile& operator=(const MemoryStoreFile&) = delete;
+
+    /**
+     * @brief 映射并校验一个记忆库文件。格式错误时抛出 std::runtime_error。
+     */
+    void open(const std::string& path);
+    /**
+     * @brief 映射与记忆库同一格式的辅助文件 (例如IVF-PQ索引)，只校验文件头与分段目录。
+     */
+    void openAuxiliary(const std::string& path);
+    /**
+     * @brief 映射 other 已打开的同一个文件 (经由其描述符，即使路径上已经换成了新文件)；other 未打开时只关闭本对象。
+     */
+    void share(const MemoryStoreFile& other);
+    void close();
+
+    /**
+     * @brief 判断文件是否以记忆库魔数开头 (用于区分旧的 memory.json)。
+     */
+    static bool isStoreFile(const std::string& path);
+
+    bool isOpen() const { return base_ != nullptr; }
+    size_t dimension() const { return dimension_; }
+    size_t count() const { return count_; }
+    const float* vectors() const;
+    std::string_view summary(size_t index) const;
+
+    /**
+     * @brief 文件中记录的WAL检查点；序号不大于它的WAL记录已包含在本文件中。
+     */
+    uint64_t walCheckpoint() const;
+
+    /**
+     * @brief 查找一个分段，不存在时返回 nullptr。
+     */
+    const void* section(uint32_t id, size_t* size) const;
+
+    /**
+     * @brief 原地改写定长分段中的若干元素 (例如访问记录)，不重写整个文件。values 依次存放 indices 中
+     * 各元素的新值，每个 element_size 字节。只用 pwrite 写入、不主动落盘；分段不存在、大小不符，
+     * 或路径上已经是另一个文件 (例如合并刚替换了记忆库) 时不写入并返回 false。
+     */
+    bool patch(uint32_t id, size_t element_size, const std::vector<size_t>& indices, const void* values) const;
+
+private:
+    // 映射文件并读取文件头与分段目录，格式错误时关闭并抛出 std::runtime_error
+    void map_file(const std::string& path);
+    // 映射 fd 所指的文件并读取文件头与分段目录；fd 的所有权转交本对象 (失败时关闭)
+    void map_descriptor(int fd, const std::string& path);
+
+    struct SectionEntry {
+        uint32_t id;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    std::string path_;
+    int fd_ = -1; // 只读描述符，保留到 close()，供 share 映射同一个文件
+    dev_t device_ = 0;
+    ino_t inode_ = 0;
+    void* base_ = nullptr;
+    size_t mapped_size_ = 0;
+    size_t dimension_ = 0;
+    size_t count_ = 0;
+    std::vector<SectionEntry> sections_;
+    const uint64_t* summary_offsets_ = nullptr;
+    const char* summary_heap_ = nullptr;
+
+    friend class MemoryStoreWriter;
+};
+
+/**
+ * @brief 记忆库文件的写入器。
+ * 先写入同目录下的临时文件，commit() 时 fsync 并原子地 rename 覆盖目标文件，
+ * 因此正在映射旧文件的读者不受影响，写到一半崩溃也不会留下损坏的记忆库。
+ */
+class MemoryStoreWriter {
+public:
+    MemoryStoreWriter(const std::string& path, size_t dimension, size_t count);
+    ~MemoryStoreWriter();
+
+    MemoryStoreWriter(const MemoryStoreWriter&) = delete;
+    MemoryStoreWriter& operator=(const MemoryStoreWriter&) = delete;
+
+    void beginSection(uint32_t id);
+    void write(const void* data, size_t bytes);
+    void endSection();
+
+    /**
+     * @brief 写入文件头与分段目录，落盘并替换目标文件。失败时抛出 std::runtime_error。
+     */
+    void commit();
+
+private:
+    void write_fully(const char* data, size_t bytes);
+    void flush();
+
+    std::string path_;
+    std::string temp_path_;
+    int fd_ = -1;
+    size_t dimension_;
+    size_t count_;
+    uint64_t position_ = 0;
+    bool in_section_ = false;
+    bool committed_ = false;
+    std::vector<MemoryStoreFile::SectionEntry> sections_;
+    std::vector<char> buffer_;
+};
+
+#endif // MEMORY_STORE_FILE_HPP
@@ -0,0 +1,62 @@
+#ifndef PROMPT_TEMPLATE_HPP
+#define PROMPT_TEMPLATE_HPP
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief 系统提示词模板 (PROMPT_FILE)。
+ * 文件只在首次使用与修改时间变化时读取，并预先编译为“文字块 + 占位符”的序列；
+ * 每轮对话只需按总长度预留一次空间再依次拼接，不再读盘或在整段文本中查找替换。
+ *
+ * 占位符 (可出现多次)：[CONVERSATION_MEMORY] 检索到的记忆、[SCENE] 当前场景、[TIME] 当前时间、
+ * [CHARACTER_NAME] 角色名。
+ */
+class PromptTemplate {
+public:
+    struct Values {
+        std::string_view memory;
+        std::string_view scene;
+        std::string_view time;
+        std::string_view character;
+    };
+
+    explicit PromptTemplate(std::string path);
+
+    /**
+     * @brief 用 values 填充占位符生成提示词。距上次检查超过 kReloadCheckInterval 时比较文件的修改时间，
+     * 变化后重新读取；文件不存在或无法读取时沿用上一次的内容 (从未读到时为空)。
+     */
+    std::string render(const Values& values);
+
+    static constexpr std::chrono::seconds kReloadCheckInterval{2};
+
+private:
+    enum class Slot { None, Memory, Scene, Time, Character };
+    struct Part {
+        std::string literal; // 占位符之前的文字
+        Slot slot;           // 其后的占位符，最后一块为 None
+    };
+    struct Compiled {
+        std::vector<Part> parts;
+        size_t literal_bytes = 0;
+    };
+
+    static std::shared_ptr<const Compiled> compile(const std::string& text);
+    // 需要时重新读取文件，返回当前的编译结果
+    std::shared_ptr<const Compiled> current();
+
+    std::string path_;
+    std::mutex mutex_;
+    std::shared_ptr<const Compiled> compiled_;
+    std::filesystem::file_time_type mtime_{};
+    std::chrono::steady_clock::time_point next_check_{};
+    bool missing_logged_ = false;
+};
+
+#endif // PROMPT_TEMPLATE_HPP
@@ -0,0 +1,79 @@
+#ifndef QUANTIZED_VECTORS_HPP
+#define QUANTIZED_VECTORS_HPP
+
+#include "MappedColumn.hpp"
+#include "TopK.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class MemoryStoreFile;
+class MemoryStoreWriter;
+
+/**
+ * @brief 记忆向量的标量量化副本，用于第一遍的粗排扫描。
+ * int8 模式下每行保存 dimension 个int8编码和一个缩放系数；fp16 模式下每行保存 dimension 个半精度数。
+ * 粗排得到的候选再用全精度向量重新打分。
+ */
+class QuantizedVectors {
+public:
+    enum class Mode { None, Int8, Fp16 };
+
+    /**
+     * @brief 查询向量的编码：int8 模式下查询同样被量化，fp16 模式下查询保持 float。
+     */
+    struct Query {
+        const float* values = nullptr;
+        std::vector<int8_t> codes;
+        float scale = 0.0f;
+    };
+
+    QuantizedVectors(Mode mode, size_t dimension);
+
+    /**
+     * @brief 解析 VECTOR_QUANTIZATION 配置值 ("none" / "int8" / "fp16")，无法识别时返回 None。
+     */
+    static Mode parseMode(const std::string& value);
+    static const char* modeName(Mode mode);
+
+    Mode mode() const { return mode_; }
+    bool enabled() const { return mode_ != Mode::None; }
+    size_t size() const;
+    size_t bytesPerRow() const;
+
+    /**
+     * @brief 追加一行 (应当已经L2归一化) 的量化编码。
+     */
+    void append(const float* row);
+    void clear();
+
+    /**
+     * @brief 直接映射记忆库文件中已保存的编码分段，避免启动时重新量化整个矩阵。
+     * @return 文件中没有当前模式的编码 (或条数不符) 时返回 false，调用方应逐行 append 重建。
+     */
+    bool attach(const MemoryStoreFile& store);
+
+    /**
+     * @brief 将前 rows 行的编码作为附加分段写入记忆库文件；keep 非空时只写入其中列出的行 (行号递增)。
+     */
+    void writeSections(MemoryStoreWriter& writer, size_t rows, const std::vector<uint32_t>* keep = nullptr) const;
+
+    Query encodeQuery(const float* query) const;
+
+    /**
+     * @brief 在编码上扫描 [begin, end) 行，把近似得分推入 selector。
+     * @param bias 可选的逐行附加得分 (bias[i] 对应第 begin + i 行)，与近似得分相加后再参与排序。
+     * @param mask 可选的行位图 (第 i 位对应第 begin + i 行)，为0的行跳过不计算。
+     */
+    void scan(const Query& query, size_t begin, size_t end, TopK& selector, const float* bias = nullptr,
+              const uint64_t* mask = nullptr) const;
+
+private:
+    Mode mode_;
+    size_t dimension_;
+    MappedColumn<int8_t> int8_codes_;
+    MappedColumn<float> int8_scales_;
+    MappedColumn<uint16_t> half_codes_;
+};
+
+#endif // QUANTIZED_VECTORS_HPP
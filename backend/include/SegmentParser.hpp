@@ -0,0 +1,54 @@
+#ifndef SEGMENT_PARSER_HPP
+#define SEGMENT_PARSER_HPP
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief 回复中的一句台词：【表情】中文台词(动作)<日语台词>。
+ */
+struct ReplySegment {
+    std::string expression;
+    std::string action;   // 中文部分第一对半角括号中的内容，没有时为空
+    std::string text_cn;  // 去掉所有括号部分后的中文台词
+    std::string text_jp;
+};
+
+/**
+ * @brief 逐字节解析模型回复的增量解析器，可以直接消费流式生成中的文本片段 (片段可以在UTF-8字符中间断开)。
+ * 每句台词在其结尾的 '>' 到达时立即回调，不必等整段回复生成完毕。
+ *
+ * 匹配规则与正则 "【(.+?)】(.+?)<(.+?)>" 逐句搜索的结果一致：三部分都至少一个字符且不跨行，
+ * 遇到换行时放弃当前这句、从换行之后重新寻找 "【"；末尾未闭合的一句不会输出。
+ * 各字段的缓冲区在解析器内部复用，稳定之后解析不再分配内存。
+ */
+class SegmentParser {
+public:
+    using Callback = std::function<void(const ReplySegment&)>;
+
+    /**
+     * @brief 消费一段文本，每解析出一句完整的台词就调用一次 on_segment (参数只在回调期间有效)。
+     * @return 本次解析出的台词数。
+     */
+    size_t feed(std::string_view text, const Callback& on_segment);
+
+    /**
+     * @brief 丢弃未完成的一句，准备解析下一段回复。
+     */
+    void reset();
+
+private:
+    enum class State { Seek, Expression, Middle, Japanese };
+
+    void emit(const Callback& on_segment);
+
+    State state_ = State::Seek;
+    int marker_ = 0; // Seek 状态下已匹配的 "【" 字节数
+    std::string expression_;
+    std::string middle_;
+    std::string japanese_;
+    ReplySegment segment_;
+};
+
+#endif // SEGMENT_PARSER_HPP
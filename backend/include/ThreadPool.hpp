@@ -0,0 +1,46 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 固定数量工作线程的线程池，用于把一次检索的扫描拆成若干分片并行执行。
+ * 多个请求线程可以同时提交；提交者自己也参与执行分片，因此即使工作线程都在忙，
+ * 调用也总能完成，不会互相等待而死锁。
+ */
+class ThreadPool {
+public:
+    /**
+     * @param workers 工作线程数 (不含调用线程)，为0时 run() 退化为在调用线程上顺序执行。
+     */
+    explicit ThreadPool(size_t workers);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t workers() const { return workers_.size(); }
+
+    /**
+     * @brief 执行 task(0) ... task(count - 1)，全部完成后返回。
+     * 任务抛出的第一个异常会在所有任务结束后由本函数重新抛出。
+     */
+    void run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    void worker_loop();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    bool stopping_ = false;
+};
+
+#endif // THREAD_POOL_HPP
@@ -0,0 +1,58 @@
+#ifndef TOP_K_HPP
+#define TOP_K_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief 检索结果：一行记忆的下标及其得分。
+ */
+struct ScoredIndex {
+    float score;
+    size_t index;
+};
+
+/**
+ * @brief 有界最小堆，用于在扫描过程中只保留得分最高的 k 个下标。
+ * 堆顶是当前 k 个结果中得分最低的一个，新得分只需与它比较一次。
+ */
+class TopK {
+public:
+    explicit TopK(size_t k) : k_(k) { heap_.reserve(k); }
+
+    void push(float score, size_t index) {
+        if (k_ == 0) return;
+        if (heap_.size() < k_) {
+            heap_.push_back({score, index});
+            std::push_heap(heap_.begin(), heap_.end(), worse_first);
+        } else if (score > heap_.front().score) {
+            std::pop_heap(heap_.begin(), heap_.end(), worse_first);
+            heap_.back() = {score, index};
+            std::push_heap(heap_.begin(), heap_.end(), worse_first);
+        }
+    }
+
+    /**
+     * @brief 按得分从高到低取出结果，调用后选择器被清空。
+     */
+    std::vector<ScoredIndex> take_sorted() {
+        std::sort_heap(heap_.begin(), heap_.end(), worse_first);
+        std::vector<ScoredIndex> result;
+        result.swap(heap_);
+        return result;
+    }
+
+    size_t size() const { return heap_.size(); }
+
+private:
+    // std::*_heap 构造的是最大堆，这里反转比较方向，使得分最低的元素位于堆顶
+    static bool worse_first(const ScoredIndex& a, const ScoredIndex& b) {
+        return a.score > b.score;
+    }
+
+    size_t k_;
+    std::vector<ScoredIndex> heap_;
+};
+
+#endif // TOP_K_HPP
@@ -0,0 +1,57 @@
+#ifndef VECTOR_MATH_HPP
+#define VECTOR_MATH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief 向量检索用到的数学内核。
+ * 点积在运行时根据 CPU 特性选择 AVX-512 / AVX2 / NEON 实现，都不支持时回退到标量版本。
+ * 除 float32 外还提供 int8 与 fp16 编码向量的点积，供量化存储使用。
+ */
+class VectorMath {
+public:
+    /**
+     * @brief 计算两个长度为 n 的向量的点积。
+     * 对已经L2归一化的向量而言，点积就是余弦相似度。
+     */
+    static float dot(const float* a, const float* b, size_t n);
+
+    /**
+     * @brief 同时计算4个向量与同一个向量 b 的点积：out[j] = dot(a + j * stride, b, n)。
+     * b 的每一段只从内存读取一次，供多个查询批量扫描同一块矩阵时使用。
+     */
+    static void dot4(const float* a, size_t stride, const float* b, size_t n, float* out);
+
+    /**
+     * @brief 两个int8编码向量的整数点积，乘以两者的缩放系数即为近似的浮点点积。
+     */
+    static int32_t dotInt8(const int8_t* a, const int8_t* b, size_t n);
+
+    /**
+     * @brief float 向量与 fp16 编码向量的点积。
+     */
+    static float dotHalf(const float* a, const uint16_t* b, size_t n);
+
+    /**
+     * @brief 将向量对称量化为int8编码 (范围 [-127, 127])。
+     * @return 缩放系数，满足 v[i] ≈ codes[i] * scale。
+     */
+    static float quantizeInt8(const float* v, int8_t* codes, size_t n);
+
+    static uint16_t floatToHalf(float value);
+    static float halfToFloat(uint16_t value);
+
+    /**
+     * @brief 将向量原地归一化为单位长度。
+     * @return 归一化之前的模长；模长为0的向量保持不变。
+     */
+    static float normalize(float* v, size_t n);
+
+    /**
+     * @brief 当前进程实际使用的内核名称，用于日志。
+     */
+    static const char* kernelName();
+};
+
+#endif // VECTOR_MATH_HPP
@@ -38,9 +38,12 @@ private:
     static int websocket_data_handler(mg_connection* conn, int flags, char* data, size_t data_len, void* ws_server_ptr);
     static void websocket_close_handler(const mg_connection* conn, void* ws_server_ptr);
     static int civetweb_error_log_handler(const mg_connection* conn, const char* message);
+    // GET /metrics：以 Prometheus 文本格式输出运行指标 (目前为embedding缓存的命中情况)
+    static int metrics_handler(mg_connection* conn, void* ws_server_ptr);
 
     // 内部工具函数
-    void send_websocket_message(mg_connection* conn, const std::string& message);
+    // verbose 为 false 时不记录日志 (流式转发的每一小段)
+    void send_websocket_message(mg_connection* conn, const std::string& message, bool verbose = true);
     void log_info(const std::string& message) const;
     void log_error(const std::string& message) const;
     void log_warning(const std::string& message) const;
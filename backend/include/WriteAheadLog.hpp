@@ -0,0 +1,81 @@
+#ifndef WRITE_AHEAD_LOG_HPP
+#define WRITE_AHEAD_LOG_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 记忆库的追加写日志 (WAL)。
+ * 每次 addMemory 只向日志末尾追加一条带长度和CRC32校验的记录，持久化代价与记忆总数无关；
+ * 启动时回放尚未合并进记忆库文件的记录，合并 (compaction) 完成后再截掉已合并的部分。
+ *
+ * 记录格式：[u32 负载长度][u32 负载CRC32][负载]
+ * 负载：    [u64 序号][u32 摘要字节数][摘要][u32 维度][维度个 float32][u32 附加字节数][附加数据]
+ * 附加数据 (时间戳、重要度等记忆属性) 由调用方编码，日志不解释其内容；早期版本写出的记录没有这一段。
+ */
+class WriteAheadLog {
+public:
+    enum class FsyncPolicy {
+        Always,   // 每条记录写入后立即 fdatasync，崩溃不丢数据
+        Interval, // 由后台线程每隔一段时间 fdatasync 一次，最多丢失一个间隔内的记录
+        Never,    // 完全交给操作系统回写
+    };
+
+    using ReplayFn = std::function<void(uint64_t seq, const std::string& summary, const std::vector<float>& embedding,
+                                        const std::string& extra)>;
+
+    WriteAheadLog(const std::string& path, FsyncPolicy policy, unsigned fsync_interval_ms);
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    /**
+     * @brief 解析 WAL_FSYNC 配置值 ("always" / "interval" / "never")，无法识别时返回 Interval。
+     */
+    static FsyncPolicy parsePolicy(const std::string& value);
+
+    /**
+     * @brief 按顺序回放序号大于 after_seq 的记录。
+     * 遇到不完整或校验失败的尾部记录 (例如写到一半时崩溃) 会将其截断并停止。
+     */
+    void replay(uint64_t after_seq, const ReplayFn& on_record);
+
+    /**
+     * @brief 追加一条记录，返回分配给它的序号。失败时抛出 std::runtime_error。
+     */
+    uint64_t append(const std::string& summary, const float* embedding, size_t dimension, std::string_view extra = {});
+
+    /**
+     * @brief 丢弃序号不大于 seq 的记录 (它们已经合并进记忆库文件)，保留之后的记录。
+     */
+    void truncateThrough(uint64_t seq);
+
+    uint64_t lastSeq() const;
+    uint64_t bytes() const;
+
+private:
+    void open_for_append();
+    void flusher_loop();
+
+    std::string path_;
+    FsyncPolicy policy_;
+    unsigned fsync_interval_ms_;
+    int fd_ = -1;
+    uint64_t bytes_ = 0;
+    uint64_t next_seq_ = 1;
+    bool unsynced_ = false;
+
+    mutable std::mutex mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    std::thread flusher_;
+};
+
+#endif // WRITE_AHEAD_LOG_HPP
@@ -7,10 +7,17 @@
 #include <stdexcept>
 #include <iostream>
 #include <sstream>
-#include <fstream>
 #include <regex>
 #include <string>
 #include <algorithm>
+#include <chrono>
+
+namespace {
+
+// 没有检索到记忆 (或未启用RAG) 时填入 [CONVERSATION_MEMORY] 的内容
+constexpr std::string_view kNoMemories = "无相关记忆。";
+
+} // namespace
 
 AIEngine::AIEngine(ConfigManager& config, MemoryManager& memory_manager)
     : config_(config), 
@@ -18,7 +25,16 @@ AIEngine::AIEngine(ConfigManager& config, MemoryManager& memory_manager)
       // 使用 [API_LLM] 部分的Key初始化llmHttpClient_
       llmHttpClient_(config.get("API_LLM", "DEEPSEEK_API_KEY")),
       // 使用 [API_EMBEDDING] 部分的Key初始化embeddingHttpClient_
-      embeddingHttpClient_(config.get("API_EMBEDDING", "EMBEDDING_API_KEY"))
+      embeddingHttpClient_(config.get("API_EMBEDDING", "EMBEDDING_API_KEY")),
+      reembedHttpClient_(config.get("API_EMBEDDING", "EMBEDDING_API_KEY")),
+      consolidateLlmClient_(config.get("API_LLM", "DEEPSEEK_API_KEY")),
+      consolidateEmbeddingClient_(config.get("API_EMBEDDING", "EMBEDDING_API_KEY")),
+      writebackEmbeddingClient_(config.get("API_EMBEDDING", "EMBEDDING_API_KEY")),
+      prompt_template_(config.get("SystemPrompt", "PROMPT_FILE", "prompt.txt")),
+      embedding_dimension_(std::stoul(config.get("API_EMBEDDING", "EMBEDDING_VECTOR_DIMENSION", "1024"))),
+      embedding_cache_(config.get("API_EMBEDDING", "EMBEDDING_CACHE_PATH", "embedding_cache.bin"),
+                       static_cast<size_t>(std::stoul(config.get("API_EMBEDDING", "EMBEDDING_CACHE_MB", "32"))) << 20,
+                       embedding_dimension_)
 {
     // 从 [API_LLM] 加载聊天模型配置
     llm_model_ = config.get("AI", "MODEL", "deepseek-chat");
@@ -34,141 +50,572 @@ AIEngine::AIEngine(ConfigManager& config, MemoryManager& memory_manager)
     std::transform(rag_flag_str.begin(), rag_flag_str.end(), rag_flag_str.begin(), 
                    [](unsigned char c){ return std::tolower(c); });
     rag_enabled_ = (rag_flag_str == "true");
+    std::string stream_flag = config.get("AI", "STREAM_RESPONSE", "true");
+    std::transform(stream_flag.begin(), stream_flag.end(), stream_flag.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    stream_enabled_ = (stream_flag == "true");
+
+    character_name_ = config.get("Character", "CHARACTER_NAME", "");
+    std::string scope = config.get("AI", "MEMORY_SCOPE", "shared");
+    std::transform(scope.begin(), scope.end(), scope.begin(), [](unsigned char c){ return std::tolower(c); });
+    memory_scoped_ = scope == "character" && !character_name_.empty();
+
+    reembed_batch_size_ = std::max<size_t>(1, std::stoul(config.get("API_EMBEDDING", "REEMBED_BATCH_SIZE", "16")));
+    reembed_interval_seconds_ = std::max(1u, static_cast<unsigned>(
+        std::stoul(config.get("API_EMBEDDING", "REEMBED_INTERVAL_SECONDS", "60"))));
+
+    consolidation_interval_minutes_ = static_cast<unsigned>(
+        std::stoul(config.get("AI", "CONSOLIDATION_INTERVAL_MINUTES", "60")));
+    consolidation_min_age_hours_ = static_cast<unsigned>(
+        std::stoul(config.get("AI", "CONSOLIDATION_MIN_AGE_HOURS", "168")));
+    consolidation_similarity_ = std::stof(config.get("AI", "CONSOLIDATION_SIMILARITY", "0.8"));
+    consolidation_min_cluster_ = std::max<size_t>(2, std::stoul(config.get("AI", "CONSOLIDATION_MIN_CLUSTER", "4")));
+    consolidation_max_cluster_ = std::max(consolidation_min_cluster_,
+                                          static_cast<size_t>(std::stoul(config.get("AI", "CONSOLIDATION_MAX_CLUSTER", "16"))));
+    consolidation_max_per_run_ = std::stoul(config.get("AI", "CONSOLIDATION_MAX_PER_RUN", "8"));
+
+    // embedding接口与后台LLM请求的超时，停止时等待后台线程的时间因此有上限
+    long embedding_timeout = std::stol(config.get("API_EMBEDDING", "EMBEDDING_TIMEOUT_SECONDS", "30"));
+    for (HTTPClient* client : {&embeddingHttpClient_, &reembedHttpClient_, &consolidateEmbeddingClient_, &writebackEmbeddingClient_}) {
+        client->setTimeout(embedding_timeout);
+    }
+    consolidateLlmClient_.setTimeout(std::stol(config.get("API_LLM", "BACKGROUND_TIMEOUT_SECONDS", "120")));
 
     if (rag_enabled_) {
         Logger::logInfo("AIEngine 已初始化。RAG记忆系统: [已启用]");
+        writeback_queue_max_ = std::max<size_t>(1, std::stoul(config.get("AI", "WRITEBACK_QUEUE_MAX", "256")));
+        writeback_drain_seconds_ = static_cast<unsigned>(std::stoul(config.get("AI", "WRITEBACK_DRAIN_SECONDS", "10")));
+        try {
+            // 上次运行中排队、还没写入记忆库的对话重新入队
+            writeback_journal_ = std::make_unique<WriteAheadLog>(
+                config.get("Database", "WRITEBACK_JOURNAL_PATH", "memory_writeback.wal"),
+                WriteAheadLog::parsePolicy(config.get("Database", "WAL_FSYNC", "interval")),
+                static_cast<unsigned>(std::stoul(config.get("Database", "WAL_FSYNC_INTERVAL_MS", "1000"))));
+            writeback_journal_->replay(0, [this](uint64_t seq, const std::string& summary, const std::vector<float>&,
+                                                 const std::string& extra) {
+                writeback_queue_.push_back({summary, MemoryMetadata::Attributes::decode(extra), seq});
+            });
+            if (!writeback_queue_.empty()) {
+                Logger::logInfo("上次运行中有 " + std::to_string(writeback_queue_.size()) + " 条对话尚未写入记忆库，已重新排队。");
+            }
+        } catch (const std::exception& e) {
+            Logger::logError(std::string(e.what()) + "，排队中的对话记忆将只保存在内存中。");
+            writeback_journal_.reset();
+        }
+        writeback_thread_ = std::thread(&AIEngine::writebackLoop, this);
+        if (!embedding_api_url_.empty()) {
+            reembed_thread_ = std::thread(&AIEngine::reembedLoop, this);
+            if (consolidation_interval_minutes_ > 0 && consolidation_max_per_run_ > 0) {
+                consolidate_thread_ = std::thread(&AIEngine::consolidateLoop, this);
+                Logger::logInfo("旧记忆整合: 每 " + std::to_string(consolidation_interval_minutes_) + " 分钟一轮，每轮至多 "
+                                + std::to_string(consolidation_max_per_run_) + " 组创建超过 "
+                                + std::to_string(consolidation_min_age_hours_) + " 小时的相似记忆。");
+            }
+        }
     } else {
         Logger::logInfo("AIEngine 已初始化。RAG记忆系统: [已禁用]");
     }
 }
 
-std::string AIEngine::processPlayerInput(const std::string& user_input, SessionManager& session) {
+AIEngine::~AIEngine() {
+    {
+        std::lock_guard<std::mutex> lock(reembed_mutex_);
+        stopping_ = true;
+        writeback_deadline_ = std::chrono::steady_clock::now() + std::chrono::seconds(writeback_drain_seconds_);
+    }
+    reembed_cv_.notify_all();
+    consolidate_cv_.notify_all();
+    writeback_cv_.notify_all();
+    if (writeback_thread_.joinable()) {
+        // 在 WRITEBACK_DRAIN_SECONDS 秒内尽量写完已排队的记忆，其余留在 writeback_journal_ 中
+        writeback_thread_.join();
+    }
+    if (reembed_thread_.joinable()) {
+        reembed_thread_.join();
+    }
+    if (consolidate_thread_.joinable()) {
+        consolidate_thread_.join();
+    }
+}
+
+std::string AIEngine::processPlayerInput(const std::string& user_input, SessionManager& session,
+                                        const std::function<void(const std::string&)>& on_delta) {
+    trackSceneCommand(user_input);
     if (rag_enabled_) {
         // --- RAG 启用路径 (有记忆) ---
         Logger::logInfo("开始处理玩家输入 (RAG路径)...");
 
-        auto query_embedding = getEmbeddings(user_input);
-        std::vector<std::string> retrieved_memories = memory_manager_.retrieveMemories(query_embedding, 3);
-
-        std::string system_prompt_template;
-        const std::string prompt_file_path = config_.get("SystemPrompt", "PROMPT_FILE", "prompt.txt");
-        if (!prompt_file_path.empty()) {
-            std::ifstream file(prompt_file_path);
-            if (file) {
-                std::stringstream buffer;
-                buffer << file.rdbuf();
-                system_prompt_template = buffer.str();
-            }
+        // embedding接口最近一次调用失败时不再为查询等待网络请求，直接走字面检索；
+        // 接口是否恢复由之后的记忆摘要向量化与后台重新生成任务探测
+        std::vector<float> query_embedding;
+        if (embedding_healthy_ || !memory_manager_.lexicalEnabled()) {
+            query_embedding = getEmbeddings(embeddingHttpClient_, user_input);
         }
-        
-        std::string memory_section = "无相关记忆。";
-        if (!retrieved_memories.empty()) {
-            std::stringstream ss;
-            for (const auto& mem : retrieved_memories) {
-                ss << "- " << mem << "\n";
-            }
-            memory_section = ss.str();
+        MemoryFilter memory_filter;
+        if (memory_scoped_) {
+            memory_filter.character = character_name_;
         }
-        size_t placeholder_pos = system_prompt_template.find("[CONVERSATION_MEMORY]");
-        if (placeholder_pos != std::string::npos) {
-            system_prompt_template.replace(placeholder_pos, std::string("[CONVERSATION_MEMORY]").length(), memory_section);
+        std::vector<std::string> retrieved_memories =
+            memory_manager_.retrieveMemories(user_input, query_embedding, 3, memory_filter);
+
+        std::string memory_section;
+        for (const auto& mem : retrieved_memories) {
+            memory_section.append("- ").append(mem).append("\n");
+        }
+        if (memory_section.empty()) {
+            memory_section = kNoMemories;
         }
 
         nlohmann::json messages_payload = nlohmann::json::array();
-        messages_payload.push_back({{"role", "system"}, {"content", system_prompt_template}});
+        messages_payload.push_back({{"role", "system"}, {"content", renderSystemPrompt(memory_section)}});
         
         const auto& history = session.getHistory();
         for (const auto& msg : history) {
             messages_payload.push_back(msg);
         }
 
-        std::string ai_response = generateResponse(messages_payload);
+        std::string ai_response = generateResponse(llmHttpClient_, messages_payload, on_delta);
+
+        // 生成向量、写入记忆库交给后台线程，回复立即返回；创建时间记为本轮对话的时间
+        WritebackItem item;
+        item.summary = createMemorySummary(user_input, ai_response);
+        item.attributes.character = character_name_;
+        item.attributes.created = MemoryMetadata::now();
+        {
+            std::lock_guard<std::mutex> lock(reembed_mutex_);
+            if (writeback_queue_.size() >= writeback_queue_max_) {
+                Logger::logError("待写入的对话记忆已达 " + std::to_string(writeback_queue_max_)
+                                 + " 条 (WRITEBACK_QUEUE_MAX)，本轮对话不写入记忆库。");
+            } else {
+                if (writeback_journal_) {
+                    // 在锁内追加，日志中的序号与队列顺序一致
+                    try {
+                        item.seq = writeback_journal_->append(item.summary, nullptr, 0, item.attributes.encode());
+                    } catch (const std::exception& e) {
+                        Logger::logError("记录待写入的对话记忆失败: " + std::string(e.what()));
+                    }
+                }
+                writeback_queue_.push_back(std::move(item));
+            }
+        }
+        writeback_cv_.notify_one();
 
-        std::string summary = createMemorySummary(user_input, ai_response);
-        auto summary_embedding = getEmbeddings(summary);
-        memory_manager_.addMemory(summary, summary_embedding);
-        
         return ai_response;
 
     } else {
         // --- RAG 禁用路径 (无记忆) ---
         Logger::logInfo("开始处理玩家输入 (非RAG路径)...");
 
-        std::string system_prompt;
-        const std::string prompt_file_path = config_.get("SystemPrompt", "PROMPT_FILE", "prompt.txt");
-        if (!prompt_file_path.empty()) {
-            std::ifstream file(prompt_file_path);
-            if (file) {
-                std::stringstream buffer;
-                buffer << file.rdbuf();
-                system_prompt = buffer.str();
-            }
-        }
-        
         nlohmann::json messages_payload = nlohmann::json::array();
-        messages_payload.push_back({{"role", "system"}, {"content", system_prompt}});
+        messages_payload.push_back({{"role", "system"}, {"content", renderSystemPrompt(kNoMemories)}});
         
         const auto& history = session.getHistory();
         for (const auto& msg : history) {
             messages_payload.push_back(msg);
         }
 
-        return generateResponse(messages_payload);
+        return generateResponse(llmHttpClient_, messages_payload, on_delta);
     }
 }
 
-std::string AIEngine::generateResponse(const nlohmann::json& messages_payload) {
+void AIEngine::trackSceneCommand(const std::string& user_input) {
+    // 前端的系统指令以 "{指令：命令 值}" 的形式进入对话 (见 WebSocketServer)
+    static const std::string prefix = "{指令：";
+    if (user_input.compare(0, prefix.size(), prefix) != 0 || user_input.back() != '}') return;
+    std::string body = user_input.substr(prefix.size(), user_input.size() - prefix.size() - 1);
+    size_t space = body.find(' ');
+    if (space == std::string::npos) return;
+    std::string command = body.substr(0, space);
+    if (command == "set_scene") {
+        scene_ = body.substr(space + 1);
+    } else if (command == "set_time") {
+        time_ = body.substr(space + 1);
+    }
+}
+
+std::string AIEngine::renderSystemPrompt(std::string_view memory_section) {
+    PromptTemplate::Values values;
+    values.memory = memory_section;
+    values.scene = scene_;
+    values.time = time_;
+    values.character = character_name_;
+    return prompt_template_.render(values);
+}
+
+std::string AIEngine::generateResponse(HTTPClient& client, const nlohmann::json& messages_payload,
+                                      const std::function<void(const std::string&)>& on_delta) {
+    const bool streaming = stream_enabled_ && on_delta;
     nlohmann::json payload = {
         {"model", llm_model_},
         {"messages", messages_payload},
         {"temperature", temperature_}
     };
+    if (streaming) {
+        payload["stream"] = true;
+    }
     std::cout << "[调试] LLM 请求负载:\n" << payload.dump(2) << std::endl;
-    // 使用专门的 llmHttpClient_
-    std::string response = llmHttpClient_.post(llm_api_url_ + "/chat/completions", payload.dump());
-    try {
-        auto response_json = nlohmann::json::parse(response);
-        if (response_json.contains("error")) {
-            throw std::runtime_error("API错误: " + response_json["error"].value("message", "未知API错误"));
+
+    auto parse_completion = [](const std::string& response) {
+        try {
+            auto response_json = nlohmann::json::parse(response);
+            if (response_json.contains("error")) {
+                throw std::runtime_error("API错误: " + response_json["error"].value("message", "未知API错误"));
+            }
+            return response_json["choices"][0]["message"]["content"].get<std::string>();
+        } catch (const nlohmann::json::exception& e) {
+            throw std::runtime_error("LLM响应解析失败: " + std::string(e.what()));
         }
-        return response_json["choices"][0]["message"]["content"].get<std::string>();
-    } catch (const nlohmann::json::exception& e) {
-        throw std::runtime_error("LLM响应解析失败: " + std::string(e.what()));
+    };
+    if (!streaming) {
+        return parse_completion(client.post(llm_api_url_ + "/chat/completions", payload.dump()));
+    }
+
+    // 流式响应为SSE：每个事件一行 "data: {json}"，以 "data: [DONE]" 结束；以 ":" 开头的是保活注释。
+    // 行可能被拆在两块数据之间，未结束的部分留在 line 中等下一块
+    std::string reply;
+    std::string line;
+    std::string body;       // 不是SSE的响应 (例如错误信息，或接口忽略了 stream 参数) 原样保留
+    bool events = false;
+    std::string stream_error;
+    auto handle_line = [&](std::string_view text) {
+        if (!text.empty() && text.back() == '\r') text.remove_suffix(1);
+        if (text.rfind("data:", 0) != 0) return;
+        events = true;
+        text.remove_prefix(5);
+        while (!text.empty() && text.front() == ' ') text.remove_prefix(1);
+        if (text == "[DONE]" || !stream_error.empty()) return;
+        try {
+            auto event = nlohmann::json::parse(text);
+            if (event.contains("error")) {
+                stream_error = "API错误: " + event["error"].value("message", "未知API错误");
+                return;
+            }
+            const auto& choices = event.at("choices");
+            if (choices.empty()) return; // 例如只携带用量统计的最后一个事件
+            const auto& delta = choices[0].at("delta");
+            auto content = delta.find("content");
+            if (content == delta.end() || !content->is_string()) return;
+            std::string piece = content->get<std::string>();
+            if (piece.empty()) return;
+            reply += piece;
+            on_delta(piece);
+        } catch (const nlohmann::json::exception& e) {
+            stream_error = "LLM流式响应解析失败: " + std::string(e.what());
+        }
+    };
+    client.postStream(llm_api_url_ + "/chat/completions", payload.dump(), [&](std::string_view chunk) {
+        if (!events) body.append(chunk);
+        for (size_t newline; (newline = chunk.find('\n')) != std::string_view::npos;) {
+            if (line.empty()) {
+                handle_line(chunk.substr(0, newline));
+            } else {
+                line.append(chunk.substr(0, newline));
+                handle_line(line);
+                line.clear();
+            }
+            chunk.remove_prefix(newline + 1);
+        }
+        line.append(chunk);
+        if (events) body.clear();
+    });
+    if (!line.empty()) {
+        handle_line(line);
+    }
+    if (!stream_error.empty()) {
+        throw std::runtime_error(stream_error);
     }
+    if (!events) {
+        return parse_completion(body);
+    }
+    return reply;
 }
 
-std::vector<float> AIEngine::getEmbeddings(const std::string& text) {
+std::vector<float> AIEngine::getEmbeddings(HTTPClient& client, const std::string& text) {
     // 防御性检查：确保URL已被配置
     if (embedding_api_url_.empty()) {
         Logger::logError("Embedding API URL 未在.env文件的[API_EMBEDDING]节中配置，无法获取向量！");
-        int dim = std::stoi(config_.get("API_EMBEDDING", "EMBEDDING_VECTOR_DIMENSION", "1024"));
-        return std::vector<float>(dim, 0.0f);
+        return std::vector<float>(embedding_dimension_, 0.0f);
+    }
+
+    std::vector<float> cached;
+    if (embedding_cache_.get(embedding_model_, text, cached)) {
+        return cached;
     }
 
+    try {
+        auto embeddings = requestEmbeddings(client, {text});
+        embedding_cache_.put(embedding_model_, text, embeddings[0]);
+        markEmbeddingHealthy();
+        return std::move(embeddings[0]);
+    } catch(const std::exception& e) {
+        Logger::logError("获取 Embedding 失败: " + std::string(e.what()));
+        embedding_healthy_ = false;
+        // 返回零向量，MemoryManager 会把对应的记忆放入待重新生成向量的队列
+        return std::vector<float>(embedding_dimension_, 0.0f);
+    }
+}
+
+void AIEngine::markEmbeddingHealthy() {
+    if (!embedding_healthy_.exchange(true)) {
+        // 接口恢复可用：唤醒后台任务，尽快补齐之前失败的记忆
+        std::lock_guard<std::mutex> lock(reembed_mutex_);
+        reembed_wakeup_ = true;
+        reembed_cv_.notify_one();
+    }
+}
+
+std::vector<std::vector<float>> AIEngine::requestEmbeddings(HTTPClient& client, const std::vector<std::string>& texts) {
     nlohmann::json payload = {
         {"model", embedding_model_},
-        {"input", text}
+        {"input", texts}
     };
 
-    // 使用专门的 embeddingHttpClient_
-    std::string response_str = embeddingHttpClient_.post(embedding_api_url_ + "/embeddings", payload.dump());
-    Logger::logInfo("Embedding API response: " + response_str);
-
+    std::string response_str = client.post(embedding_api_url_ + "/embeddings", payload.dump());
     try {
         auto response_json = nlohmann::json::parse(response_str);
-        if (response_json.contains("data") && !response_json["data"].empty() && response_json["data"][0].contains("embedding")) {
-            return response_json["data"][0]["embedding"].get<std::vector<float>>();
-        }
-        // 尝试解析可能的错误信息
         if (response_json.contains("error") && response_json["error"].is_object()) {
-             throw std::runtime_error("Embedding API 返回错误: " + response_json["error"].value("message", "未知错误"));
+            throw std::runtime_error("Embedding API 返回错误: " + response_json["error"].value("message", "未知错误"));
         }
-        throw std::runtime_error("Embedding 响应格式无效。");
-    } catch(const std::exception& e) {
-        Logger::logError("获取 Embedding 失败: " + std::string(e.what()));
-        int dim = std::stoi(config_.get("API_EMBEDDING", "EMBEDDING_VECTOR_DIMENSION", "1024"));
-        return std::vector<float>(dim, 0.0f);
+        auto data = response_json.find("data");
+        if (data == response_json.end() || !data->is_array() || data->size() != texts.size()) {
+            throw std::runtime_error("Embedding 响应格式无效。");
+        }
+        // 按 "index" 字段还原输入顺序 (OpenAI兼容接口不保证按顺序返回)
+        std::vector<std::vector<float>> embeddings(texts.size());
+        for (size_t i = 0; i < data->size(); ++i) {
+            const auto& item = (*data)[i];
+            size_t index = item.value("index", i);
+            if (index >= embeddings.size() || !item.contains("embedding")) {
+                throw std::runtime_error("Embedding 响应格式无效。");
+            }
+            embeddings[index] = item["embedding"].get<std::vector<float>>();
+        }
+        return embeddings;
+    } catch (const nlohmann::json::exception& e) {
+        throw std::runtime_error("Embedding 响应解析失败: " + std::string(e.what()));
+    }
+}
+
+void AIEngine::writebackLoop() {
+    // 日志中序号不大于 persisted_through 的对话都已持久化进记忆库；有一条没能持久化时不再推进，
+    // 它和之后的记录都留到下次启动 (其中已写入的对话重复入库时由去重合并)
+    uint64_t persisted_through = 0;
+    uint64_t trimmed_through = 0;
+    bool journal_blocked = false;
+    auto trim_journal = [&]() {
+        if (!writeback_journal_ || persisted_through <= trimmed_through) return;
+        try {
+            writeback_journal_->truncateThrough(persisted_through);
+            trimmed_through = persisted_through;
+        } catch (const std::exception& e) {
+            Logger::logError("清理待写入对话记忆的日志失败: " + std::string(e.what()));
+        }
+    };
+
+    std::unique_lock<std::mutex> lock(reembed_mutex_);
+    while (true) {
+        if (writeback_queue_.empty() && persisted_through > trimmed_through) {
+            // 队列清空后才一次性删去已持久化的记录，不必每轮对话都重写日志
+            lock.unlock();
+            trim_journal();
+            lock.lock();
+            continue;
+        }
+        writeback_cv_.wait(lock, [this] { return stopping_ || !writeback_queue_.empty(); });
+        if (writeback_queue_.empty()) break; // 停止且队列已清空
+        if (stopping_ && std::chrono::steady_clock::now() >= writeback_deadline_) {
+            Logger::logError("停止时仍有 " + std::to_string(writeback_queue_.size()) + " 条对话记忆未写入记忆库，"
+                             + (writeback_journal_ ? "将在下次启动时写入。" : "已丢弃。"));
+            break;
+        }
+        WritebackItem item = std::move(writeback_queue_.front());
+        writeback_queue_.pop_front();
+        bool skip_request = stopping_ && !embedding_healthy_;
+        lock.unlock();
+
+        bool persisted = false;
+        try {
+            const std::string& summary = item.summary;
+            // 每条摘要都是新文本，不经过 embedding_cache_，以免挤掉查询侧的缓存
+            std::vector<float> summary_embedding(embedding_dimension_, 0.0f);
+            if (embedding_api_url_.empty()) {
+                Logger::logError("Embedding API URL 未在.env文件的[API_EMBEDDING]节中配置，无法获取向量！");
+            } else if (!skip_request) {
+                // (停止时接口不可用则不再等待请求超时，直接以零向量入库，由下次启动后的后台任务补齐)
+                try {
+                    summary_embedding = std::move(requestEmbeddings(writebackEmbeddingClient_, {summary})[0]);
+                    markEmbeddingHealthy();
+                } catch (const std::exception& e) {
+                    // 零向量会让 MemoryManager 把这条记忆放入待重新生成向量的队列
+                    Logger::logError("获取 Embedding 失败: " + std::string(e.what()));
+                    embedding_healthy_ = false;
+                }
+            }
+            persisted = memory_manager_.addMemory(summary, summary_embedding, item.attributes);
+        } catch (const std::exception& e) {
+            Logger::logError("写入对话记忆失败: " + std::string(e.what()));
+        }
+        if (item.seq != 0 && !journal_blocked) {
+            if (persisted) {
+                persisted_through = item.seq;
+            } else {
+                journal_blocked = true;
+                Logger::logError("对话记忆没有持久化，保留在待写入日志中，下次启动时重新写入。");
+            }
+        }
+        lock.lock();
+    }
+    lock.unlock();
+    trim_journal();
+}
+
+void AIEngine::reembedLoop() {
+    std::unique_lock<std::mutex> lock(reembed_mutex_);
+    while (!stopping_) {
+        reembed_cv_.wait_for(lock, std::chrono::seconds(reembed_interval_seconds_),
+                             [this] { return stopping_ || reembed_wakeup_; });
+        reembed_wakeup_ = false;
+        lock.unlock();
+
+        // 每轮至多把队列处理一遍：失败的记忆移到队尾，不会挡住后面的记忆，也不会在本轮反复重试。
+        // 一批中没有任何一条成功时 (接口多半不可用) 提前结束本轮。
+        // 这里的失败不改变 embedding_healthy_：可能只是个别文本被接口拒绝，接口是否可用由检索时的请求判断
+        size_t remaining = memory_manager_.pendingCount();
+        while (remaining > 0) {
+            {
+                std::lock_guard<std::mutex> stop_lock(reembed_mutex_);
+                if (stopping_) break;
+            }
+            auto batch = memory_manager_.pendingSummaries(std::min(reembed_batch_size_, remaining));
+            if (batch.empty()) break;
+            remaining -= batch.size();
+
+            std::vector<std::vector<float>> embeddings(batch.size());
+            try {
+                embeddings = requestEmbeddings(reembedHttpClient_, batch);
+            } catch (const std::exception& e) {
+                if (batch.size() > 1) {
+                    // 整批失败时逐条重试，找出接口拒绝的那几条
+                    Logger::logError("批量重新生成记忆向量失败，改为逐条重试: " + std::string(e.what()));
+                    for (size_t i = 0; i < batch.size(); ++i) {
+                        try {
+                            embeddings[i] = std::move(requestEmbeddings(reembedHttpClient_, {batch[i]})[0]);
+                        } catch (const std::exception& single) {
+                            Logger::logError("重新生成记忆向量失败: " + std::string(single.what()));
+                        }
+                    }
+                } else {
+                    Logger::logError("重新生成记忆向量失败: " + std::string(e.what()));
+                }
+            }
+
+            size_t succeeded = 0;
+            for (size_t i = 0; i < batch.size(); ++i) {
+                const auto& embedding = embeddings[i];
+                if (MemoryManager::isValidEmbedding(embedding.data(), embedding.size(), embedding_dimension_)) {
+                    memory_manager_.addMemory(batch[i], embedding);
+                    ++succeeded;
+                    continue;
+                }
+                uint32_t failures = memory_manager_.deferPending(batch[i]);
+                if (failures > 0 && failures % 10 == 0) {
+                    Logger::logError("有一条记忆已连续 " + std::to_string(failures)
+                                     + " 次无法重新生成向量 (摘要 " + std::to_string(batch[i].size())
+                                     + " 字节)，请检查其内容或embedding接口。");
+                }
+            }
+            if (succeeded > 0) {
+                if (!embedding_healthy_.exchange(true)) {
+                    Logger::logInfo("embedding接口已恢复。");
+                }
+                Logger::logInfo("已为 " + std::to_string(succeeded) + " 条记忆重新生成向量，剩余 "
+                                + std::to_string(memory_manager_.pendingCount()) + " 条。");
+            } else {
+                break;
+            }
+        }
+        lock.lock();
+    }
+}
+
+void AIEngine::consolidateLoop() {
+    std::unique_lock<std::mutex> lock(reembed_mutex_);
+    while (true) {
+        consolidate_cv_.wait_for(lock, std::chrono::minutes(consolidation_interval_minutes_),
+                                 [this] { return stopping_; });
+        if (stopping_) break;
+        lock.unlock();
+        try {
+            runConsolidation();
+        } catch (const std::exception& e) {
+            Logger::logError("整合旧记忆失败，下一轮重试: " + std::string(e.what()));
+        }
+        lock.lock();
+    }
+}
+
+void AIEngine::runConsolidation() {
+    // embedding接口不可用时整合结果也无法入库，不必消耗LLM请求
+    if (!embedding_healthy_) return;
+
+    ConsolidationOptions options;
+    options.created_before = MemoryMetadata::now() - static_cast<int64_t>(consolidation_min_age_hours_) * 3600;
+    options.similarity = consolidation_similarity_;
+    options.min_size = consolidation_min_cluster_;
+    options.max_size = consolidation_max_cluster_;
+    options.max_clusters = consolidation_max_per_run_;
+    options.first_row = consolidation_cursor_;
+    std::vector<MemoryCluster> clusters = memory_manager_.findConsolidationClusters(options, &consolidation_cursor_);
+    if (clusters.empty()) return;
+
+    const std::string instruction =
+        "你是记忆整理助手。下面是" + (character_name_.empty() ? std::string("角色") : character_name_)
+        + "与玩家之间若干条内容相近的对话记忆。请把它们合并为一条简洁的记忆，保留人物、事件、偏好、约定等关键信息，"
+          "省略寒暄与重复的内容。只输出合并后的记忆本身，不超过200字。";
+
+    // 逐簇请求LLM，每两次请求之间等待一段时间，避免与对话请求争抢接口配额
+    constexpr auto kRequestGap = std::chrono::seconds(2);
+    std::vector<MemoryCluster> ready;
+    for (auto& cluster : clusters) {
+        if (&cluster != &clusters.front()) {
+            std::unique_lock<std::mutex> lock(reembed_mutex_);
+            if (consolidate_cv_.wait_for(lock, kRequestGap, [this] { return stopping_; })) return;
+        }
+        std::stringstream memories;
+        for (const auto& summary : cluster.summaries) {
+            memories << "- " << summary << "\n";
+        }
+        nlohmann::json messages = nlohmann::json::array();
+        messages.push_back({{"role", "system"}, {"content", instruction}});
+        messages.push_back({{"role", "user"}, {"content", memories.str()}});
+        try {
+            std::string summary = generateResponse(consolidateLlmClient_, messages);
+            size_t begin = summary.find_first_not_of(" \t\r\n");
+            size_t end = summary.find_last_not_of(" \t\r\n");
+            if (begin == std::string::npos) continue;
+            cluster.summary = summary.substr(begin, end - begin + 1);
+            ready.push_back(std::move(cluster));
+        } catch (const std::exception& e) {
+            Logger::logError("请求LLM整合记忆失败: " + std::string(e.what()));
+        }
+    }
+    if (ready.empty()) return;
+
+    std::vector<std::string> summaries;
+    for (const auto& cluster : ready) {
+        summaries.push_back(cluster.summary);
+    }
+    try {
+        auto embeddings = requestEmbeddings(consolidateEmbeddingClient_, summaries);
+        for (size_t i = 0; i < ready.size(); ++i) {
+            ready[i].embedding = std::move(embeddings[i]);
+        }
+    } catch (const std::exception& e) {
+        embedding_healthy_ = false;
+        Logger::logError("为整合后的记忆生成向量失败，本轮放弃: " + std::string(e.what()));
+        return;
     }
+    memory_manager_.consolidateMemories(ready);
 }
 
 std::string AIEngine::createMemorySummary(const std::string& input, const std::string& response) {
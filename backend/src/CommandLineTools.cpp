@@ -0,0 +1,627 @@
+#include "CommandLineTools.hpp"
+#include "ConfigManager.hpp"
+#include "EmbeddingReducer.hpp"
+#include "HNSWIndex.hpp"
+#include "IVFPQIndex.hpp"
+#include "MemoryManager.hpp"
+#include "MemoryStoreFile.hpp"
+#include "SegmentParser.hpp"
+#include "ThreadPool.hpp"
+#include "TopK.hpp"
+#include "VectorMath.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <thread>
+#include <sys/resource.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_us(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// 随机簇中心；数据与查询都围绕同一组中心采样，比均匀随机向量更接近真实的embedding分布
+std::vector<float> make_centers(size_t clusters, size_t dim, std::mt19937& rng) {
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<float> centers(clusters * dim);
+    for (auto& x : centers) x = normal(rng);
+    return centers;
+}
+
+// 训练用的线程池：工作线程数为CPU核数减一 (调用线程也参与)
+std::unique_ptr<ThreadPool> make_training_pool() {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    return std::make_unique<ThreadPool>(threads - 1);
+}
+
+std::vector<float> sample_vectors(size_t rows, size_t dim, const std::vector<float>& centers, std::mt19937& rng) {
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::uniform_int_distribution<size_t> pick(0, centers.size() / dim - 1);
+    std::vector<float> data(rows * dim);
+    for (size_t i = 0; i < rows; ++i) {
+        const float* center = &centers[pick(rng) * dim];
+        float* out = &data[i * dim];
+        for (size_t d = 0; d < dim; ++d) {
+            out[d] = center[d] + 0.6f * normal(rng);
+        }
+        VectorMath::normalize(out, dim);
+    }
+    return data;
+}
+
+// 进程至今的峰值常驻内存 (MB)
+double peak_rss_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0; // Linux 下单位为 KB
+}
+
+// 生成约 target_bytes 大小的旧版 memory.json，返回写入的记忆条数
+size_t write_synthetic_json(const std::string& path, size_t target_bytes, size_t dim, std::mt19937& rng) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("无法创建临时文件 " + path);
+    }
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<float> row(dim);
+    size_t rows = 0;
+    long written = 0;
+    std::fputs("[\n", file);
+    while (static_cast<size_t>(written) < target_bytes) {
+        for (auto& x : row) x = normal(rng);
+        VectorMath::normalize(row.data(), dim);
+        std::fprintf(file, "%s    {\n        \"summary\": \"合成记忆 #%zu：用户提到了一件和之前聊过的话题有关的事情。\",\n        \"embedding\": [",
+                     rows ? ",\n" : "", rows);
+        for (size_t d = 0; d < dim; ++d) {
+            std::fprintf(file, d ? ", %.8f" : "%.8f", row[d]);
+        }
+        std::fputs("]\n    }", file);
+        ++rows;
+        written = std::ftell(file);
+    }
+    std::fputs("\n]\n", file);
+    std::fclose(file);
+    return rows;
+}
+
+// 模拟模型回复：若干句 【表情】中文(动作)<日语>，偶尔夹杂换行与不成句的旁白
+std::string make_reply(std::mt19937& rng) {
+    static const char* expressions[] = {"开心", "害羞", "生气", "难过", "惊讶", "思考"};
+    static const char* texts[] = {"主人回来啦，今天过得怎么样？", "哼，才、才不是特意在等你呢。",
+                                  "外面下雨了，记得带伞哦。", "这个问题嘛……让我想一想。",
+                                  "诶？真的吗？好厉害！", "晚安，明天见。"};
+    static const char* actions[] = {"摇了摇尾巴", "别过头去", "歪头", "", "", ""};
+    static const char* japanese[] = {"おかえりなさい、今日はどうでしたか？", "べ、別に待ってたわけじゃないんだから。",
+                                     "外は雨だよ、傘を忘れないでね。", "うーん、ちょっと考えさせて。",
+                                     "えっ？本当？すごい！", "おやすみ、また明日ね。"};
+    std::uniform_int_distribution<int> pick(0, 5);
+    std::uniform_int_distribution<int> count(3, 8);
+    std::string reply;
+    for (int i = 0, n = count(rng); i < n; ++i) {
+        if (pick(rng) == 0) reply += "\n";
+        reply += std::string("【") + expressions[pick(rng)] + "】";
+        const char* action = actions[pick(rng)];
+        if (*action) reply += std::string("(") + action + ")";
+        reply += std::string(texts[pick(rng)]) + "<" + japanese[pick(rng)] + ">";
+    }
+    return reply;
+}
+
+// 原先 handle_websocket_data 中的解析方式：整段回复生成完之后用正则逐句匹配
+std::vector<ReplySegment> regex_segments(const std::string& reply) {
+    auto trim = [](const std::string& s) {
+        const char* ws = " \t\n\r\f\v";
+        size_t first = s.find_first_not_of(ws);
+        if (first == std::string::npos) return std::string();
+        return s.substr(first, s.find_last_not_of(ws) - first + 1);
+    };
+    std::vector<ReplySegment> segments;
+    std::regex re_main("【(.+?)】(.+?)<(.+?)>");
+    for (std::sregex_iterator i(reply.begin(), reply.end(), re_main), end; i != end; ++i) {
+        std::smatch match = *i;
+        ReplySegment segment;
+        segment.expression = trim(match[1].str());
+        std::string middle = trim(match[2].str());
+        segment.text_jp = trim(match[3].str());
+        std::smatch action_match;
+        std::regex re_action("\\((.+?)\\)");
+        if (std::regex_search(middle, action_match, re_action) && action_match.size() > 1) {
+            segment.action = trim(action_match[1].str());
+            segment.text_cn = trim(std::regex_replace(middle, re_action, ""));
+        } else {
+            segment.text_cn = middle;
+        }
+        segments.push_back(std::move(segment));
+    }
+    return segments;
+}
+
+// --selftest-publish 用的记忆库：让构造它的线程之后第 n 次对副本应用修改时抛出异常，两份副本各计一次
+// (n = 1 落在下一次修改切换公开副本之前，n = 2 落在它对旧副本的重放中)，n 为0时取消注入。
+// 只计构造线程，后台线程应用命中记录的修改不会提前触发
+class FaultInjectingMemoryManager : public MemoryManager {
+public:
+    explicit FaultInjectingMemoryManager(ConfigManager& config)
+        : MemoryManager(config), owner_(std::this_thread::get_id()) {}
+
+    void injectFault(size_t n) { countdown_ = n; }
+
+protected:
+    void afterApply(bool) override {
+        if (std::this_thread::get_id() == owner_ && countdown_ > 0 && --countdown_ == 0) {
+            throw std::runtime_error("自检注入的故障");
+        }
+    }
+
+private:
+    const std::thread::id owner_;
+    size_t countdown_ = 0;
+};
+
+} // namespace
+
+int CommandLineTools::run(int argc, char* argv[]) {
+    std::string command = argv[1];
+    try {
+        if (command == "--bench-hnsw") return benchHnsw(argc, argv);
+        if (command == "--import-json") return importJson(argc, argv);
+        if (command == "--bench-load") return benchLoad(argc, argv);
+        if (command == "--train-ivfpq") return trainIvfpq(argc, argv);
+        if (command == "--bench-ivfpq") return benchIvfpq(argc, argv);
+        if (command == "--train-pca") return trainPca(argc, argv);
+        if (command == "--bench-segments") return benchSegments(argc, argv);
+        if (command == "--selftest-publish") return selftestPublish(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "[错误] " << command << " 执行失败: " << e.what() << std::endl;
+        return 1;
+    }
+    printUsage();
+    return (command == "--help" || command == "-h") ? 0 : 1;
+}
+
+void CommandLineTools::printUsage() {
+    std::cout << "用法: backend_server [命令]\n"
+              << "  (无参数)                         启动聊天服务器\n"
+              << "  --bench-hnsw [条数] [维度]        对比HNSW与精确扫描的召回率和延迟\n"
+              << "  --import-json [json] [记忆库]     将旧版 memory.json 转换为二进制记忆库\n"
+              << "  --bench-load [MB] [维度]          对比旧版JSON的流式/DOM加载与记忆库映射的启动耗时\n"
+              << "  --train-ivfpq [nlist] [m]         在记忆库上训练IVF-PQ索引并写入 IVFPQ_INDEX_PATH\n"
+              << "  --bench-ivfpq [条数] [维度]       对比IVF-PQ与精确扫描的召回率和延迟\n"
+              << "  --train-pca [维度]                在记忆库上学习PCA降维投影并写入 EMBEDDING_PCA_PATH\n"
+              << "  --bench-segments [条数]           对比增量解析器与正则解析回复片段的耗时\n"
+              << "  --selftest-publish [条数]         注入故障，检查记忆库副本在新增与合并失败后仍保持一致\n";
+}
+
+int CommandLineTools::benchHnsw(int argc, char* argv[]) {
+    const size_t rows = argc > 2 ? std::stoul(argv[2]) : 20000;
+    const size_t dim = argc > 3 ? std::stoul(argv[3]) : 1024;
+    const size_t queries = 200;
+    const size_t k = 10;
+
+    std::mt19937 rng(7);
+    std::cout << "[基准] 生成 " << rows << " 条 " << dim << " 维向量 (内核: " << VectorMath::kernelName() << ")..." << std::endl;
+    auto centers = make_centers(std::max<size_t>(rows / 100, 8), dim, rng);
+    auto data = sample_vectors(rows, dim, centers, rng);
+    auto query_set = sample_vectors(queries, dim, centers, rng);
+    auto row = [&](size_t i) { return &data[i * dim]; };
+
+    // 精确扫描作为召回率的基准
+    std::vector<std::vector<ScoredIndex>> truth(queries);
+    auto start = Clock::now();
+    for (size_t q = 0; q < queries; ++q) {
+        TopK selector(k);
+        for (size_t i = 0; i < rows; ++i) {
+            selector.push(VectorMath::dot(&query_set[q * dim], row(i), dim), i);
+        }
+        truth[q] = selector.take_sorted();
+    }
+    double exact_us = elapsed_us(start) / queries;
+
+    HNSWIndex::Params params;
+    HNSWIndex index(dim, params, row);
+    start = Clock::now();
+    for (size_t i = 0; i < rows; ++i) {
+        index.insert(i);
+    }
+    std::cout << "[基准] HNSW 构建耗时 " << std::fixed << std::setprecision(1)
+              << elapsed_us(start) / 1e6 << " s (M=" << params.M << ", ef_construction=" << params.ef_construction << ")" << std::endl;
+
+    std::cout << "[基准] 精确扫描: " << std::setprecision(1) << exact_us << " us/查询, recall@" << k << " = 1.000" << std::endl;
+    for (size_t ef : {16, 32, 64, 128, 256}) {
+        size_t found = 0;
+        start = Clock::now();
+        std::vector<std::vector<ScoredIndex>> results(queries);
+        for (size_t q = 0; q < queries; ++q) {
+            results[q] = index.search(&query_set[q * dim], k, ef);
+        }
+        double hnsw_us = elapsed_us(start) / queries;
+        for (size_t q = 0; q < queries; ++q) {
+            std::unordered_set<size_t> expected;
+            for (const auto& hit : truth[q]) expected.insert(hit.index);
+            for (const auto& hit : results[q]) found += expected.count(hit.index);
+        }
+        std::cout << "[基准] HNSW ef_search=" << std::setw(3) << ef << ": " << std::setprecision(1) << std::setw(8) << hnsw_us
+                  << " us/查询, recall@" << k << " = " << std::setprecision(3) << double(found) / double(queries * k)
+                  << ", 加速 " << std::setprecision(1) << exact_us / hnsw_us << "x" << std::endl;
+    }
+    return 0;
+}
+
+int CommandLineTools::importJson(int argc, char* argv[]) {
+    // 未指定的路径与维度沿用 .env 中的配置
+    ConfigManager config;
+    std::string json_path = argc > 2 ? argv[2] : config.get("Database", "MEMORY_DB_PATH", "memory.json");
+    std::string store_path = argc > 3 ? argv[3] : config.get("Database", "MEMORY_STORE_PATH", "memory.bin");
+    size_t dimension = std::stoul(config.get("API_EMBEDDING", "EMBEDDING_VECTOR_DIMENSION", "1024"));
+
+    auto start = Clock::now();
+    size_t imported = MemoryManager::importLegacyJson(json_path, store_path, dimension);
+    std::cout << "[信息] 已导入 " << imported << " 条记忆，耗时 " << std::fixed << std::setprecision(2)
+              << elapsed_us(start) / 1e6 << " s。" << std::endl;
+    return 0;
+}
+
+int CommandLineTools::benchLoad(int argc, char* argv[]) {
+    const size_t megabytes = argc > 2 ? std::stoul(argv[2]) : 500;
+    const size_t dim = argc > 3 ? std::stoul(argv[3]) : 1024;
+    const std::string json_path = (fs::temp_directory_path() / "lingmem_bench_load.json").string();
+    const std::string store_path = (fs::temp_directory_path() / "lingmem_bench_load.bin").string();
+
+    std::mt19937 rng(7);
+    std::cout << "[基准] 生成约 " << megabytes << " MB 的 memory.json (" << dim << " 维)..." << std::endl;
+    size_t rows = write_synthetic_json(json_path, megabytes * 1024 * 1024, dim, rng);
+    std::cout << "[基准] 共 " << rows << " 条记忆, 文件大小 " << std::fixed << std::setprecision(1)
+              << fs::file_size(json_path) / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    // 峰值内存只增不减，因此先测流式导入，再测旧的DOM解析
+    double rss_before = peak_rss_mb();
+    auto start = Clock::now();
+    size_t imported = MemoryManager::importLegacyJson(json_path, store_path, dim);
+    double sax_s = elapsed_us(start) / 1e6;
+    double sax_rss = peak_rss_mb();
+    std::cout << "[基准] SAX 流式导入: " << std::setprecision(2) << sax_s << " s, " << imported
+              << " 条, 峰值内存 " << std::setprecision(0) << sax_rss << " MB (+" << sax_rss - rss_before << ")" << std::endl;
+
+    start = Clock::now();
+    {
+        std::ifstream file(json_path);
+        nlohmann::json memory_db = nlohmann::json::parse(file);
+        std::cout << "[基准] DOM 整体解析: " << std::setprecision(2) << elapsed_us(start) / 1e6 << " s, "
+                  << memory_db.size() << " 条, 峰值内存 " << std::setprecision(0) << peak_rss_mb()
+                  << " MB (+" << peak_rss_mb() - sax_rss << ")" << std::endl;
+    }
+
+    start = Clock::now();
+    MemoryStoreFile store;
+    store.open(store_path);
+    std::cout << "[基准] 映射二进制记忆库: " << std::setprecision(2) << elapsed_us(start) / 1e3 << " ms, "
+              << store.count() << " 条" << std::endl;
+    store.close();
+
+    fs::remove(json_path);
+    fs::remove(store_path);
+    return 0;
+}
+
+int CommandLineTools::trainIvfpq(int argc, char* argv[]) {
+    // 记忆库与索引路径、默认的 nlist / m 沿用 .env 中的配置
+    ConfigManager config;
+    std::string store_path = config.get("Database", "MEMORY_STORE_PATH", "memory.bin");
+    std::string index_path = config.get("Database", "IVFPQ_INDEX_PATH", "memory.ivfpq");
+    IVFPQIndex::Params params;
+    params.nlist = std::stoul(argc > 2 ? argv[2] : config.get("Database", "IVFPQ_NLIST", "1024"));
+    params.m = std::stoul(argc > 3 ? argv[3] : config.get("Database", "IVFPQ_M", "64"));
+
+    // 只使用已合并进记忆库文件的向量；WAL中尚未合并的记忆在服务器启动时用训练好的码本补编码
+    MemoryStoreFile store;
+    store.open(store_path);
+    size_t rows = store.count();
+    size_t dim = store.dimension();
+    std::cout << "[信息] 记忆库 " << store_path << ": " << rows << " 条 " << dim << " 维向量，nlist=" << params.nlist
+              << ", m=" << params.m << std::endl;
+
+    auto pool = make_training_pool();
+    auto start = Clock::now();
+    auto index = IVFPQIndex::train(store.vectors(), rows, dim, params, pool.get());
+    std::cout << "[信息] 训练耗时 " << std::fixed << std::setprecision(1) << elapsed_us(start) / 1e6 << " s" << std::endl;
+
+    start = Clock::now();
+    for (size_t i = 0; i < rows; ++i) {
+        index->add(i, store.vectors() + i * dim);
+    }
+    index->save(index_path);
+    std::cout << "[信息] 编码并写入 " << index_path << " 耗时 " << std::setprecision(1) << elapsed_us(start) / 1e6
+              << " s，每条记忆 " << index->subquantizers() << " 字节编码 (float32 为 " << dim * sizeof(float)
+              << " 字节)。将 VECTOR_INDEX 设为 \"ivfpq\" 后重启服务器即可使用。" << std::endl;
+    return 0;
+}
+
+int CommandLineTools::trainPca(int argc, char* argv[]) {
+    ConfigManager config;
+    std::string store_path = config.get("Database", "MEMORY_STORE_PATH", "memory.bin");
+    std::string pca_path = config.get("API_EMBEDDING", "EMBEDDING_PCA_PATH", "memory.pca");
+    size_t input_dim = std::stoul(config.get("API_EMBEDDING", "EMBEDDING_VECTOR_DIMENSION", "1024"));
+    size_t output_dim = std::stoul(argc > 2 ? argv[2] : config.get("API_EMBEDDING", "EMBEDDING_REDUCED_DIMENSION", "256"));
+
+    // 训练需要原始维度的向量：降维存储的记忆库取其中保存的原始向量，未降维的记忆库直接使用其向量
+    MemoryStoreFile store;
+    store.open(store_path);
+    size_t rows = store.count();
+    size_t size = 0;
+    const float* data = static_cast<const float*>(store.section(MemoryStoreFile::FullVectors, &size));
+    if (!data || size != rows * input_dim * sizeof(float)) {
+        if (store.dimension() != input_dim) {
+            throw std::runtime_error("记忆库 " + store_path + " 为 " + std::to_string(store.dimension())
+                                     + " 维且没有保存原始向量，无法学习 " + std::to_string(input_dim) + " 维的投影");
+        }
+        data = store.vectors();
+    }
+    if (rows < output_dim) {
+        throw std::runtime_error("记忆库只有 " + std::to_string(rows) + " 条记忆，不足以学习 "
+                                 + std::to_string(output_dim) + " 维的投影");
+    }
+    std::cout << "[信息] 记忆库 " << store_path << ": " << rows << " 条 " << input_dim << " 维向量，降为 " << output_dim
+              << " 维 (抽样至多 " << EmbeddingReducer::kTrainSamples << " 条)" << std::endl;
+
+    auto pool = make_training_pool();
+    auto start = Clock::now();
+    auto reducer = EmbeddingReducer::trainPca(data, rows, input_dim, output_dim, pool.get());
+    reducer->savePca(pca_path);
+    std::cout << "[信息] 训练耗时 " << std::fixed << std::setprecision(1) << elapsed_us(start) / 1e6 << " s，保留了 "
+              << std::setprecision(2) << reducer->retainedEnergy() * 100.0f << "% 的二阶矩，已写入 " << pca_path
+              << "。将 EMBEDDING_REDUCTION 设为 \"pca\" 后重启服务器，记忆库会在启动时重新投影；"
+                 "已训练的IVF-PQ索引需要重新训练。" << std::endl;
+    return 0;
+}
+
+int CommandLineTools::benchSegments(int argc, char* argv[]) {
+    const size_t replies = argc > 2 ? std::stoul(argv[2]) : 20000;
+    const size_t chunk = 6; // 流式响应中每个片段的字节数 (大致相当于一两个汉字)
+
+    std::mt19937 rng(7);
+    std::vector<std::string> corpus;
+    size_t bytes = 0;
+    for (size_t i = 0; i < replies; ++i) {
+        corpus.push_back(make_reply(rng));
+        bytes += corpus.back().size();
+    }
+    std::cout << "[基准] " << replies << " 条模拟回复，平均 " << bytes / replies << " 字节" << std::endl;
+
+    size_t regex_count = 0;
+    auto start = Clock::now();
+    for (const auto& reply : corpus) {
+        regex_count += regex_segments(reply).size();
+    }
+    double regex_us = elapsed_us(start) / replies;
+
+    // 增量解析器按小块输入，并校验与正则的结果一致
+    size_t parser_count = 0;
+    size_t mismatches = 0;
+    SegmentParser parser;
+    start = Clock::now();
+    for (const auto& reply : corpus) {
+        parser.reset();
+        std::string_view rest(reply);
+        while (!rest.empty()) {
+            size_t take = std::min(chunk, rest.size());
+            parser_count += parser.feed(rest.substr(0, take), [](const ReplySegment&) {});
+            rest.remove_prefix(take);
+        }
+    }
+    double parser_us = elapsed_us(start) / replies;
+    for (const auto& reply : corpus) {
+        std::vector<ReplySegment> parsed;
+        parser.reset();
+        parser.feed(reply, [&](const ReplySegment& segment) { parsed.push_back(segment); });
+        auto expected = regex_segments(reply);
+        bool same = parsed.size() == expected.size();
+        for (size_t i = 0; same && i < parsed.size(); ++i) {
+            same = parsed[i].expression == expected[i].expression && parsed[i].action == expected[i].action
+                   && parsed[i].text_cn == expected[i].text_cn && parsed[i].text_jp == expected[i].text_jp;
+        }
+        mismatches += !same;
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "[基准] std::regex 整段解析: " << regex_us << " us/条 (" << regex_count << " 句)\n"
+              << "[基准] 增量解析器 (每块 " << chunk << " 字节): " << parser_us << " us/条 (" << parser_count
+              << " 句)，快 " << std::setprecision(1) << regex_us / parser_us << " 倍\n"
+              << "[基准] 结果不一致的回复: " << mismatches << " 条" << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+int CommandLineTools::benchIvfpq(int argc, char* argv[]) {
+    const size_t rows = argc > 2 ? std::stoul(argv[2]) : 100000;
+    const size_t dim = argc > 3 ? std::stoul(argv[3]) : 1024;
+    const size_t queries = 200;
+    const size_t k = 10;
+    const size_t rerank = 64;
+
+    std::mt19937 rng(7);
+    std::cout << "[基准] 生成 " << rows << " 条 " << dim << " 维向量 (内核: " << VectorMath::kernelName() << ")..." << std::endl;
+    auto centers = make_centers(std::max<size_t>(rows / 100, 8), dim, rng);
+    auto data = sample_vectors(rows, dim, centers, rng);
+    auto query_set = sample_vectors(queries, dim, centers, rng);
+    auto row = [&](size_t i) { return &data[i * dim]; };
+
+    std::vector<std::vector<ScoredIndex>> truth(queries);
+    auto start = Clock::now();
+    for (size_t q = 0; q < queries; ++q) {
+        TopK selector(k);
+        for (size_t i = 0; i < rows; ++i) {
+            selector.push(VectorMath::dot(&query_set[q * dim], row(i), dim), i);
+        }
+        truth[q] = selector.take_sorted();
+    }
+    double exact_us = elapsed_us(start) / queries;
+
+    IVFPQIndex::Params params;
+    params.nlist = std::max<size_t>(1, std::min<size_t>(params.nlist, rows / 64));
+    params.m = dim % 64 == 0 ? 64 : dim % 32 == 0 ? 32 : 1;
+    auto pool = make_training_pool();
+    start = Clock::now();
+    auto index = IVFPQIndex::train(data.data(), rows, dim, params, pool.get());
+    for (size_t i = 0; i < rows; ++i) {
+        index->add(i, row(i));
+    }
+    std::cout << "[基准] IVF-PQ 训练与编码耗时 " << std::fixed << std::setprecision(1) << elapsed_us(start) / 1e6
+              << " s (nlist=" << index->nlist() << ", m=" << index->subquantizers() << ")" << std::endl;
+
+    std::cout << "[基准] 精确扫描: " << std::setprecision(1) << exact_us << " us/查询, recall@" << k << " = 1.000" << std::endl;
+    for (size_t nprobe : {1, 4, 16, 64}) {
+        size_t found = 0;
+        size_t found_reranked = 0;
+        start = Clock::now();
+        std::vector<std::vector<ScoredIndex>> results(queries);
+        for (size_t q = 0; q < queries; ++q) {
+            results[q] = index->search(&query_set[q * dim], rerank, nprobe);
+        }
+        double ivf_us = elapsed_us(start) / queries;
+        for (size_t q = 0; q < queries; ++q) {
+            std::unordered_set<size_t> expected;
+            for (const auto& hit : truth[q]) expected.insert(hit.index);
+            // 近似得分的前 k 个，以及对 rerank 个候选用全精度向量重排后的前 k 个
+            TopK selector(k);
+            for (size_t i = 0; i < results[q].size(); ++i) {
+                if (i < k) found += expected.count(results[q][i].index);
+                selector.push(VectorMath::dot(&query_set[q * dim], row(results[q][i].index), dim), results[q][i].index);
+            }
+            for (const auto& hit : selector.take_sorted()) found_reranked += expected.count(hit.index);
+        }
+        std::cout << "[基准] IVF-PQ nprobe=" << std::setw(3) << nprobe << ": " << std::setprecision(1) << std::setw(8) << ivf_us
+                  << " us/查询, recall@" << k << " = " << std::setprecision(3) << double(found) / double(queries * k)
+                  << ", 重排" << rerank << "个后 = " << double(found_reranked) / double(queries * k)
+                  << ", 加速 " << std::setprecision(1) << exact_us / ivf_us << "x" << std::endl;
+    }
+    return 0;
+}
+
+int CommandLineTools::selftestPublish(int argc, char* argv[]) {
+    const size_t rows = argc > 2 ? std::stoul(argv[2]) : 300;
+    const size_t dim = 32;
+    const fs::path dir = fs::temp_directory_path() / "lingmem_selftest_publish";
+    size_t failures = 0;
+
+    for (const char* index : {"flat", "hnsw"}) {
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        const std::string env_path = (dir / "selftest.env").string();
+        {
+            // 只用临时目录中的文件；合并阈值足够大，合并只由本命令显式触发
+            std::ofstream env(env_path);
+            env << "[API_EMBEDDING]\nEMBEDDING_VECTOR_DIMENSION=" << dim << "\n"
+                << "[Database]\nMEMORY_STORE_PATH=" << (dir / "memory.bin").string() << "\n"
+                << "MEMORY_DB_PATH=" << (dir / "memory.json").string() << "\n"
+                << "MEMORY_WAL_PATH=" << (dir / "memory.wal").string() << "\n"
+                << "COLD_STORE_PATH=" << (dir / "memory_cold.bin").string() << "\n"
+                << "WAL_FSYNC=never\nWAL_COMPACT_MB=1024\nDEDUP_THRESHOLD=0\nRETRIEVAL_MODE=hybrid\n"
+                << "VECTOR_INDEX=" << index << "\n";
+        }
+        ConfigManager config(env_path);
+        FaultInjectingMemoryManager manager(config);
+
+        std::mt19937 rng(11);
+        auto centers = make_centers(16, dim, rng);
+        std::vector<std::string> summaries;
+        std::vector<std::vector<float>> vectors;
+        size_t serial = 0;
+        auto make_memory = [&]() {
+            auto data = sample_vectors(1, dim, centers, rng);
+            std::string summary = "自检记忆 #" + std::to_string(serial++);
+            return std::make_pair(summary, data);
+        };
+        auto add = [&]() {
+            auto memory = make_memory();
+            manager.addMemory(memory.first, memory.second);
+            summaries.push_back(memory.first);
+            vectors.push_back(memory.second);
+        };
+        // 每条记忆都应能以自己的向量和摘要检索到自己排在第一；每次检查之后再新增一条，
+        // 使公开副本切换到另一份，两份副本都被检查到
+        auto verify = [&](const std::string& step) {
+            for (int round = 0; round < 2; ++round) {
+                size_t wrong = manager.size() == summaries.size() ? 0 : 1;
+                for (size_t i = 0; i < summaries.size(); ++i) {
+                    auto result = manager.retrieveMemories(summaries[i], vectors[i], 1);
+                    if (result.empty() || result[0] != summaries[i]) ++wrong;
+                }
+                std::cout << "[自检] " << index << " " << step << " (副本 " << round + 1 << "): " << manager.size()
+                          << " 条，" << (wrong ? "不一致 " + std::to_string(wrong) + " 处" : std::string("一致"))
+                          << std::endl;
+                failures += wrong;
+                add();
+            }
+        };
+        // 期望 action 抛出 (或不抛出) 注入的异常
+        auto expect = [&](const std::string& step, bool should_throw, const std::function<void()>& action) {
+            bool thrown = false;
+            try {
+                action();
+            } catch (const std::exception&) {
+                thrown = true;
+            }
+            if (thrown != should_throw) {
+                std::cout << "[自检] " << index << " " << step << ": " << (thrown ? "意外抛出异常" : "没有抛出异常")
+                          << std::endl;
+                ++failures;
+            }
+            manager.injectFault(0);
+            verify(step);
+        };
+
+        for (size_t i = 0; i < rows; ++i) {
+            add();
+        }
+        manager.compact();
+        for (size_t i = 0; i < rows / 4; ++i) {
+            add(); // 一部分行只在WAL中，重建副本时要从公开副本复制
+        }
+        verify("初始状态");
+
+        // 切换之前失败：新增不生效并报告给调用方
+        expect("新增在切换前失败", true, [&]() {
+            manager.injectFault(1);
+            auto memory = make_memory();
+            manager.addMemory(memory.first, memory.second);
+        });
+        // 重放时失败：新增已经生效，调用方不会看到异常
+        expect("新增在重放时失败", false, [&]() {
+            manager.injectFault(2);
+            add();
+        });
+        // 合并在重新映射新文件时失败：公开副本仍映射旧文件，下一次合并重新写出
+        expect("合并在切换前失败", true, [&]() {
+            manager.injectFault(1);
+            manager.compact();
+        });
+        expect("合并在重放时失败", false, [&]() {
+            manager.injectFault(2);
+            manager.compact();
+        });
+        expect("再次合并", false, [&]() { manager.compact(); });
+    }
+    fs::remove_all(dir);
+
+    std::cout << "[自检] " << (failures ? "失败，共 " + std::to_string(failures) + " 处不一致" : std::string("全部通过"))
+              << std::endl;
+    return failures ? 1 : 0;
+}
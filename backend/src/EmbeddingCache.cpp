@@ -0,0 +1,337 @@
+#include "EmbeddingCache.hpp"
+#include "FileUtil.hpp"
+#include "Logger.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kEntryOverhead = 96; // 链表节点、哈希表槽位等的估计开销
+
+// 编码一条完整的记录帧 (格式与WAL相同的帧头，见 FileUtil)
+std::string encode_record(uint64_t key, const std::string& identity, const std::vector<float>& embedding) {
+    std::string record;
+    record.reserve(FileUtil::kFrameHeaderSize + 16 + identity.size() + embedding.size() * sizeof(float));
+    size_t frame = FileUtil::beginFrame(record);
+    FileUtil::put(record, key);
+    FileUtil::put(record, static_cast<uint32_t>(identity.size()));
+    record += identity;
+    FileUtil::put(record, static_cast<uint32_t>(embedding.size()));
+    record.append(reinterpret_cast<const char*>(embedding.data()), embedding.size() * sizeof(float));
+    FileUtil::finishFrame(record, frame);
+    return record;
+}
+
+} // namespace
+
+EmbeddingCache::EmbeddingCache(std::string path, size_t capacity_bytes, size_t dimension)
+    : path_(std::move(path)), capacity_bytes_(capacity_bytes), dimension_(dimension)
+{
+    if (!enabled() || path_.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    try {
+        load();
+    } catch (const std::exception& e) {
+        // 缓存文件不可用时退化为只在内存中缓存
+        Logger::logError(std::string(e.what()) + "，embedding缓存将只保存在内存中。");
+        close_file();
+        path_.clear();
+        return;
+    }
+    compactor_ = std::thread(&EmbeddingCache::compactor_loop, this);
+}
+
+EmbeddingCache::~EmbeddingCache() {
+    if (compactor_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        compactor_cv_.notify_one();
+        compactor_.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (hits_ + misses_ > 0) {
+        Logger::logInfo("embedding缓存: 共查询 " + std::to_string(hits_ + misses_) + " 次，命中 "
+                        + std::to_string(hits_) + " 次。");
+    }
+    if (fd_ >= 0) {
+        try {
+            rewrite();
+        } catch (const std::exception& e) {
+            Logger::logError(e.what());
+        }
+        close_file();
+    }
+}
+
+std::string EmbeddingCache::make_identity(std::string_view model, std::string_view text) const {
+    std::string dimension = std::to_string(dimension_);
+    std::string identity;
+    identity.reserve(model.size() + dimension.size() + 2 + text.size());
+    identity.append(model);
+    identity.push_back('\0');
+    identity.append(dimension);
+    identity.push_back('\0');
+    identity.append(text);
+    return identity;
+}
+
+bool EmbeddingCache::valid(const std::vector<float>& embedding) const {
+    if (embedding.size() != dimension_) {
+        return false;
+    }
+    bool nonzero = false;
+    for (float x : embedding) {
+        if (!std::isfinite(x)) return false;
+        nonzero = nonzero || x != 0.0f;
+    }
+    return nonzero;
+}
+
+size_t EmbeddingCache::entry_bytes(const Entry& entry) {
+    return kEntryOverhead + entry.identity.size() + entry.embedding.size() * sizeof(float);
+}
+
+bool EmbeddingCache::get(std::string_view model, std::string_view text, std::vector<float>& embedding) {
+    if (!enabled()) {
+        return false;
+    }
+    std::string identity = make_identity(model, text);
+    uint64_t key = FileUtil::fnv1a(FileUtil::kFnvOffset, identity.data(), identity.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end() || it->second->identity != identity) {
+        ++misses_;
+        return false;
+    }
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    embedding = it->second->embedding;
+    return true;
+}
+
+void EmbeddingCache::put(std::string_view model, std::string_view text, const std::vector<float>& embedding) {
+    if (!enabled() || !valid(embedding)) {
+        return;
+    }
+    std::string identity = make_identity(model, text);
+    uint64_t key = FileUtil::fnv1a(FileUtil::kFnvOffset, identity.data(), identity.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert(key, std::move(identity), embedding);
+    if (fd_ < 0) {
+        return;
+    }
+    try {
+        append(lru_.front());
+        if (file_bytes_ > 2 * capacity_bytes_ && !rewriting_ && !compact_requested_) {
+            // 重写交给后台线程，查询线程不等待
+            compact_requested_ = true;
+            compactor_cv_.notify_one();
+        }
+    } catch (const std::exception& e) {
+        Logger::logError(std::string(e.what()) + "，embedding缓存将只保存在内存中。");
+        close_file();
+    }
+}
+
+EmbeddingCache::Stats EmbeddingCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.entries = lru_.size();
+    stats.bytes = bytes_;
+    stats.capacity_bytes = capacity_bytes_;
+    return stats;
+}
+
+void EmbeddingCache::insert(uint64_t key, std::string identity, std::vector<float> embedding) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        // 同一文本 (或哈希冲突的另一段文本)：替换旧的一条
+        bytes_ -= entry_bytes(*it->second);
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+    lru_.push_front(Entry{key, std::move(identity), std::move(embedding)});
+    index_.emplace(key, lru_.begin());
+    bytes_ += entry_bytes(lru_.front());
+    evict();
+}
+
+void EmbeddingCache::evict() {
+    // 至少保留刚插入的一条
+    while (bytes_ > capacity_bytes_ && lru_.size() > 1) {
+        bytes_ -= entry_bytes(lru_.back());
+        index_.erase(lru_.back().key);
+        lru_.pop_back();
+    }
+}
+
+void EmbeddingCache::load() {
+    std::vector<char> content = FileUtil::readFile(path_);
+
+    // 文件中越靠后的记录越新，依次插入后链表头部就是最近使用的
+    size_t discarded = 0;
+    size_t offset = FileUtil::scanFrames(content.data(), content.size(), [&](size_t, const char* cursor, size_t size) {
+        const char* end = cursor + size;
+        uint64_t key = 0;
+        uint32_t identity_size = 0, dimension = 0;
+        if (!FileUtil::take(cursor, end, key) || !FileUtil::take(cursor, end, identity_size)
+            || static_cast<size_t>(end - cursor) < identity_size) {
+            return false;
+        }
+        std::string identity(cursor, identity_size);
+        cursor += identity_size;
+        if (!FileUtil::take(cursor, end, dimension) || static_cast<size_t>(end - cursor) != dimension * sizeof(float)) {
+            return false;
+        }
+        std::vector<float> embedding(dimension);
+        std::memcpy(embedding.data(), cursor, dimension * sizeof(float));
+        if (!valid(embedding)) {
+            // 其他维度配置下写入的记录 (或旧版本缓存的零向量)，重写时丢弃
+            ++discarded;
+            return true;
+        }
+        insert(key, std::move(identity), std::move(embedding));
+        return true;
+    });
+    if (offset < content.size()) {
+        Logger::logError("embedding缓存文件 " + path_ + " 尾部有 " + std::to_string(content.size() - offset)
+                         + " 字节不完整或校验失败的数据，已丢弃。");
+    }
+    if (!lru_.empty()) {
+        Logger::logInfo("已从 " + path_ + " 载入 " + std::to_string(lru_.size()) + " 条缓存的embedding。");
+    }
+
+    if (offset < content.size() || offset > 2 * capacity_bytes_ || discarded > 0) {
+        // 截掉损坏的尾部，或丢掉已被淘汰、维度不符的记录
+        rewrite();
+    } else {
+        fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd_ < 0) {
+            throw std::runtime_error("无法打开embedding缓存文件 " + path_ + ": " + std::strerror(errno));
+        }
+        file_bytes_ = offset;
+    }
+}
+
+void EmbeddingCache::append(const Entry& entry) {
+    std::string record = encode_record(entry.key, entry.identity, entry.embedding);
+    FileUtil::writeFully(fd_, record.data(), record.size(), "embedding缓存文件");
+    file_bytes_ += record.size();
+    if (rewriting_) {
+        backlog_ += record;
+    }
+}
+
+std::string EmbeddingCache::snapshot() const {
+    // 按从旧到新的顺序，重新载入时恢复同样的LRU顺序
+    std::string content;
+    for (auto it = lru_.rbegin(); it != lru_.rend(); ++it) {
+        content += encode_record(it->key, it->identity, it->embedding);
+    }
+    return content;
+}
+
+int EmbeddingCache::write_temp(const std::string& content) const {
+    std::string temp_path = path_ + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("无法创建embedding缓存文件 " + temp_path + ": " + std::strerror(errno));
+    }
+    try {
+        FileUtil::writeFully(fd, content.data(), content.size(), "embedding缓存文件");
+    } catch (...) {
+        discard_temp(fd);
+        throw;
+    }
+    return fd;
+}
+
+void EmbeddingCache::discard_temp(int fd) const {
+    ::close(fd);
+    std::remove((path_ + ".tmp").c_str());
+}
+
+void EmbeddingCache::install(int fd, uint64_t bytes) {
+    if (std::rename((path_ + ".tmp").c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error("替换embedding缓存文件 " + path_ + " 失败: " + std::strerror(errno));
+    }
+    // 新文件以追加方式继续使用 (O_APPEND 对已打开的描述符通过 fcntl 设置)
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_APPEND);
+    close_file();
+    fd_ = fd;
+    file_bytes_ = bytes;
+}
+
+void EmbeddingCache::rewrite() {
+    std::string content = snapshot();
+    int fd = write_temp(content);
+    try {
+        install(fd, content.size());
+    } catch (...) {
+        discard_temp(fd);
+        throw;
+    }
+}
+
+void EmbeddingCache::compactor_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        compactor_cv_.wait(lock, [this] { return stopping_ || compact_requested_; });
+        if (stopping_) {
+            return;
+        }
+        compact_requested_ = false;
+        if (fd_ < 0) {
+            continue;
+        }
+        // 锁内只做编码；写文件期间新追加的记录同时记入 backlog_
+        std::string content = snapshot();
+        rewriting_ = true;
+        backlog_.clear();
+        lock.unlock();
+        int fd = -1;
+        try {
+            fd = write_temp(content);
+        } catch (const std::exception& e) {
+            Logger::logError("重写embedding缓存文件失败: " + std::string(e.what()));
+        }
+        lock.lock();
+        rewriting_ = false;
+        if (fd >= 0) {
+            try {
+                if (fd_ < 0 || stopping_) {
+                    // 文件已停用，或即将在关闭时重写
+                    discard_temp(fd);
+                } else {
+                    FileUtil::writeFully(fd, backlog_.data(), backlog_.size(), "embedding缓存文件");
+                    install(fd, content.size() + backlog_.size());
+                }
+            } catch (const std::exception& e) {
+                discard_temp(fd);
+                Logger::logError("重写embedding缓存文件失败: " + std::string(e.what()));
+            }
+        }
+        backlog_.clear();
+    }
+}
+
+void EmbeddingCache::close_file() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
@@ -0,0 +1,285 @@
+#include "EmbeddingReducer.hpp"
+#include "FileUtil.hpp"
+#include "ThreadPool.hpp"
+#include "VectorMath.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// 记忆库文件中的降维标记
+struct ReductionSection {
+    uint32_t mode;
+    uint32_t input_dimension;
+    uint64_t fingerprint;
+};
+
+// 投影文件的参数分段；文件头中的维度为输入维度
+struct PcaParamsSection {
+    uint64_t output_dimension;
+    float retained_energy;
+    uint32_t reserved;
+};
+
+// 二阶矩矩阵每次累加的样本数：转置后的一块 (维度 × kMomentBlock) 留在L2中
+constexpr size_t kMomentBlock = 256;
+
+// 子空间迭代的轮数：每轮把非主成分方向的分量按特征值之比压缩一次
+constexpr size_t kSubspaceIterations = 30;
+
+// 把 task(0 .. count-1) 交给线程池并行执行，没有线程池时顺序执行
+void parallel_for(ThreadPool* pool, size_t count, const std::function<void(size_t)>& task) {
+    if (pool) {
+        pool->run(count, task);
+    } else {
+        for (size_t i = 0; i < count; ++i) task(i);
+    }
+}
+
+// 修正的 Gram-Schmidt：把 rows 行 (每行 dimension 维) 正交归一化；退化的行换成与前面各行正交的随机方向
+void orthonormalize(float* rows, size_t count, size_t dimension, std::mt19937& rng) {
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    for (size_t k = 0; k < count; ++k) {
+        float* row = rows + k * dimension;
+        for (int attempt = 0; attempt < 3; ++attempt) {
+            for (size_t j = 0; j < k; ++j) {
+                const float* basis = rows + j * dimension;
+                float projection = VectorMath::dot(row, basis, dimension);
+                for (size_t d = 0; d < dimension; ++d) row[d] -= projection * basis[d];
+            }
+            if (VectorMath::normalize(row, dimension) > 1e-6f) break;
+            for (size_t d = 0; d < dimension; ++d) row[d] = normal(rng);
+        }
+    }
+}
+
+} // namespace
+
+EmbeddingReducer::Mode EmbeddingReducer::parseMode(const std::string& value) {
+    std::string lower = value;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (lower == "truncate" || lower == "matryoshka") return Mode::Truncate;
+    if (lower == "pca") return Mode::Pca;
+    return Mode::None;
+}
+
+const char* EmbeddingReducer::modeName(Mode mode) {
+    switch (mode) {
+    case Mode::Truncate: return "truncate";
+    case Mode::Pca: return "pca";
+    default: return "none";
+    }
+}
+
+EmbeddingReducer::EmbeddingReducer(Mode mode, size_t input_dimension, size_t output_dimension)
+    : mode_(mode), input_dimension_(input_dimension),
+      output_dimension_(mode == Mode::None ? input_dimension : output_dimension) {
+    if (mode == Mode::Pca) {
+        throw std::runtime_error("PCA投影需要通过 trainPca() 或 loadPca() 创建。");
+    }
+    if (mode == Mode::Truncate && (output_dimension_ == 0 || output_dimension_ >= input_dimension_)) {
+        throw std::runtime_error("截断后的维度 (" + std::to_string(output_dimension_) + ") 必须小于原始维度 ("
+                                 + std::to_string(input_dimension_) + ")。");
+    }
+    compute_fingerprint();
+}
+
+std::unique_ptr<EmbeddingReducer> EmbeddingReducer::trainPca(const float* data, size_t rows, size_t input_dimension,
+                                                             size_t output_dimension, ThreadPool* pool) {
+    if (rows == 0 || input_dimension == 0) {
+        throw std::runtime_error("没有可用于训练PCA投影的向量。");
+    }
+    if (output_dimension == 0 || output_dimension >= input_dimension) {
+        throw std::runtime_error("PCA降维后的维度 (" + std::to_string(output_dimension) + ") 必须小于原始维度 ("
+                                 + std::to_string(input_dimension) + ")。");
+    }
+    const size_t dim = input_dimension;
+    const size_t samples = std::min(rows, kTrainSamples);
+    const size_t parts = pool ? pool->workers() + 1 : 1;
+
+    // 二阶矩矩阵 C = Σ x xᵀ / n 的上三角：每块样本先转置，使 C[i][j] 成为两段连续内存的点积；
+    // 各线程按行交错分担 (上三角越往下越短)，只写自己的行
+    std::vector<float> moment(dim * dim, 0.0f);
+    std::vector<float> block(dim * kMomentBlock);
+    for (size_t first = 0; first < samples; first += kMomentBlock) {
+        size_t count = std::min(kMomentBlock, samples - first);
+        for (size_t s = 0; s < count; ++s) {
+            size_t source = samples == rows ? first + s : (first + s) * rows / samples;
+            const float* x = data + source * dim;
+            for (size_t d = 0; d < dim; ++d) block[d * kMomentBlock + s] = x[d];
+        }
+        parallel_for(pool, parts, [&](size_t part) {
+            for (size_t i = part; i < dim; i += parts) {
+                const float* xi = &block[i * kMomentBlock];
+                float* out = &moment[i * dim];
+                size_t j = i;
+                for (; j + 4 <= dim; j += 4) {
+                    float sums[4];
+                    VectorMath::dot4(&block[j * kMomentBlock], kMomentBlock, xi, count, sums);
+                    for (size_t t = 0; t < 4; ++t) out[j + t] += sums[t];
+                }
+                for (; j < dim; ++j) out[j] += VectorMath::dot(&block[j * kMomentBlock], xi, count);
+            }
+        });
+    }
+    double trace = 0.0;
+    for (size_t i = 0; i < dim; ++i) {
+        for (size_t j = i; j < dim; ++j) {
+            moment[i * dim + j] /= static_cast<float>(samples);
+            moment[j * dim + i] = moment[i * dim + j];
+        }
+        trace += moment[i * dim + i];
+    }
+
+    // 子空间迭代：Q ← orth(C Q)，收敛到前 output_dimension 个特征向量张成的子空间
+    // (降维后的内积只取决于这个子空间，与其中基的选取无关)
+    std::mt19937 rng(20240601);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<float> basis(output_dimension * dim);
+    for (auto& x : basis) x = normal(rng);
+    orthonormalize(basis.data(), output_dimension, dim, rng);
+    std::vector<float> next(output_dimension * dim);
+    auto multiply = [&]() {
+        parallel_for(pool, parts, [&](size_t part) {
+            for (size_t k = part; k < output_dimension; k += parts) {
+                const float* q = &basis[k * dim];
+                float* z = &next[k * dim];
+                size_t i = 0;
+                for (; i + 4 <= dim; i += 4) VectorMath::dot4(&moment[i * dim], dim, q, dim, z + i);
+                for (; i < dim; ++i) z[i] = VectorMath::dot(&moment[i * dim], q, dim);
+            }
+        });
+    };
+    for (size_t iteration = 0; iteration < kSubspaceIterations; ++iteration) {
+        multiply();
+        basis.swap(next);
+        orthonormalize(basis.data(), output_dimension, dim, rng);
+    }
+
+    // 各方向上的能量 qᵀCq，按从大到小排列 (前面的维度最重要，与 Matryoshka 的截断习惯一致)
+    multiply();
+    std::vector<double> energy(output_dimension);
+    double retained = 0.0;
+    for (size_t k = 0; k < output_dimension; ++k) {
+        energy[k] = VectorMath::dot(&basis[k * dim], &next[k * dim], dim);
+        retained += energy[k];
+    }
+    std::vector<size_t> order(output_dimension);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return energy[a] > energy[b]; });
+
+    std::unique_ptr<EmbeddingReducer> reducer(new EmbeddingReducer());
+    reducer->mode_ = Mode::Pca;
+    reducer->input_dimension_ = dim;
+    reducer->output_dimension_ = output_dimension;
+    reducer->retained_energy_ = trace > 0.0 ? static_cast<float>(std::min(1.0, retained / trace)) : 0.0f;
+    reducer->components_ = MappedColumn<float>(dim);
+    reducer->components_.reserve_tail(output_dimension);
+    for (size_t k : order) {
+        reducer->components_.append(&basis[k * dim]);
+    }
+    reducer->compute_fingerprint();
+    return reducer;
+}
+
+std::unique_ptr<EmbeddingReducer> EmbeddingReducer::loadPca(const std::string& path) {
+    std::unique_ptr<EmbeddingReducer> reducer(new EmbeddingReducer());
+    MemoryStoreFile& file = reducer->file_;
+    file.openAuxiliary(path);
+
+    size_t size = 0;
+    const auto* params = static_cast<const PcaParamsSection*>(file.section(MemoryStoreFile::PcaParams, &size));
+    if (!params || size != sizeof(PcaParamsSection) || params->output_dimension == 0
+        || params->output_dimension >= file.dimension()) {
+        throw std::runtime_error("PCA投影文件 " + path + " 缺少参数分段或参数无效。");
+    }
+    size_t components_size = 0;
+    const auto* components =
+        static_cast<const float*>(file.section(MemoryStoreFile::PcaComponents, &components_size));
+    if (!components || components_size != params->output_dimension * file.dimension() * sizeof(float)) {
+        throw std::runtime_error("PCA投影文件 " + path + " 的分段大小不符，可能已损坏。");
+    }
+
+    reducer->mode_ = Mode::Pca;
+    reducer->input_dimension_ = file.dimension();
+    reducer->output_dimension_ = params->output_dimension;
+    reducer->retained_energy_ = params->retained_energy;
+    reducer->components_ = MappedColumn<float>(file.dimension());
+    reducer->components_.attach(components, params->output_dimension);
+    reducer->compute_fingerprint();
+    return reducer;
+}
+
+void EmbeddingReducer::savePca(const std::string& path) const {
+    if (mode_ != Mode::Pca) {
+        throw std::runtime_error("只有PCA投影可以保存为文件。");
+    }
+    MemoryStoreWriter writer(path, input_dimension_, 0);
+    PcaParamsSection params{output_dimension_, retained_energy_, 0};
+    writer.beginSection(MemoryStoreFile::PcaParams);
+    writer.write(&params, sizeof(params));
+    writer.beginSection(MemoryStoreFile::PcaComponents);
+    components_.for_each_block(0, output_dimension_, [&](size_t, const float* data, size_t count) {
+        writer.write(data, count * input_dimension_ * sizeof(float));
+    });
+    writer.endSection();
+    writer.commit();
+}
+
+void EmbeddingReducer::reduce(const float* input, float* output) const {
+    if (mode_ != Mode::Pca) {
+        std::memcpy(output, input, output_dimension_ * sizeof(float));
+        return;
+    }
+    // 投影的各行要么全部映射自文件，要么全部在内存尾部，相邻4行总是连续存放
+    const float* components = components_.row(0);
+    size_t k = 0;
+    for (; k + 4 <= output_dimension_; k += 4) {
+        VectorMath::dot4(components + k * input_dimension_, input_dimension_, input, input_dimension_, output + k);
+    }
+    for (; k < output_dimension_; ++k) {
+        output[k] = VectorMath::dot(components + k * input_dimension_, input, input_dimension_);
+    }
+}
+
+bool EmbeddingReducer::matches(const MemoryStoreFile& store) const {
+    if (store.dimension() != output_dimension_) {
+        return false;
+    }
+    size_t size = 0;
+    const auto* section = static_cast<const ReductionSection*>(store.section(MemoryStoreFile::Reduction, &size));
+    if (!section) {
+        return mode_ == Mode::None;
+    }
+    return size == sizeof(ReductionSection) && section->mode == static_cast<uint32_t>(mode_)
+           && section->input_dimension == input_dimension_ && section->fingerprint == fingerprint_;
+}
+
+void EmbeddingReducer::writeSections(MemoryStoreWriter& writer) const {
+    if (mode_ == Mode::None) {
+        return;
+    }
+    ReductionSection section{static_cast<uint32_t>(mode_), static_cast<uint32_t>(input_dimension_), fingerprint_};
+    writer.beginSection(MemoryStoreFile::Reduction);
+    writer.write(&section, sizeof(section));
+    writer.endSection();
+}
+
+void EmbeddingReducer::compute_fingerprint() {
+    uint64_t hash = FileUtil::kFnvOffset;
+    uint64_t header[3] = {static_cast<uint64_t>(mode_), input_dimension_, output_dimension_};
+    hash = FileUtil::fnv1a(hash, header, sizeof(header));
+    if (mode_ == Mode::Pca) {
+        components_.for_each_block(0, output_dimension_, [&](size_t, const float* data, size_t count) {
+            hash = FileUtil::fnv1a(hash, data, count * input_dimension_ * sizeof(float));
+        });
+    }
+    fingerprint_ = hash;
+}
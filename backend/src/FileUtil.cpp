@@ -0,0 +1,97 @@
+#include "FileUtil.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+void FileUtil::writeFully(int fd, const char* data, size_t size, const char* what) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = ::write(fd, data + written, size - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("写入") + what + "失败: " + std::strerror(errno));
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+
+std::vector<char> FileUtil::readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return {};
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void FileUtil::fsyncParentDir(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return;
+    fsync(fd);
+    ::close(fd);
+}
+
+size_t FileUtil::beginFrame(std::string& out) {
+    size_t start = out.size();
+    out.append(kFrameHeaderSize, '\0');
+    return start;
+}
+
+void FileUtil::finishFrame(std::string& out, size_t frame_start) {
+    const char* payload = out.data() + frame_start + kFrameHeaderSize;
+    uint32_t payload_size = static_cast<uint32_t>(out.size() - frame_start - kFrameHeaderSize);
+    uint32_t checksum = crc32(payload, payload_size);
+    std::memcpy(&out[frame_start], &payload_size, sizeof(payload_size));
+    std::memcpy(&out[frame_start + 4], &checksum, sizeof(checksum));
+}
+
+size_t FileUtil::scanFrames(const char* data, size_t size,
+                            const std::function<bool(size_t, const char*, size_t)>& on_payload) {
+    size_t offset = 0;
+    while (size - offset >= kFrameHeaderSize) {
+        uint32_t payload_size = 0, checksum = 0;
+        std::memcpy(&payload_size, data + offset, sizeof(payload_size));
+        std::memcpy(&checksum, data + offset + 4, sizeof(checksum));
+        if (payload_size > kMaxFramePayload || size - offset - kFrameHeaderSize < payload_size) {
+            break;
+        }
+        const char* payload = data + offset + kFrameHeaderSize;
+        if (crc32(payload, payload_size) != checksum || !on_payload(offset, payload, payload_size)) {
+            break;
+        }
+        offset += kFrameHeaderSize + payload_size;
+    }
+    return offset;
+}
+
+uint32_t FileUtil::crc32(const char* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1u) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFFu] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+uint64_t FileUtil::fnv1a(uint64_t hash, const void* data, size_t bytes) {
+    const auto* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < bytes; ++i) {
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,217 @@
+#include "HNSWIndex.hpp"
+#include "VectorMath.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// 每个线程一份的访问标记表：用递增的“轮次”代替每次查询都清零整张表
+struct VisitedMarks {
+    std::vector<uint32_t> marks;
+    uint32_t epoch = 0;
+
+    void reset(size_t n) {
+        if (marks.size() < n) marks.resize(n, 0);
+        if (++epoch == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            epoch = 1;
+        }
+    }
+    // 已访问返回 true；否则标记为已访问并返回 false
+    bool test_and_mark(size_t id) {
+        if (marks[id] == epoch) return true;
+        marks[id] = epoch;
+        return false;
+    }
+};
+
+VisitedMarks& thread_visited(size_t n) {
+    thread_local VisitedMarks visited;
+    visited.reset(n);
+    return visited;
+}
+
+// 候选集是按得分的最大堆，结果集是按得分的最小堆 (堆顶为当前最差结果)
+bool lower_score(const ScoredIndex& a, const ScoredIndex& b) { return a.score < b.score; }
+bool higher_score(const ScoredIndex& a, const ScoredIndex& b) { return a.score > b.score; }
+
+} // namespace
+
+HNSWIndex::HNSWIndex(size_t dimension, const Params& params, RowFn row_fn)
+    : dimension_(dimension),
+      params_(params),
+      row_fn_(std::move(row_fn)),
+      max_links0_(std::max<size_t>(params.M, 2) * 2),
+      max_links_(std::max<size_t>(params.M, 2)),
+      level_mult_(1.0 / std::log(static_cast<double>(std::max<size_t>(params.M, 2)))) {}
+
+float HNSWIndex::similarity(const float* query, size_t id) const {
+    return VectorMath::dot(query, row_fn_(id), dimension_);
+}
+
+int HNSWIndex::random_level() {
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    double r = std::max(dist(rng_), 1e-12);
+    return static_cast<int>(-std::log(r) * level_mult_);
+}
+
+uint32_t* HNSWIndex::links(size_t id, int level) {
+    if (level == 0) return &links0_[id * (max_links0_ + 1)];
+    return &upper_links_[id][(level - 1) * (max_links_ + 1)];
+}
+
+const uint32_t* HNSWIndex::links(size_t id, int level) const {
+    if (level == 0) return &links0_[id * (max_links0_ + 1)];
+    return &upper_links_[id][(level - 1) * (max_links_ + 1)];
+}
+
+std::vector<ScoredIndex> HNSWIndex::search_layer(const float* query, size_t entry, size_t ef, int level,
+                                                 const Filter* accept) const {
+    VisitedMarks& visited = thread_visited(levels_.size());
+    std::vector<ScoredIndex> candidates;
+    std::vector<ScoredIndex> results;
+    candidates.reserve(ef * 2);
+    results.reserve(ef + 1);
+
+    // 过滤时结果集只收满足条件的节点，候选集照常扩展；结果集未满之前不会提前停止
+    auto accepted = [&](size_t id) { return !accept || (*accept)(id); };
+
+    ScoredIndex start{similarity(query, entry), entry};
+    visited.test_and_mark(entry);
+    candidates.push_back(start);
+    if (accepted(entry)) {
+        results.push_back(start);
+    }
+
+    while (!candidates.empty()) {
+        std::pop_heap(candidates.begin(), candidates.end(), lower_score);
+        ScoredIndex current = candidates.back();
+        candidates.pop_back();
+        // 最好的候选也比结果集中最差的还差，继续扩展不会再有收益
+        if (results.size() >= ef && current.score < results.front().score) break;
+
+        const uint32_t* neighbor_list = links(current.index, level);
+        for (uint32_t i = 1; i <= neighbor_list[0]; ++i) {
+            size_t neighbor = neighbor_list[i];
+            if (visited.test_and_mark(neighbor)) continue;
+            float score = similarity(query, neighbor);
+            if (results.size() < ef || score > results.front().score) {
+                candidates.push_back({score, neighbor});
+                std::push_heap(candidates.begin(), candidates.end(), lower_score);
+                if (!accepted(neighbor)) continue;
+                results.push_back({score, neighbor});
+                std::push_heap(results.begin(), results.end(), higher_score);
+                if (results.size() > ef) {
+                    std::pop_heap(results.begin(), results.end(), higher_score);
+                    results.pop_back();
+                }
+            }
+        }
+    }
+    return results;
+}
+
+std::vector<ScoredIndex> HNSWIndex::select_neighbors(std::vector<ScoredIndex> candidates, size_t max_count) const {
+    std::sort(candidates.begin(), candidates.end(), higher_score);
+    std::vector<ScoredIndex> selected;
+    selected.reserve(max_count);
+    for (const auto& candidate : candidates) {
+        if (selected.size() >= max_count) break;
+        const float* candidate_row = row_fn_(candidate.index);
+        bool diverse = true;
+        for (const auto& kept : selected) {
+            // 候选离某个已选邻居比离目标节点更近，则它可以经由该邻居到达
+            if (similarity(candidate_row, kept.index) > candidate.score) {
+                diverse = false;
+                break;
+            }
+        }
+        if (diverse) selected.push_back(candidate);
+    }
+    return selected;
+}
+
+void HNSWIndex::connect(size_t id, size_t neighbor, int level) {
+    size_t capacity = (level == 0) ? max_links0_ : max_links_;
+    uint32_t* neighbor_list = links(id, level);
+    if (neighbor_list[0] < capacity) {
+        neighbor_list[++neighbor_list[0]] = static_cast<uint32_t>(neighbor);
+        return;
+    }
+
+    // 邻居表已满：把新邻居与现有邻居放在一起重新做一次启发式筛选
+    const float* base = row_fn_(id);
+    std::vector<ScoredIndex> candidates;
+    candidates.reserve(capacity + 1);
+    for (uint32_t i = 1; i <= neighbor_list[0]; ++i) {
+        candidates.push_back({similarity(base, neighbor_list[i]), neighbor_list[i]});
+    }
+    candidates.push_back({similarity(base, neighbor), neighbor});
+    auto kept = select_neighbors(std::move(candidates), capacity);
+    neighbor_list[0] = static_cast<uint32_t>(kept.size());
+    for (size_t i = 0; i < kept.size(); ++i) {
+        neighbor_list[i + 1] = static_cast<uint32_t>(kept[i].index);
+    }
+}
+
+void HNSWIndex::insert(size_t id) {
+    int level = random_level();
+    levels_.push_back(level);
+    links0_.resize(levels_.size() * (max_links0_ + 1), 0);
+    upper_links_.emplace_back(static_cast<size_t>(level) * (max_links_ + 1), 0);
+
+    if (max_level_ < 0) {
+        entry_point_ = id;
+        max_level_ = level;
+        return;
+    }
+
+    const float* query = row_fn_(id);
+    size_t entry = entry_point_;
+    // 在高于新节点层级的各层上贪心下降，只为找到一个好的入口
+    for (int l = max_level_; l > level; --l) {
+        auto nearest = search_layer(query, entry, 1, l);
+        entry = std::max_element(nearest.begin(), nearest.end(), lower_score)->index;
+    }
+
+    for (int l = std::min(level, max_level_); l >= 0; --l) {
+        auto candidates = search_layer(query, entry, params_.ef_construction, l);
+        entry = std::max_element(candidates.begin(), candidates.end(), lower_score)->index;
+
+        auto neighbors = select_neighbors(std::move(candidates), max_links_);
+        uint32_t* own_links = links(id, l);
+        own_links[0] = static_cast<uint32_t>(neighbors.size());
+        for (size_t i = 0; i < neighbors.size(); ++i) {
+            own_links[i + 1] = static_cast<uint32_t>(neighbors[i].index);
+        }
+        for (const auto& neighbor : neighbors) {
+            connect(neighbor.index, id, l);
+        }
+    }
+
+    if (level > max_level_) {
+        max_level_ = level;
+        entry_point_ = id;
+    }
+}
+
+std::vector<ScoredIndex> HNSWIndex::search(const float* query, size_t k, size_t ef, const Filter& accept) const {
+    if (levels_.empty() || k == 0) {
+        return {};
+    }
+    ef = std::max(ef == 0 ? params_.ef_search : ef, k);
+
+    size_t entry = entry_point_;
+    for (int l = max_level_; l > 0; --l) {
+        auto nearest = search_layer(query, entry, 1, l);
+        entry = std::max_element(nearest.begin(), nearest.end(), lower_score)->index;
+    }
+
+    // 上层只负责找入口，过滤条件只作用在包含全部节点的第0层
+    auto results = search_layer(query, entry, ef, 0, accept ? &accept : nullptr);
+    std::sort(results.begin(), results.end(), higher_score);
+    if (results.size() > k) {
+        results.resize(k);
+    }
+    return results;
+}
@@ -26,7 +26,8 @@ HTTPClient::~HTTPClient() {
 }
 
 size_t HTTPClient::WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    ((std::string*)userp)->append((char*)contents, size * nmemb);
+    const auto& on_data = *static_cast<const std::function<void(std::string_view)>*>(userp);
+    on_data(std::string_view(static_cast<const char*>(contents), size * nmemb));
     return size * nmemb;
 }
 
@@ -38,14 +39,33 @@ std::string HTTPClient::get(const std::string& url, const std::vector<std::strin
     return sendRequest(url, "GET", "", headers);
 }
 
+void HTTPClient::postStream(const std::string& url, const std::string& data,
+                            const std::function<void(std::string_view)>& on_data,
+                            const std::vector<std::string>& headers) {
+    perform(url, "POST", data, headers, on_data);
+}
+
 std::string HTTPClient::sendRequest(const std::string& url, const std::string& method, const std::string& data, const std::vector<std::string>& additional_headers) {
+    std::string response_string;
+    perform(url, method, data, additional_headers,
+            [&response_string](std::string_view chunk) { response_string.append(chunk); });
+    return response_string;
+}
+
+void HTTPClient::perform(const std::string& url, const std::string& method, const std::string& data,
+                         const std::vector<std::string>& additional_headers,
+                         const std::function<void(std::string_view)>& on_data) {
     if (!curl_) throw std::runtime_error("cURL 句柄无效。");
     curl_easy_reset(curl_);
-    std::string response_string;
     struct curl_slist* chunk = nullptr;
     curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response_string);
+    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &on_data);
+    if (timeout_seconds_ > 0) {
+        // 多线程中使用超时时不能依赖信号
+        curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl_, CURLOPT_TIMEOUT, timeout_seconds_);
+    }
     if (method == "POST") {
         curl_easy_setopt(curl_, CURLOPT_POST, 1L);
         curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, data.c_str());
@@ -70,5 +90,4 @@ std::string HTTPClient::sendRequest(const std::string& url, const std::string& m
     if (res != CURLE_OK) {
         throw std::runtime_error("cURL 请求失败: " + std::string(curl_easy_strerror(res)));
     }
-    return response_string;
 }
\ No newline at end of file
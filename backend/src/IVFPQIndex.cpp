@@ -0,0 +1,391 @@
+#include "IVFPQIndex.hpp"
+#include "ThreadPool.hpp"
+#include "VectorMath.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t kAssignChunk = 4096; // k-means 分配步骤每个并行分片的向量数
+
+// 对每个中心计算 |c|²/2，使最近中心的判断化为 x·c - |c|²/2 的最大值 (省去 |x|²)
+void half_norms(const float* centroids, size_t k, size_t dimension, std::vector<float>& out) {
+    out.resize(k);
+    for (size_t c = 0; c < k; ++c) {
+        const float* row = centroids + c * dimension;
+        out[c] = 0.5f * VectorMath::dot(row, row, dimension);
+    }
+}
+
+// 低维 (PQ子空间) 时逐个调用点积内核的开销远大于计算本身，改为在转置的中心上按列累加：
+// transposed[d * k + c] 为第 c 个中心的第 d 维，内层循环对 k 个中心连续访问，可以被编译器向量化
+constexpr size_t kTransposedMaxDimension = 64;
+
+void transpose(const float* rows, size_t k, size_t dimension, std::vector<float>& out) {
+    out.resize(k * dimension);
+    for (size_t c = 0; c < k; ++c) {
+        for (size_t d = 0; d < dimension; ++d) out[d * k + c] = rows[c * dimension + d];
+    }
+}
+
+// scores[c] = x · 中心c - bias[c]
+void score_transposed(const float* x, const float* transposed, const float* bias, size_t k, size_t dimension,
+                      float* scores) {
+    for (size_t c = 0; c < k; ++c) scores[c] = -bias[c];
+    for (size_t d = 0; d < dimension; ++d) {
+        const float* column = transposed + d * k;
+        float value = x[d];
+        for (size_t c = 0; c < k; ++c) scores[c] += value * column[c];
+    }
+}
+
+size_t argmax(const float* scores, size_t k) {
+    return static_cast<size_t>(std::max_element(scores, scores + k) - scores);
+}
+
+size_t nearest(const float* x, const float* centroids, const float* norms, size_t k, size_t dimension) {
+    size_t best = 0;
+    float best_score = -std::numeric_limits<float>::infinity();
+    for (size_t c = 0; c < k; ++c) {
+        float score = VectorMath::dot(x, centroids + c * dimension, dimension) - norms[c];
+        if (score > best_score) {
+            best_score = score;
+            best = c;
+        }
+    }
+    return best;
+}
+
+/**
+ * Lloyd k-means：以随机抽取的 k 个样本为初始中心，迭代“分配 - 求均值”。
+ * 样本不足 k 个时循环复用样本作为中心；迭代中变空的簇从随机样本重新播种。
+ */
+std::vector<float> kmeans(const float* data, size_t n, size_t dimension, size_t k, size_t iterations,
+                          ThreadPool* pool, std::mt19937& rng) {
+    std::vector<float> centroids(k * dimension);
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::shuffle(order.begin(), order.end(), rng);
+    for (size_t c = 0; c < k; ++c) {
+        std::memcpy(&centroids[c * dimension], data + order[c % n] * dimension, dimension * sizeof(float));
+    }
+    if (n <= k) {
+        return centroids;
+    }
+
+    std::vector<uint32_t> assignment(n);
+    std::vector<float> norms;
+    std::vector<float> transposed;
+    const bool small = dimension <= kTransposedMaxDimension;
+    std::vector<float> sums(k * dimension);
+    std::vector<size_t> counts(k);
+    std::uniform_int_distribution<size_t> pick(0, n - 1);
+    size_t chunks = (n + kAssignChunk - 1) / kAssignChunk;
+    for (size_t iteration = 0; iteration < iterations; ++iteration) {
+        half_norms(centroids.data(), k, dimension, norms);
+        if (small) transpose(centroids.data(), k, dimension, transposed);
+        auto assign = [&](size_t chunk) {
+            size_t end = std::min(n, (chunk + 1) * kAssignChunk);
+            std::vector<float> scores(small ? k : 0);
+            for (size_t i = chunk * kAssignChunk; i < end; ++i) {
+                const float* x = data + i * dimension;
+                if (small) {
+                    score_transposed(x, transposed.data(), norms.data(), k, dimension, scores.data());
+                    assignment[i] = static_cast<uint32_t>(argmax(scores.data(), k));
+                } else {
+                    assignment[i] = static_cast<uint32_t>(nearest(x, centroids.data(), norms.data(), k, dimension));
+                }
+            }
+        };
+        if (pool && chunks > 1) {
+            pool->run(chunks, assign);
+        } else {
+            for (size_t chunk = 0; chunk < chunks; ++chunk) assign(chunk);
+        }
+
+        std::fill(sums.begin(), sums.end(), 0.0f);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < n; ++i) {
+            float* sum = &sums[assignment[i] * dimension];
+            const float* x = data + i * dimension;
+            for (size_t d = 0; d < dimension; ++d) sum[d] += x[d];
+            ++counts[assignment[i]];
+        }
+        for (size_t c = 0; c < k; ++c) {
+            float* centroid = &centroids[c * dimension];
+            if (counts[c] == 0) {
+                std::memcpy(centroid, data + pick(rng) * dimension, dimension * sizeof(float));
+                continue;
+            }
+            float scale = 1.0f / static_cast<float>(counts[c]);
+            for (size_t d = 0; d < dimension; ++d) centroid[d] = sums[c * dimension + d] * scale;
+        }
+    }
+    return centroids;
+}
+
+struct IvfParamsSection {
+    uint64_t nlist;
+    uint64_t m;
+    uint64_t rows;
+};
+
+} // namespace
+
+std::unique_ptr<IVFPQIndex> IVFPQIndex::train(const float* data, size_t rows, size_t dimension, const Params& params,
+                                              ThreadPool* pool) {
+    if (rows == 0 || dimension == 0) {
+        throw std::runtime_error("没有可用于训练IVF-PQ索引的向量。");
+    }
+    if (params.m == 0 || dimension % params.m != 0) {
+        throw std::runtime_error("IVF-PQ的分段数 (" + std::to_string(params.m) + ") 必须整除向量维度 ("
+                                 + std::to_string(dimension) + ")。");
+    }
+    size_t nlist = std::max<size_t>(1, std::min(params.nlist, rows));
+    std::unique_ptr<IVFPQIndex> index(new IVFPQIndex(dimension, nlist, params.m));
+
+    // 均匀抽样训练集 (固定种子，同一份数据训练结果可复现)
+    std::mt19937 rng(20240601);
+    size_t samples = std::min(rows, std::max<size_t>(params.train_samples, nlist));
+    std::vector<float> training(samples * dimension);
+    for (size_t i = 0; i < samples; ++i) {
+        size_t source = samples == rows ? i : i * rows / samples;
+        std::memcpy(&training[i * dimension], data + source * dimension, dimension * sizeof(float));
+    }
+
+    // 粗量化中心
+    std::vector<float> centroids = kmeans(training.data(), samples, dimension, nlist, params.iterations, pool, rng);
+    for (size_t c = 0; c < nlist; ++c) {
+        index->centroids_.append(&centroids[c * dimension]);
+    }
+    half_norms(centroids.data(), nlist, dimension, index->centroid_norms_);
+
+    // 残差按段拆成 m 份连续的子向量，各自训练 256 个中心
+    size_t dsub = index->sub_dimension_;
+    std::vector<float> residuals(samples * dimension);
+    for (size_t i = 0; i < samples; ++i) {
+        const float* x = &training[i * dimension];
+        const float* c = &centroids[index->nearest_centroid(x) * dimension];
+        for (size_t d = 0; d < dimension; ++d) residuals[i * dimension + d] = x[d] - c[d];
+    }
+    std::vector<float> sub(samples * dsub);
+    for (size_t j = 0; j < params.m; ++j) {
+        for (size_t i = 0; i < samples; ++i) {
+            std::memcpy(&sub[i * dsub], &residuals[i * dimension + j * dsub], dsub * sizeof(float));
+        }
+        std::vector<float> codebook = kmeans(sub.data(), samples, dsub, kCodebookSize, params.iterations, pool, rng);
+        for (size_t c = 0; c < kCodebookSize; ++c) {
+            index->codebooks_.append(&codebook[c * dsub]);
+        }
+    }
+    index->compute_norms();
+    return index;
+}
+
+std::unique_ptr<IVFPQIndex> IVFPQIndex::load(const std::string& path) {
+    // 先映射到索引对象自己持有的文件上，各列直接挂接映射内容，在对象的整个生命周期内有效
+    std::unique_ptr<IVFPQIndex> index(new IVFPQIndex());
+    MemoryStoreFile& file = index->file_;
+    file.openAuxiliary(path);
+
+    size_t size = 0;
+    const auto* params = static_cast<const IvfParamsSection*>(file.section(MemoryStoreFile::IvfParams, &size));
+    if (!params || size != sizeof(IvfParamsSection) || params->nlist == 0 || params->m == 0
+        || file.dimension() == 0 || file.dimension() % params->m != 0) {
+        throw std::runtime_error("IVF-PQ索引文件 " + path + " 缺少参数分段或参数无效。");
+    }
+    size_t dimension = file.dimension();
+    size_t nlist = params->nlist;
+    size_t m = params->m;
+    size_t rows = params->rows;
+
+    size_t centroids_size = 0, codebooks_size = 0, offsets_size = 0, ids_size = 0, codes_size = 0;
+    const auto* centroids = static_cast<const float*>(file.section(MemoryStoreFile::IvfCentroids, &centroids_size));
+    const auto* codebooks = static_cast<const float*>(file.section(MemoryStoreFile::IvfCodebooks, &codebooks_size));
+    const auto* offsets = static_cast<const uint64_t*>(file.section(MemoryStoreFile::IvfListOffsets, &offsets_size));
+    const auto* ids = static_cast<const uint32_t*>(file.section(MemoryStoreFile::IvfListIds, &ids_size));
+    const auto* codes = static_cast<const uint8_t*>(file.section(MemoryStoreFile::IvfListCodes, &codes_size));
+    if (!centroids || !codebooks || !offsets || !ids || !codes
+        || centroids_size != nlist * dimension * sizeof(float)
+        || codebooks_size != kCodebookSize * dimension * sizeof(float)
+        || offsets_size != (nlist + 1) * sizeof(uint64_t)
+        || ids_size != rows * sizeof(uint32_t)
+        || codes_size != rows * m
+        || offsets[0] != 0 || offsets[nlist] != rows) {
+        throw std::runtime_error("IVF-PQ索引文件 " + path + " 的分段大小不符，可能已损坏。");
+    }
+    for (size_t l = 0; l < nlist; ++l) {
+        if (offsets[l] > offsets[l + 1]) {
+            throw std::runtime_error("IVF-PQ索引文件 " + path + " 的倒排列表偏移无效。");
+        }
+    }
+
+    index->configure(dimension, nlist, m);
+    index->centroids_.attach(centroids, nlist);
+    index->codebooks_.attach(codebooks, m * kCodebookSize);
+    for (size_t l = 0; l < nlist; ++l) {
+        size_t count = offsets[l + 1] - offsets[l];
+        index->list_ids_[l].attach(ids + offsets[l], count);
+        index->list_codes_[l].attach(codes + offsets[l] * m, count);
+    }
+    index->rows_ = rows;
+    index->compute_norms();
+    return index;
+}
+
+void IVFPQIndex::save(const std::string& path) const {
+    MemoryStoreWriter writer(path, dimension_, 0);
+
+    IvfParamsSection params{nlist_, m_, rows_};
+    writer.beginSection(MemoryStoreFile::IvfParams);
+    writer.write(&params, sizeof(params));
+
+    writer.beginSection(MemoryStoreFile::IvfCentroids);
+    centroids_.for_each_block(0, nlist_, [&](size_t, const float* data, size_t count) {
+        writer.write(data, count * dimension_ * sizeof(float));
+    });
+    writer.beginSection(MemoryStoreFile::IvfCodebooks);
+    codebooks_.for_each_block(0, m_ * kCodebookSize, [&](size_t, const float* data, size_t count) {
+        writer.write(data, count * sub_dimension_ * sizeof(float));
+    });
+
+    // 各列表首尾相接 (映射部分与追加部分合并)，偏移表记录每个列表的起点
+    writer.beginSection(MemoryStoreFile::IvfListOffsets);
+    uint64_t offset = 0;
+    writer.write(&offset, sizeof(offset));
+    for (const auto& ids : list_ids_) {
+        offset += ids.rows();
+        writer.write(&offset, sizeof(offset));
+    }
+    writer.beginSection(MemoryStoreFile::IvfListIds);
+    for (const auto& ids : list_ids_) {
+        ids.for_each_block(0, ids.rows(), [&](size_t, const uint32_t* data, size_t count) {
+            writer.write(data, count * sizeof(uint32_t));
+        });
+    }
+    writer.beginSection(MemoryStoreFile::IvfListCodes);
+    for (const auto& codes : list_codes_) {
+        codes.for_each_block(0, codes.rows(), [&](size_t, const uint8_t* data, size_t count) {
+            writer.write(data, count * m_);
+        });
+    }
+    writer.endSection();
+    writer.commit();
+}
+
+void IVFPQIndex::add(size_t id, const float* vector) {
+    if (id != rows_) {
+        throw std::runtime_error("IVF-PQ索引必须按行号顺序加入 (期望 " + std::to_string(rows_) + "，实际 "
+                                 + std::to_string(id) + ")。");
+    }
+    size_t list = nearest_centroid(vector);
+    encode_residual(vector, list, list_codes_[list].append_row());
+    uint32_t row = static_cast<uint32_t>(id);
+    list_ids_[list].append(&row);
+    ++rows_;
+}
+
+std::vector<ScoredIndex> IVFPQIndex::search(const float* query, size_t k, size_t nprobe,
+                                            const std::function<bool(size_t)>& accept) const {
+    if (rows_ == 0 || k == 0) {
+        return {};
+    }
+
+    // 选出与查询内积最大的 nprobe 个列表
+    TopK probes(std::max<size_t>(1, std::min(nprobe, nlist_)));
+    for (size_t l = 0; l < nlist_; ++l) {
+        if (list_ids_[l].rows() > 0) probes.push(VectorMath::dot(query, centroids_.row(l), dimension_), l);
+    }
+
+    // 查找表：table[j * 256 + c] = 查询第 j 段与第 j 段码本第 c 个中心的内积 (按线程复用)
+    thread_local std::vector<float> table;
+    table.resize(m_ * kCodebookSize);
+    for (size_t j = 0; j < m_; ++j) {
+        score_transposed(query + j * sub_dimension_, &codebooks_transposed_[j * kCodebookSize * sub_dimension_],
+                         zero_bias_.data(), kCodebookSize, sub_dimension_, &table[j * kCodebookSize]);
+    }
+
+    TopK selector(k);
+    for (const auto& probe : probes.take_sorted()) {
+        const auto& ids = list_ids_[probe.index];
+        list_codes_[probe.index].for_each_block(0, ids.rows(), [&](size_t first, const uint8_t* codes, size_t count) {
+            const uint32_t* rows = ids.row(first);
+            for (size_t i = 0; i < count; ++i, codes += m_) {
+                if (accept && !accept(rows[i])) continue;
+                float score = probe.score;
+                const float* entry = table.data();
+                for (size_t j = 0; j < m_; ++j, entry += kCodebookSize) score += entry[codes[j]];
+                selector.push(score, rows[i]);
+            }
+        });
+    }
+    return selector.take_sorted();
+}
+
+void IVFPQIndex::clear() {
+    for (auto& ids : list_ids_) ids.clear();
+    for (auto& codes : list_codes_) codes.clear();
+    rows_ = 0;
+}
+
+void IVFPQIndex::configure(size_t dimension, size_t nlist, size_t m) {
+    dimension_ = dimension;
+    nlist_ = nlist;
+    m_ = m;
+    sub_dimension_ = dimension / m;
+    centroids_ = MappedColumn<float>(dimension);
+    codebooks_ = MappedColumn<float>(sub_dimension_);
+    list_ids_.assign(nlist, MappedColumn<uint32_t>(1));
+    list_codes_.assign(nlist, MappedColumn<uint8_t>(m));
+}
+
+void IVFPQIndex::compute_norms() {
+    centroid_norms_.resize(nlist_);
+    for (size_t l = 0; l < nlist_; ++l) {
+        const float* c = centroids_.row(l);
+        centroid_norms_[l] = 0.5f * VectorMath::dot(c, c, dimension_);
+    }
+    codebook_norms_.resize(m_ * kCodebookSize);
+    codebooks_transposed_.resize(m_ * kCodebookSize * sub_dimension_);
+    std::vector<float> transposed;
+    for (size_t j = 0; j < m_; ++j) {
+        const float* codebook = codebooks_.row(j * kCodebookSize);
+        half_norms(codebook, kCodebookSize, sub_dimension_, transposed);
+        std::copy(transposed.begin(), transposed.end(), &codebook_norms_[j * kCodebookSize]);
+        transpose(codebook, kCodebookSize, sub_dimension_, transposed);
+        std::copy(transposed.begin(), transposed.end(), &codebooks_transposed_[j * kCodebookSize * sub_dimension_]);
+    }
+    zero_bias_.assign(kCodebookSize, 0.0f);
+}
+
+size_t IVFPQIndex::nearest_centroid(const float* vector) const {
+    size_t best = 0;
+    float best_score = -std::numeric_limits<float>::infinity();
+    for (size_t l = 0; l < nlist_; ++l) {
+        float score = VectorMath::dot(vector, centroids_.row(l), dimension_) - centroid_norms_[l];
+        if (score > best_score) {
+            best_score = score;
+            best = l;
+        }
+    }
+    return best;
+}
+
+void IVFPQIndex::encode_residual(const float* vector, size_t list, uint8_t* code) const {
+    thread_local std::vector<float> residual;
+    residual.resize(dimension_);
+    const float* centroid = centroids_.row(list);
+    for (size_t d = 0; d < dimension_; ++d) residual[d] = vector[d] - centroid[d];
+
+    float scores[kCodebookSize];
+    for (size_t j = 0; j < m_; ++j) {
+        score_transposed(residual.data() + j * sub_dimension_, &codebooks_transposed_[j * kCodebookSize * sub_dimension_],
+                         &codebook_norms_[j * kCodebookSize], kCodebookSize, sub_dimension_, scores);
+        code[j] = static_cast<uint8_t>(argmax(scores, kCodebookSize));
+    }
+}
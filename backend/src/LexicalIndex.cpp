@@ -0,0 +1,186 @@
+#include "LexicalIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+enum class CharClass { Separator, Word, Cjk };
+
+// 解码一个UTF-8字符，返回码点并前移 pos；非法字节按单字节的分隔符处理
+uint32_t next_codepoint(std::string_view text, size_t& pos) {
+    unsigned char lead = static_cast<unsigned char>(text[pos]);
+    size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+    if (length == 0 || pos + length > text.size()) {
+        ++pos;
+        return 0xFFFD;
+    }
+    uint32_t cp = length == 1 ? lead : lead & (0x7F >> length);
+    for (size_t i = 1; i < length; ++i) {
+        unsigned char c = static_cast<unsigned char>(text[pos + i]);
+        if ((c & 0xC0) != 0x80) {
+            ++pos;
+            return 0xFFFD;
+        }
+        cp = (cp << 6) | (c & 0x3F);
+    }
+    pos += length;
+    return cp;
+}
+
+// 全角字母数字折叠为半角，大写折叠为小写
+uint32_t fold(uint32_t cp) {
+    if (cp >= 0xFF10 && cp <= 0xFF19) cp = cp - 0xFF10 + '0';
+    else if (cp >= 0xFF21 && cp <= 0xFF3A) cp = cp - 0xFF21 + 'a';
+    else if (cp >= 0xFF41 && cp <= 0xFF5A) cp = cp - 0xFF41 + 'a';
+    if (cp >= 'A' && cp <= 'Z') cp += 'a' - 'A';
+    return cp;
+}
+
+CharClass classify(uint32_t cp) {
+    if ((cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z')) return CharClass::Word;
+    if (cp >= 0xC0 && cp <= 0x24F && cp != 0xD7 && cp != 0xF7) return CharClass::Word; // 带变音符的拉丁字母
+    if ((cp >= 0x3040 && cp <= 0x30FF) ||   // 平假名、片假名
+        (cp >= 0x3400 && cp <= 0x4DBF) ||   // 汉字扩展A
+        (cp >= 0x4E00 && cp <= 0x9FFF) ||   // 基本汉字
+        (cp >= 0xF900 && cp <= 0xFAFF) ||   // 兼容汉字
+        (cp >= 0xAC00 && cp <= 0xD7AF) ||   // 谚文音节
+        (cp >= 0x20000 && cp <= 0x2FA1F)) { // 汉字扩展B及以后
+        return CharClass::Cjk;
+    }
+    return CharClass::Separator;
+}
+
+void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+} // namespace
+
+std::vector<std::string> LexicalIndex::tokenize(std::string_view text) {
+    std::vector<std::string> tokens;
+    std::string word;                 // 正在累积的字母数字词
+    std::vector<std::string_view> run; // 正在累积的连续CJK字符 (指向原文)
+
+    auto flush_word = [&] {
+        if (!word.empty()) {
+            tokens.push_back(std::move(word));
+            word.clear();
+        }
+    };
+    auto flush_run = [&] {
+        if (run.size() == 1) {
+            tokens.emplace_back(run[0]);
+        }
+        for (size_t i = 0; i + 1 < run.size(); ++i) {
+            std::string bigram(run[i]);
+            bigram.append(run[i + 1]);
+            tokens.push_back(std::move(bigram));
+        }
+        run.clear();
+    };
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t start = pos;
+        uint32_t cp = fold(next_codepoint(text, pos));
+        switch (classify(cp)) {
+        case CharClass::Word:
+            flush_run();
+            append_utf8(word, cp);
+            break;
+        case CharClass::Cjk:
+            flush_word();
+            run.push_back(text.substr(start, pos - start));
+            break;
+        case CharClass::Separator:
+            flush_word();
+            flush_run();
+            break;
+        }
+    }
+    flush_word();
+    flush_run();
+    return tokens;
+}
+
+void LexicalIndex::add(std::string_view text) {
+    uint32_t doc = static_cast<uint32_t>(doc_lengths_.size());
+    std::vector<std::string> tokens = tokenize(text);
+
+    // 统计本文档内的词频，再追加到各自的倒排列表末尾 (文档编号递增，列表天然有序)
+    std::unordered_map<uint32_t, uint32_t> counts;
+    for (auto& token : tokens) {
+        auto it = term_ids_.find(token);
+        if (it == term_ids_.end()) {
+            it = term_ids_.emplace(std::move(token), static_cast<uint32_t>(postings_.size())).first;
+            postings_.emplace_back();
+        }
+        ++counts[it->second];
+    }
+    for (const auto& [term, tf] : counts) {
+        postings_[term].push_back({doc, tf});
+    }
+    doc_lengths_.push_back(static_cast<uint32_t>(tokens.size()));
+    total_length_ += tokens.size();
+}
+
+std::vector<ScoredIndex> LexicalIndex::search(std::string_view query, size_t k,
+                                              const std::function<bool(size_t)>& accept) const {
+    size_t docs = doc_lengths_.size();
+    if (docs == 0 || k == 0) {
+        return {};
+    }
+    std::vector<std::string> tokens = tokenize(query);
+    std::sort(tokens.begin(), tokens.end());
+    tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+
+    // 稠密累加数组按线程复用，只清理本次触及的文档
+    thread_local std::vector<float> scores;
+    thread_local std::vector<uint32_t> touched;
+    if (scores.size() < docs) scores.resize(docs, 0.0f);
+    touched.clear();
+
+    float average_length = static_cast<float>(total_length_) / static_cast<float>(docs);
+    for (const auto& token : tokens) {
+        auto it = term_ids_.find(token);
+        if (it == term_ids_.end()) continue;
+        const auto& list = postings_[it->second];
+        float n = static_cast<float>(list.size());
+        float idf = std::log(1.0f + (static_cast<float>(docs) - n + 0.5f) / (n + 0.5f));
+        for (const auto& posting : list) {
+            float tf = static_cast<float>(posting.tf);
+            float norm = params_.k1 * (1.0f - params_.b + params_.b * doc_lengths_[posting.doc] / average_length);
+            if (scores[posting.doc] == 0.0f) touched.push_back(posting.doc);
+            scores[posting.doc] += idf * tf * (params_.k1 + 1.0f) / (tf + norm);
+        }
+    }
+
+    TopK selector(k);
+    for (uint32_t doc : touched) {
+        if (scores[doc] > 0.0f && (!accept || accept(doc))) selector.push(scores[doc], doc);
+        scores[doc] = 0.0f;
+    }
+    return selector.take_sorted();
+}
+
+void LexicalIndex::clear() {
+    term_ids_.clear();
+    postings_.clear();
+    doc_lengths_.clear();
+    total_length_ = 0;
+}
@@ -1,112 +1,1863 @@
 #include "MemoryManager.hpp"
+#include "ConfigManager.hpp"
+#include "EmbeddingReducer.hpp"
 #include "Logger.hpp"
+#include "VectorMath.hpp"
+#include "ThreadPool.hpp"
+#include "TopK.hpp"
 #include <fstream>
-#include <cmath>
-#include <numeric>
+#include <filesystem>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/**
+ * @brief 旧版 memory.json 的流式 (SAX) 解析器。
+ * 文件是 [{"summary": "...", "embedding": [...]}, ...] 形式的数组；每解析完一个对象就立即交给回调，
+ * 不构建整棵 DOM，内存占用与单条记忆的大小相当，而不是整个文件的数倍。
+ */
+class LegacyMemorySax : public nlohmann::json_sax<nlohmann::json> {
+public:
+    using EntryFn = std::function<void(const std::string&, const std::vector<float>&)>;
+
+    explicit LegacyMemorySax(const EntryFn& on_entry) : on_entry_(on_entry) {}
+
+    const std::string& error() const { return error_; }
+
+    bool null() override { return scalar(); }
+    bool boolean(bool) override { return scalar(); }
+    bool number_integer(number_integer_t value) override { return number(static_cast<float>(value)); }
+    bool number_unsigned(number_unsigned_t value) override { return number(static_cast<float>(value)); }
+    bool number_float(number_float_t value, const string_t&) override { return number(static_cast<float>(value)); }
+    bool binary(binary_t&) override { return scalar(); }
+
+    bool string(string_t& value) override {
+        if (depth_ == 2 && field_ == Field::Summary) {
+            summary_ = std::move(value);
+        }
+        return scalar();
+    }
+
+    bool start_object(std::size_t) override {
+        if (depth_ == 0) return fail("顶层必须是数组");
+        if (depth_ == 1) {
+            summary_.clear();
+            embedding_.clear();
+        }
+        ++depth_;
+        field_ = Field::Other;
+        return true;
+    }
+
+    bool key(string_t& name) override {
+        if (depth_ == 2) {
+            field_ = name == "summary" ? Field::Summary : name == "embedding" ? Field::Embedding : Field::Other;
+        }
+        return true;
+    }
+
+    bool end_object() override {
+        --depth_;
+        if (depth_ == 1) {
+            on_entry_(summary_, embedding_);
+        }
+        field_ = Field::Other;
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        ++depth_;
+        return true;
+    }
+
+    bool end_array() override {
+        --depth_;
+        if (depth_ == 2) {
+            field_ = Field::Other;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& e) override {
+        return fail("第 " + std::to_string(position) + " 字节处: " + e.what());
+    }
+
+private:
+    enum class Field { Other, Summary, Embedding };
+
+    // 只有顶层数组中各对象的 "embedding" 数组 (深度3) 里的数值会被收集
+    bool number(float value) {
+        if (depth_ == 3 && field_ == Field::Embedding) {
+            embedding_.push_back(value);
+        }
+        return scalar();
+    }
+
+    bool scalar() {
+        if (depth_ == 0) return fail("顶层必须是数组");
+        return true;
+    }
+
+    bool fail(const std::string& message) {
+        error_ = message;
+        return false;
+    }
 
-// === 向量数学辅助函数 ===
-// 计算两个向量的点积
-float dot_product(const std::vector<float>& a, const std::vector<float>& b) {
-    return std::inner_product(a.begin(), a.end(), b.begin(), 0.0f);
+    const EntryFn& on_entry_;
+    int depth_ = 0;
+    Field field_ = Field::Other;
+    std::string summary_;
+    std::vector<float> embedding_;
+    std::string error_;
+};
+
+MemoryMetadata::Weights read_score_weights(ConfigManager& config) {
+    MemoryMetadata::Weights weights;
+    weights.recency = std::stof(config.get("Database", "RECENCY_WEIGHT", "0.1"));
+    weights.importance = std::stof(config.get("Database", "IMPORTANCE_WEIGHT", "0.1"));
+    weights.half_life_hours = std::max(std::stof(config.get("Database", "RECENCY_HALF_LIFE_HOURS", "168")), 0.01f);
+    return weights;
 }
 
-// 计算向量的模长 (L2范数)
-float magnitude(const std::vector<float>& v) {
-    float sum_sq = 0.0f;
-    for (float x : v) {
-        sum_sq += x * x;
+// 按 [API_EMBEDDING] 节创建降维方式；PCA投影文件缺失或与当前配置不符时抛出 std::runtime_error
+std::unique_ptr<EmbeddingReducer> read_reducer(ConfigManager& config, size_t embedding_dimension) {
+    auto mode = EmbeddingReducer::parseMode(config.get("API_EMBEDDING", "EMBEDDING_REDUCTION", "none"));
+    size_t reduced = std::stoul(config.get("API_EMBEDDING", "EMBEDDING_REDUCED_DIMENSION", "256"));
+    if (mode != EmbeddingReducer::Mode::Pca) {
+        return std::make_unique<EmbeddingReducer>(mode, embedding_dimension, reduced);
+    }
+    std::string path = config.get("API_EMBEDDING", "EMBEDDING_PCA_PATH", "memory.pca");
+    if (!fs::exists(path)) {
+        throw std::runtime_error("未找到PCA投影文件 " + path + "，请先运行 backend_server --train-pca。");
+    }
+    auto reducer = EmbeddingReducer::loadPca(path);
+    if (reducer->inputDimension() != embedding_dimension || reducer->outputDimension() != reduced) {
+        throw std::runtime_error("PCA投影文件 " + path + " 为 " + std::to_string(reducer->inputDimension()) + " → "
+                                 + std::to_string(reducer->outputDimension()) + " 维，与 EMBEDDING_VECTOR_DIMENSION / "
+                                 "EMBEDDING_REDUCED_DIMENSION 不符，请重新运行 backend_server --train-pca。");
     }
-    return std::sqrt(sum_sq);
+    return reducer;
 }
 
-// 计算两个向量的余弦相似度
-float cosine_similarity(const std::vector<float>& a, const std::vector<float>& b) {
-    if (a.empty() || b.empty() || a.size() != b.size()) {
-        return 0.0f;
+// 每次为多少行计算附加得分后再扫描这些行的向量 (附加得分缓冲留在L1中)
+constexpr size_t kScoreBlockRows = 1024;
+
+// 过滤后的行表不超过总行数的 1/kSparseSelectionRatio 时，逐行精确打分比扫描全库或遍历图更省
+constexpr size_t kSparseSelectionRatio = 16;
+
+// 入库去重时检查的最相似记忆数 (其中可能有会话或角色为空、与新记忆不属于同一范围的行)
+constexpr size_t kDuplicateCandidates = 4;
+
+// 批量检索时每一片矩阵的字节数：一片与各组查询依次计算期间始终留在L2中
+constexpr size_t kBatchTileBytes = 256 * 1024;
+
+} // namespace
+
+MemoryManager::Replica::Replica(size_t dimension, size_t full_dimension, QuantizedVectors::Mode mode,
+                                const MemoryMetadata::Weights& weights)
+    : vectors(dimension),
+      full_vectors(full_dimension),
+      quantized(mode, dimension),
+      metadata(weights),
+      cold_vectors(dimension),
+      cold_full_vectors(full_dimension),
+      cold_metadata(weights) {}
+
+std::string_view MemoryManager::Replica::summary(size_t index) const {
+    if (index < store.count()) {
+        return store.summary(index);
     }
-    float mag_a = magnitude(a);
-    float mag_b = magnitude(b);
-    if (mag_a == 0.0f || mag_b == 0.0f) {
-        return 0.0f;
+    return tail_summaries[index - store.count()];
+}
+
+std::string_view MemoryManager::Replica::hit_summary(size_t index) const {
+    return (index & kColdRow) ? cold_store.summary(index & ~kColdRow) : summary(index);
+}
+
+MemoryManager::ReadSnapshot::ReadSnapshot(const MemoryManager& owner) : owner_(owner) {
+    // 先登记再确认公开副本没有切换：写入方先切换再检查登记数，两边至少有一方能看到对方的修改，
+    // 因此要么写入方等待本次登记撤销，要么这里发现已经切换而改为登记新副本
+    while (true) {
+        slot_ = owner_.active_.load();
+        owner_.readers_[slot_].count.fetch_add(1);
+        if (owner_.active_.load() == slot_) break;
+        owner_.readers_[slot_].count.fetch_sub(1);
     }
-    return dot_product(a, b) / (mag_a * mag_b);
+    replica_ = owner_.replicas_[slot_].get();
+}
+
+MemoryManager::ReadSnapshot::~ReadSnapshot() {
+    owner_.readers_[slot_].count.fetch_sub(1);
 }
-// =========================
 
-MemoryManager::MemoryManager(const std::string& memory_file_path) : file_path_(memory_file_path) {
-    std::ifstream file(file_path_);
-    if (file.is_open()) {
-        // 如果文件存在且不为空，则加载
-        file >> memory_db_;
-        Logger::logInfo("已从 " + file_path_ + " 加载 " + std::to_string(memory_db_.size()) + " 条记忆。");
+MemoryManager::MemoryManager(ConfigManager& config)
+    : legacy_json_path_(config.get("Database", "MEMORY_DB_PATH", "memory.json")),
+      store_path_(config.get("Database", "MEMORY_STORE_PATH", "memory.bin")),
+      embedding_dimension_(std::stoul(config.get("API_EMBEDDING", "EMBEDDING_VECTOR_DIMENSION", "1024"))),
+      reducer_(read_reducer(config, embedding_dimension_)),
+      dimension_(reducer_->outputDimension()),
+      rerank_candidates_(std::stoul(config.get("Database", "RERANK_CANDIDATES", "64"))),
+      fusion_candidates_(std::stoul(config.get("Database", "FUSION_CANDIDATES", "50"))),
+      rrf_k_(std::stof(config.get("Database", "RRF_K", "60"))),
+      dedup_threshold_(std::stof(config.get("Database", "DEDUP_THRESHOLD", "0.97"))),
+      capacity_(std::stoul(config.get("Database", "MAX_MEMORIES", "0"))),
+      cold_path_(config.get("Database", "COLD_STORE_PATH", "memory_cold.bin")),
+      cold_threshold_(std::stof(config.get("Database", "COLD_SEARCH_THRESHOLD", "0.5"))),
+      parallel_scan_min_rows_(std::stoul(config.get("Database", "PARALLEL_SCAN_MIN_ROWS", "20000")))
+{
+    const MemoryMetadata::Weights weights = read_score_weights(config);
+    const QuantizedVectors::Mode quantization =
+        QuantizedVectors::parseMode(config.get("Database", "VECTOR_QUANTIZATION", "none"));
+    for (auto& replica : replicas_) {
+        replica = std::make_unique<Replica>(dimension_, embedding_dimension_, quantization, weights);
+    }
+    std::string keep_full = config.get("API_EMBEDDING", "KEEP_FULL_VECTORS", "true");
+    std::transform(keep_full.begin(), keep_full.end(), keep_full.begin(), [](unsigned char c){ return std::tolower(c); });
+    keep_full_vectors_ = reducer_->enabled() && keep_full == "true";
+
+    std::string mode = config.get("Database", "RETRIEVAL_MODE", "hybrid");
+    std::transform(mode.begin(), mode.end(), mode.begin(), [](unsigned char c){ return std::tolower(c); });
+    retrieval_mode_ = mode == "vector" ? RetrievalMode::Vector : mode == "lexical" ? RetrievalMode::Lexical
+                                                                                   : RetrievalMode::Hybrid;
+    lexical_enabled_ = retrieval_mode_ != RetrievalMode::Vector;
+    std::string policy = config.get("Database", "EVICTION_POLICY", "lru");
+    std::transform(policy.begin(), policy.end(), policy.begin(), [](unsigned char c){ return std::tolower(c); });
+    eviction_policy_ = policy == "importance" ? EvictionPolicy::Importance : EvictionPolicy::Lru;
+
+    // 构造期间没有检索，两份副本经由 publish 同步构建，与之后的每次修改走同一条路径
+    Logger::logInfo(std::string("向量点积内核: ") + VectorMath::kernelName());
+    if (reducer_->enabled()) {
+        Logger::logInfo(std::string("向量降维: ") + EmbeddingReducer::modeName(reducer_->mode()) + "，"
+                        + std::to_string(embedding_dimension_) + " → " + std::to_string(dimension_) + " 维"
+                        + (reducer_->mode() == EmbeddingReducer::Mode::Pca
+                               ? " (保留训练集二阶矩的 " + std::to_string(reducer_->retainedEnergy() * 100.0f) + "%)"
+                               : std::string())
+                        + (keep_full_vectors_ ? "，同时保存原始向量用于重排。" : "，不保存原始向量。"));
+    }
+    if (fs::exists(store_path_)) {
+        convert_store(store_path_);
+        publish([this](Replica& replica) { open_store(replica); });
+        load_pending();
+    } else if (fs::exists(legacy_json_path_)) {
+        // 旧版部署：把 memory.json 一次性转换为二进制记忆库，之后只读写新文件
+        Logger::logInfo("未找到记忆库文件 " + store_path_ + "，正在从旧版 " + legacy_json_path_ + " 导入...");
+        importLegacyJson(legacy_json_path_, store_path_, embedding_dimension_);
+        convert_store(store_path_);
+        publish([this](Replica& replica) { open_store(replica); });
+        load_pending();
+        Logger::logInfo("导入完成，旧文件 " + legacy_json_path_ + " 已不再使用，可以自行备份或删除。");
     } else {
-        // 如果文件不存在，初始化一个空的JSON数组
-        memory_db_ = nlohmann::json::array();
         Logger::logInfo("未找到记忆文件，已初始化新的记忆库。");
     }
+    if (fs::exists(cold_path_)) {
+        convert_store(cold_path_);
+    }
+    publish([this](Replica& replica) { open_cold_store(replica); });
+
+    // 倒排索引不落盘，启动时由摘要重建；WAL回放的记忆在 append_row 中加入
+    if (lexical_enabled_) {
+        publish([](Replica& replica) {
+            for (size_t i = 0; i < replica.rows(); ++i) {
+                replica.lexical.add(replica.summary(i));
+            }
+        });
+        Logger::logInfo("字面倒排索引已构建: " + std::to_string(current().lexical.size()) + " 条记忆, "
+                        + std::to_string(current().lexical.termCount()) + " 个词。");
+    }
+
+    // 回放上次运行中已写入WAL、但还没来得及合并进记忆库文件的记忆
+    wal_ = std::make_unique<WriteAheadLog>(
+        config.get("Database", "MEMORY_WAL_PATH", "memory.wal"),
+        WriteAheadLog::parsePolicy(config.get("Database", "WAL_FSYNC", "interval")),
+        static_cast<unsigned>(std::stoul(config.get("Database", "WAL_FSYNC_INTERVAL_MS", "1000"))));
+    wal_->replay(current().store.walCheckpoint(), [this](uint64_t, const std::string& summary,
+                                                         const std::vector<float>& embedding, const std::string& extra) {
+        // 早期版本的记录没有属性，解码为默认值，创建时间在 insert_entry 中补上
+        auto attributes = MemoryMetadata::Attributes::decode(extra);
+        insert_entry(summary, embedding.data(), embedding.size(), attributes);
+    });
+    if (!pending_.empty()) {
+        Logger::logInfo("有 " + std::to_string(pending_.size()) + " 条记忆的向量无效，不参与检索，等待重新生成embedding。");
+    }
+    compact_threshold_bytes_ = std::stoull(config.get("Database", "WAL_COMPACT_MB", "16")) * 1024 * 1024;
+
+    const QuantizedVectors& quantized = current().quantized;
+    if (quantized.enabled()) {
+        Logger::logInfo(std::string("向量量化模式: ") + QuantizedVectors::modeName(quantized.mode())
+                        + "，每行 " + std::to_string(quantized.bytesPerRow()) + " 字节 (float32 为 "
+                        + std::to_string(dimension_ * sizeof(float)) + " 字节)，重排候选数: "
+                        + std::to_string(rerank_candidates_));
+    }
+    if (current().metadata.scoring()) {
+        const auto& score_weights = current().metadata.weights();
+        Logger::logInfo("检索得分叠加时间衰减 (权重 " + std::to_string(score_weights.recency) + "，半衰期 "
+                        + std::to_string(score_weights.half_life_hours) + " 小时) 与重要度 (权重 "
+                        + std::to_string(score_weights.importance) + ")。");
+    }
+
+    // 暴力扫描的线程池：SCAN_THREADS 为参与一次扫描的线程总数 (含请求线程本身)，0 表示按CPU核数
+    size_t scan_threads = std::stoul(config.get("Database", "SCAN_THREADS", "0"));
+    if (scan_threads == 0) {
+        scan_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (scan_threads > 1) {
+        scan_pool_ = std::make_unique<ThreadPool>(scan_threads - 1);
+        Logger::logInfo("暴力扫描在 " + std::to_string(parallel_scan_min_rows_) + " 条记忆以上时由 "
+                        + std::to_string(scan_threads) + " 个线程并行执行。");
+    }
+
+    std::string index_type = config.get("Database", "VECTOR_INDEX", "flat");
+    std::transform(index_type.begin(), index_type.end(), index_type.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    if (index_type == "hnsw") {
+        hnsw_params_.M = std::stoul(config.get("Database", "HNSW_M", "16"));
+        hnsw_params_.ef_construction = std::stoul(config.get("Database", "HNSW_EF_CONSTRUCTION", "200"));
+        hnsw_params_.ef_search = std::stoul(config.get("Database", "HNSW_EF_SEARCH", "64"));
+        publish([this](Replica& replica) { build_hnsw(replica); });
+        Logger::logInfo("HNSW索引已构建: " + std::to_string(current().hnsw->size()) + " 个节点 (M="
+                        + std::to_string(hnsw_params_.M) + ", ef_search=" + std::to_string(hnsw_params_.ef_search)
+                        + ")。");
+    } else if (index_type == "ivfpq") {
+        ivfpq_path_ = config.get("Database", "IVFPQ_INDEX_PATH", "memory.ivfpq");
+        ivfpq_nprobe_ = std::stoul(config.get("Database", "IVFPQ_NPROBE", "16"));
+        publish([this](Replica& replica) { open_ivfpq(replica); });
+    }
+
+    if (capacity_ > 0) {
+        Logger::logInfo("记忆库容量上限 " + std::to_string(capacity_) + " 条，超出时按"
+                        + (eviction_policy_ == EvictionPolicy::Lru ? "最久未被检索" : "重要度最低") + "淘汰到冷层 "
+                        + cold_path_ + "。");
+        // 启动时已经超出上限 (例如刚调低了 MAX_MEMORIES)：让后台线程立即淘汰一次
+        compact_requested_ = current().rows() > capacity_;
+    }
+
+    compactor_ = std::thread(&MemoryManager::compactor_loop, this);
 }
 
 MemoryManager::~MemoryManager() {
-    save_memories_to_file();
+    {
+        std::lock_guard<std::mutex> lock(compactor_mutex_);
+        stopping_ = true;
+    }
+    compactor_cv_.notify_all();
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+    // 退出前做最后一次合并，下次启动时无需回放WAL
+    try {
+        compact();
+    } catch (const std::exception& e) {
+        Logger::logError("合并记忆库失败: " + std::string(e.what()) + " (记忆仍保存在WAL中)");
+    }
+}
+
+void MemoryManager::publish(const std::function<void(Replica&)>& apply) {
+    std::vector<Touch> touches;
+    {
+        std::lock_guard<std::mutex> lock(touch_mutex_);
+        touches.swap(touches_);
+    }
+    size_t old = active_.load();
+    if (poisoned_[1 - old]) {
+        resync(1 - old); // 仍然失败时异常直接交给调用方，公开副本不受影响
+    }
+    Replica& next = *replicas_[1 - old];
+    try {
+        apply(next);
+        afterApply(false);
+        apply_touches(next, touches);
+    } catch (...) {
+        // 修改没有公开：把后台副本恢复成公开副本的样子，命中记录放回队列，再把异常交给调用方
+        poisoned_[1 - old] = true;
+        {
+            std::lock_guard<std::mutex> lock(touch_mutex_);
+            touches_.insert(touches_.begin(), touches.begin(), touches.end());
+        }
+        try {
+            resync(1 - old);
+        } catch (const std::exception& e) {
+            Logger::logError("恢复后台副本失败: " + std::string(e.what()) + "，下次修改前重试。");
+        }
+        throw;
+    }
+    active_.store(1 - old);
+
+    // 宽限期：等待仍在读旧副本的检索结束 (新的检索只会登记到新副本)，之后旧副本只属于写入方
+    while (readers_[old].count.load() != 0) {
+        std::this_thread::yield();
+    }
+    Replica& previous = *replicas_[old];
+    replaying_ = true;
+    try {
+        apply(previous);
+        afterApply(true);
+        apply_touches(previous, touches);
+        replaying_ = false;
+    } catch (const std::exception& e) {
+        // 修改已经公开，不再向调用方报告失败；旧副本改为从公开副本重建
+        replaying_ = false;
+        poisoned_[old] = true;
+        Logger::logError("对第二份副本重放修改失败: " + std::string(e.what()) + "，正在从公开副本重建。");
+        try {
+            resync(old);
+        } catch (const std::exception& again) {
+            Logger::logError("重建副本失败: " + std::string(again.what()) + "，下次修改前重试。");
+        }
+    }
+    if (!touches.empty()) {
+        persist_touches(touches);
+    }
+}
+
+void MemoryManager::resync(size_t slot) {
+    // 另一份副本是公开副本，检索只读它；这一份没有检索登记，可以整个替换
+    const Replica& source = *replicas_[1 - slot];
+    auto fresh = std::make_unique<Replica>(dimension_, embedding_dimension_, source.quantized.mode(),
+                                           source.metadata.weights());
+    Replica& target = *fresh;
+    // 重建期间的映射、量化与索引加载都不输出日志 (与重放相同)
+    replaying_ = true;
+    try {
+        copy_replica(source, target);
+    } catch (...) {
+        replaying_ = false;
+        throw;
+    }
+    replaying_ = false;
+    replicas_[slot] = std::move(fresh);
+    poisoned_[slot] = false;
+    Logger::logInfo("已从公开副本重建另一份副本 (" + std::to_string(source.rows()) + " 条记忆)。");
+}
+
+void MemoryManager::copy_replica(const Replica& source, Replica& target) {
+    // 映射公开副本正在使用的文件本身 (合并失败时路径上可能已是新文件)
+    target.store.share(source.store);
+    if (target.store.isOpen()) {
+        attach_store(target);
+    }
+    target.cold_store.share(source.cold_store);
+    if (target.cold_store.isOpen()) {
+        attach_cold_store(target);
+    }
+    // 文件之外的状态：尚未合并的行、内存中更新过的访问记录与合并次数、被整合的行
+    for (size_t i = target.rows(); i < source.rows(); ++i) {
+        if (has_full_vectors(source)) {
+            target.full_vectors.append(source.full_vectors.row(i));
+        }
+        target.vectors.append(source.row(i));
+        target.quantized.append(source.row(i));
+        target.metadata.appendFrom(source.metadata, i);
+        target.tail_summaries.emplace_back(source.summary(i));
+    }
+    for (size_t i = 0; i < source.rows(); ++i) {
+        MemoryMetadata::Row row = source.metadata.row(i);
+        target.metadata.setAccess(i, row.last_access, row.access_count);
+        target.metadata.setMergeCount(i, row.merge_count);
+        if (source.metadata.retired(i)) {
+            target.metadata.retire(i);
+        }
+    }
+    for (size_t i = 0; i < source.cold_metadata.size(); ++i) {
+        MemoryMetadata::Row row = source.cold_metadata.row(i);
+        target.cold_metadata.setAccess(i, row.last_access, row.access_count);
+    }
+    target.generation = source.generation;
+
+    // 索引按公开副本的配置重建；IVF-PQ 沿用索引文件中的码本，文件之后的行在 open_ivfpq 中补编码
+    if (lexical_enabled_) {
+        for (size_t i = 0; i < target.rows(); ++i) {
+            target.lexical.add(target.summary(i));
+        }
+    }
+    if (source.hnsw) {
+        build_hnsw(target);
+    }
+    if (source.ivfpq) {
+        open_ivfpq(target);
+    }
+}
+
+void MemoryManager::persist_touches(const std::vector<Touch>& touches) {
+    const Replica& replica = current();
+    std::vector<size_t> hot;
+    std::vector<size_t> cold;
+    for (const auto& touch : touches) {
+        if (touch.generation != replica.generation) continue;
+        if (touch.index & kColdRow) {
+            cold.push_back(touch.index & ~kColdRow);
+        } else if (touch.index < replica.store.count()) {
+            // 尚未合并进文件的行不必改写：下次合并会连同它们的访问记录一起写入
+            hot.push_back(touch.index);
+        }
+    }
+    // 访问时间与次数是定长列，直接改写文件中对应的元素
+    auto write_back = [](const MemoryStoreFile& store, const MemoryMetadata& metadata, std::vector<size_t>& rows) {
+        if (rows.empty()) return true;
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+        std::vector<int64_t> last_access(rows.size());
+        std::vector<uint32_t> access_count(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            MemoryMetadata::Row row = metadata.row(rows[i]);
+            last_access[i] = row.last_access;
+            access_count[i] = row.access_count;
+        }
+        return store.patch(MemoryStoreFile::LastAccess, sizeof(int64_t), rows, last_access.data())
+               && store.patch(MemoryStoreFile::AccessCount, sizeof(uint32_t), rows, access_count.data());
+    };
+    if (!write_back(replica.store, replica.metadata, hot)) {
+        store_stale_ = true; // 无法原地改写时，访问记录随下次合并写回文件
+    }
+    // 冷层改写失败时，访问记录在下次淘汰重写冷层时写回
+    write_back(replica.cold_store, replica.cold_metadata, cold);
+}
+
+void MemoryManager::apply_touches(Replica& replica, const std::vector<Touch>& touches) const {
+    for (const auto& touch : touches) {
+        if (touch.generation != replica.generation) continue;
+        if (touch.index & kColdRow) {
+            replica.cold_metadata.touch(touch.index & ~kColdRow, touch.when);
+        } else {
+            replica.metadata.touch(touch.index, touch.when);
+        }
+    }
+}
+
+void MemoryManager::record_touches(std::vector<Touch> touches) {
+    if (touches.empty()) {
+        return;
+    }
+    bool first = false;
+    {
+        std::lock_guard<std::mutex> lock(touch_mutex_);
+        first = touches_.empty();
+        touches_.insert(touches_.end(), touches.begin(), touches.end());
+    }
+    // 队列从空变为非空时唤醒后台线程去应用；检索线程自己不等待任何写入方或宽限期
+    if (first) {
+        std::lock_guard<std::mutex> lock(compactor_mutex_);
+        touches_requested_ = true;
+        compactor_cv_.notify_one();
+    }
+}
+
+void MemoryManager::attach_full_vectors(const MemoryStoreFile& store, MappedColumn<float>& column,
+                                        const std::string& path) const {
+    column.clear();
+    if (!keep_full_vectors_ || store.count() == 0) {
+        return;
+    }
+    size_t size = 0;
+    const void* data = store.section(MemoryStoreFile::FullVectors, &size);
+    if (data && size == store.count() * embedding_dimension_ * sizeof(float)) {
+        column.attach(static_cast<const float*>(data), store.count());
+    } else if (!replaying_) {
+        Logger::logInfo("记忆库 " + path + " 中没有原始向量，检索时不做全精度重排。");
+    }
+}
+
+void MemoryManager::convert_store(const std::string& path) const {
+    MemoryStoreFile store;
+    store.open(path);
+    if (reducer_->matches(store)) {
+        return;
+    }
+    // 原始向量优先取文件中保存的那一份 (由其他降维方式写出)，未降维的文件直接使用其向量
+    const size_t count = store.count();
+    size_t size = 0;
+    const float* source = static_cast<const float*>(store.section(MemoryStoreFile::FullVectors, &size));
+    if (!source || size != count * embedding_dimension_ * sizeof(float)) {
+        if (store.dimension() != embedding_dimension_) {
+            throw std::runtime_error("记忆库 " + path + " 的向量维度 (" + std::to_string(store.dimension())
+                                     + ") 与当前配置不一致，且文件中没有可用于重新投影的原始向量；"
+                                       "请确认embedding模型与 EMBEDDING_REDUCTION 配置。");
+        }
+        source = store.vectors();
+    }
+    auto start = std::chrono::steady_clock::now();
+    MappedColumn<float> full(embedding_dimension_);
+    full.attach(source, count);
+    std::vector<PendingEntry> pending;
+    read_pending(store, path, pending);
+    MemoryMetadata metadata(current().metadata.weights());
+    const bool has_metadata = metadata.attach(store);
+    // 投影后的矩阵与原文件行号一致，无效行留空并由 keep 排除
+    MappedColumn<float> projected(dimension_);
+    projected.reserve_tail(count);
+    std::vector<uint32_t> keep;
+    keep.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        float* row = projected.append_row();
+        reducer_->reduce(full.row(i), row);
+        if (!isValidEmbedding(full.row(i), embedding_dimension_, embedding_dimension_)
+            || !isValidEmbedding(row, dimension_, dimension_)) {
+            // 无法投影的行 (例如旧文件中的零向量) 挪到待处理队列，等待重新计算embedding
+            pending.push_back({std::string(store.summary(i)),
+                               has_metadata ? metadata.attributes(i) : MemoryMetadata::Attributes{}});
+            continue;
+        }
+        VectorMath::normalize(row, dimension_);
+        keep.push_back(static_cast<uint32_t>(i));
+    }
+    write_store(path, dimension_, projected, count, [&store](size_t i) { return store.summary(i); }, nullptr,
+                has_metadata ? &metadata : nullptr, pending, store.walCheckpoint(), reducer_.get(),
+                keep_full_vectors_ ? &full : nullptr, keep.size() == count ? nullptr : &keep);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    Logger::logInfo("已将记忆库 " + path + " 的 " + std::to_string(keep.size()) + " 条记忆重新投影为 "
+                    + std::to_string(dimension_) + " 维 (" + EmbeddingReducer::modeName(reducer_->mode()) + ")"
+                    + (keep.size() == count ? std::string() : "，" + std::to_string(count - keep.size())
+                                                                   + " 条无效向量移入待处理队列")
+                    + "，耗时 " + std::to_string(static_cast<long>(ms)) + " ms。");
+}
+
+void MemoryManager::open_store(Replica& replica) {
+    replica.store.open(store_path_);
+    attach_store(replica);
+}
+
+void MemoryManager::attach_store(Replica& replica) {
+    if (!reducer_->matches(replica.store)) {
+        size_t file_dimension = replica.store.dimension();
+        replica.store.close();
+        throw std::runtime_error("记忆库 " + store_path_ + " 的向量维度 (" + std::to_string(file_dimension)
+                                 + ") 或降维方式与当前配置 (" + std::to_string(dimension_)
+                                 + " 维) 不一致，请确认embedding模型与 EMBEDDING_REDUCTION 配置。");
+    }
+    replica.vectors.attach(replica.store.vectors(), replica.store.count());
+    replica.tail_summaries.clear();
+    attach_full_vectors(replica.store, replica.full_vectors, store_path_);
+
+    if (replica.quantized.enabled() && !replica.quantized.attach(replica.store)) {
+        // 文件中没有当前模式的编码 (例如刚切换了量化模式)，重新量化一次并在下次合并时写入文件
+        for (size_t i = 0; i < replica.rows(); ++i) {
+            replica.quantized.append(replica.row(i));
+        }
+        store_stale_ = true;
+        if (!replaying_) {
+            Logger::logInfo("记忆库中没有 " + std::string(QuantizedVectors::modeName(replica.quantized.mode()))
+                            + " 编码，已重新量化 " + std::to_string(replica.rows()) + " 条记忆。");
+        }
+    }
+    if (!replica.metadata.attach(replica.store)) {
+        // 旧版本写出的记忆库没有元数据：创建时间按现在计，重要度取默认值
+        MemoryMetadata::Attributes defaults;
+        defaults.created = MemoryMetadata::now();
+        for (size_t i = 0; i < replica.rows(); ++i) {
+            replica.metadata.append(defaults);
+        }
+        store_stale_ = true;
+    }
+    if (!replaying_) {
+        Logger::logInfo("已映射记忆库 " + store_path_ + "，共 " + std::to_string(replica.store.count()) + " 条记忆。");
+    }
+}
+
+void MemoryManager::open_ivfpq(Replica& replica) {
+    replica.ivfpq.reset();
+    if (!fs::exists(ivfpq_path_)) {
+        if (!replaying_) {
+            Logger::logError("未找到IVF-PQ索引文件 " + ivfpq_path_
+                             + "，请先运行 backend_server --train-ivfpq；暂时使用暴力扫描。");
+        }
+        return;
+    }
+    try {
+        auto start = std::chrono::steady_clock::now();
+        auto index = IVFPQIndex::load(ivfpq_path_);
+        if (index->dimension() != dimension_ || index->size() > replica.rows()) {
+            throw std::runtime_error("索引为 " + std::to_string(index->dimension()) + " 维 "
+                                     + std::to_string(index->size()) + " 条，记忆库为 " + std::to_string(dimension_)
+                                     + " 维 " + std::to_string(replica.rows()) + " 条，需要重新训练");
+        }
+        ivfpq_saved_rows_ = index->size();
+        // 训练之后新增的记忆 (包括刚回放的WAL记录) 用现有码本编码，下次合并时写回索引文件
+        for (size_t i = index->size(); i < replica.rows(); ++i) {
+            index->add(i, replica.row(i));
+        }
+        replica.ivfpq = std::move(index);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!replaying_) {
+            Logger::logInfo("IVF-PQ索引已加载: " + std::to_string(replica.ivfpq->size()) + " 条记忆 (nlist="
+                            + std::to_string(replica.ivfpq->nlist()) + ", m="
+                            + std::to_string(replica.ivfpq->subquantizers()) + ", nprobe="
+                            + std::to_string(ivfpq_nprobe_) + ")，其中 "
+                            + std::to_string(replica.ivfpq->size() - ivfpq_saved_rows_) + " 条为启动时补编码，耗时 "
+                            + std::to_string(static_cast<long>(ms)) + " ms。");
+        }
+    } catch (const std::exception& e) {
+        if (!replaying_) {
+            Logger::logError("无法使用IVF-PQ索引 " + ivfpq_path_ + ": " + e.what()
+                             + "。请重新运行 backend_server --train-ivfpq；暂时使用暴力扫描。");
+        }
+    }
+}
+
+bool MemoryManager::read_pending(const MemoryStoreFile& store, const std::string& path,
+                                 std::vector<PendingEntry>& out) {
+    size_t size = 0;
+    const char* data = static_cast<const char*>(store.section(MemoryStoreFile::PendingSummaries, &size));
+    if (!data) {
+        return false;
+    }
+    // 每条为 [u32 字节数][内容]；返回的 string_view 指向映射的文件
+    auto read_entries = [&](const char* entries, size_t entries_size, const char* what) {
+        std::vector<std::string_view> result;
+        for (size_t offset = 0; entries_size - offset >= sizeof(uint32_t);) {
+            uint32_t length;
+            std::memcpy(&length, entries + offset, sizeof(length));
+            offset += sizeof(length);
+            if (length > entries_size - offset) {
+                Logger::logError("记忆库 " + path + " 的" + what + "分段已损坏，已忽略剩余部分。");
+                break;
+            }
+            result.emplace_back(entries + offset, length);
+            offset += length;
+        }
+        return result;
+    };
+    auto summaries = read_entries(data, size, "待处理队列");
+    // 较早的文件没有属性分段，此时属性取默认值 (重新入库时以当前时间为创建时间)
+    size_t attributes_size = 0;
+    const char* attributes_data =
+        static_cast<const char*>(store.section(MemoryStoreFile::PendingAttributes, &attributes_size));
+    std::vector<std::string_view> attributes;
+    if (attributes_data) {
+        attributes = read_entries(attributes_data, attributes_size, "待处理属性");
+    }
+    out.clear();
+    for (size_t i = 0; i < summaries.size(); ++i) {
+        out.push_back({std::string(summaries[i]), i < attributes.size()
+                                                      ? MemoryMetadata::Attributes::decode(attributes[i])
+                                                      : MemoryMetadata::Attributes{}});
+    }
+    return true;
+}
+
+void MemoryManager::load_pending() {
+    const Replica& replica = current();
+    if (read_pending(replica.store, store_path_, pending_)) {
+        return;
+    }
+
+    // 旧版本写出的记忆库：向量未经校验，可能混有embedding失败时存下的零向量。
+    // 一次性把它们挪到待处理队列，并重写文件去掉这些行 (之后的文件都带有该分段，不会再次扫描)
+    MappedColumn<float> valid(dimension_);
+    std::vector<std::string> summaries;
+    for (size_t i = 0; i < replica.store.count(); ++i) {
+        if (isValidEmbedding(replica.row(i), dimension_, dimension_)) {
+            std::copy(replica.row(i), replica.row(i) + dimension_, valid.append_row());
+            summaries.emplace_back(replica.summary(i));
+        } else {
+            pending_.push_back({std::string(replica.summary(i)), replica.metadata.attributes(i)});
+        }
+    }
+    if (pending_.empty()) {
+        store_stale_ = true; // 下次合并时补写 (空的) 待处理分段
+        return;
+    }
+    write_store(store_path_, dimension_, valid, summaries.size(),
+                [&](size_t i) { return std::string_view(summaries[i]); }, nullptr, nullptr, pending_,
+                replica.store.walCheckpoint(), reducer_.get(), nullptr);
+    Logger::logInfo("已从记忆库中移出 " + std::to_string(pending_.size()) + " 条零向量或无效向量。");
+    publish([this](Replica& target) { open_store(target); });
+}
+
+void MemoryManager::compactor_loop() {
+    std::unique_lock<std::mutex> lock(compactor_mutex_);
+    while (true) {
+        compactor_cv_.wait(lock, [this] { return stopping_ || compact_requested_ || touches_requested_; });
+        if (stopping_) {
+            return;
+        }
+        bool compact_due = compact_requested_;
+        compact_requested_ = false;
+        touches_requested_ = false;
+        lock.unlock();
+        try {
+            if (compact_due) {
+                compact(); // 合并时一并应用排队的命中记录
+            } else {
+                std::lock_guard<std::mutex> write_lock(write_mutex_);
+                publish([](Replica&) {});
+            }
+        } catch (const std::exception& e) {
+            Logger::logError("后台合并记忆库失败: " + std::string(e.what()) + " (记忆仍保存在WAL中)");
+        }
+        lock.lock();
+    }
+}
+
+void MemoryManager::compact() {
+    // 合并全程持有 write_mutex_：新增记忆等待合并完成，检索始终读取公开副本，不受影响
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    // 排队的命中记录先应用到副本，随本次合并写回文件
+    bool touches_queued = false;
+    {
+        std::lock_guard<std::mutex> touch_lock(touch_mutex_);
+        touches_queued = !touches_.empty();
+    }
+    if (touches_queued) {
+        publish([](Replica&) {});
+    }
+
+    // 第一阶段：把公开副本的所有行写成新文件 (写入方持有锁期间公开副本不会改变)
+    const Replica& replica = current();
+    size_t merged = replica.rows();
+    uint64_t checkpoint = wal_ ? wal_->lastSeq() : 0;
+    // 已被整合的行在本次合并中移除；超出容量上限时同时淘汰。两种情况下热层的行号都会整体改变
+    const size_t retired = replica.metadata.retiredCount();
+    const size_t live = merged - retired;
+    const bool evicting = capacity_ > 0 && live > capacity_;
+    const bool renumbering = evicting || retired > 0;
+    // 索引文件只在有新编码的行时重写 (记忆库本身可能无需重写，例如索引训练得比记忆库旧)；
+    // 写失败不影响记忆库，这些行下次启动时重新编码。行号改变时索引在第二阶段按新行号重建后再写
+    bool ivfpq_saved = false;
+    if (!renumbering && replica.ivfpq && replica.ivfpq->size() != ivfpq_saved_rows_) {
+        try {
+            replica.ivfpq->save(ivfpq_path_);
+            ivfpq_saved_rows_ = replica.ivfpq->size();
+            ivfpq_saved = true;
+        } catch (const std::exception& e) {
+            Logger::logError("写入IVF-PQ索引失败: " + std::string(e.what()));
+        }
+    }
+    if (merged == replica.store.count() && checkpoint == replica.store.walCheckpoint() && !store_stale_
+        && !renumbering) {
+        return;
+    }
+    std::vector<uint32_t> survivors;
+    size_t evicted = 0;
+    if (renumbering) {
+        survivors.reserve(live);
+        for (size_t i = 0; i < merged; ++i) {
+            if (!replica.is_retired(i)) survivors.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    if (evicting) {
+        std::vector<uint32_t> candidates = std::move(survivors);
+        survivors = select_survivors(replica, candidates, capacity_ - capacity_ / 10);
+        std::vector<uint32_t> victims;
+        victims.reserve(candidates.size() - survivors.size());
+        std::set_difference(candidates.begin(), candidates.end(), survivors.begin(), survivors.end(),
+                            std::back_inserter(victims));
+        // 先写冷层再写热层：两次写入之间崩溃时，被淘汰的记忆会同时留在两层中，但不会丢失
+        write_cold_store(replica, victims);
+        evicted = victims.size();
+    }
+    write_store(store_path_, dimension_, replica.vectors, merged,
+                [&replica](size_t i) { return replica.summary(i); }, &replica.quantized, &replica.metadata, pending_,
+                checkpoint, reducer_.get(), has_full_vectors(replica) ? &replica.full_vectors : nullptr,
+                renumbering ? &survivors : nullptr);
+
+    // 第二阶段：两份副本依次重新映射新文件，行号改变时重建索引
+    store_stale_ = false;
+    publish([&](Replica& target) {
+        open_store(target); // 重新挂接元数据时清除被整合行的标记
+        if (evicting) {
+            open_cold_store(target);
+        }
+        if (renumbering) {
+            ++target.generation;
+            rebuild_indexes(target);
+        } else if (ivfpq_saved) {
+            // 重新映射刚写出的索引，释放内存中累积的编码
+            open_ivfpq(target);
+        }
+    });
+    if (wal_) {
+        wal_->truncateThrough(checkpoint);
+    }
+    Logger::logInfo("已将 " + std::to_string(merged) + " 条记忆合并到 " + store_path_ + " (WAL检查点 #"
+                    + std::to_string(checkpoint) + ")。");
+    if (retired > 0) {
+        Logger::logInfo("已移除 " + std::to_string(retired) + " 条被整合的记忆。");
+    }
+    if (evicting) {
+        Logger::logInfo("记忆超出容量上限，已淘汰 " + std::to_string(evicted) + " 条到冷层 (冷层共 "
+                        + std::to_string(current().cold_vectors.rows()) + " 条)，热层保留 "
+                        + std::to_string(current().rows()) + " 条。");
+    }
 }
 
-void MemoryManager::addMemory(const std::string& text_summary, const std::vector<float>& embedding) {
-    // 将新记忆作为一个JSON对象添加到数组中
-    nlohmann::json new_memory = {
-        {"summary", text_summary},
-        {"embedding", embedding}
+std::vector<uint32_t> MemoryManager::select_survivors(const Replica& replica, std::vector<uint32_t> order,
+                                                      size_t target) const {
+    // 排在前面的先淘汰：LRU 按最近被检索的时间，其次访问次数；重要度策略按重要度，其次最近被检索的时间
+    auto evict_first = [&](uint32_t a, uint32_t b) {
+        MemoryMetadata::Row x = replica.metadata.row(a);
+        MemoryMetadata::Row y = replica.metadata.row(b);
+        if (eviction_policy_ == EvictionPolicy::Importance && x.importance != y.importance) {
+            return x.importance < y.importance;
+        }
+        if (x.last_access != y.last_access) return x.last_access < y.last_access;
+        if (x.access_count != y.access_count) return x.access_count < y.access_count;
+        return a < b;
     };
-    memory_db_.push_back(new_memory);
-    Logger::logInfo("已添加一条新记忆到内存中。当前总数: " + std::to_string(memory_db_.size()));
+    size_t victims = order.size() - std::min(order.size(), target);
+    std::nth_element(order.begin(), order.begin() + victims, order.end(), evict_first);
+    std::vector<uint32_t> survivors(order.begin() + victims, order.end());
+    std::sort(survivors.begin(), survivors.end());
+    return survivors;
+}
+
+void MemoryManager::write_cold_store(const Replica& replica, const std::vector<uint32_t>& victims) const {
+    // 现有冷层直接来自映射，被淘汰的行追加在其后；冷层的访问记录 (检索命中) 随之写回
+    size_t existing = replica.cold_vectors.rows();
+    MappedColumn<float> vectors = replica.cold_vectors;
+    MemoryMetadata metadata = replica.cold_metadata;
+    // 两层都保存了原始向量时，冷层同样保存，之后更换降维方式时可以重新投影
+    const bool with_full = has_full_vectors(replica) && replica.cold_full_vectors.rows() == existing;
+    MappedColumn<float> full_vectors = replica.cold_full_vectors;
+    vectors.reserve_tail(victims.size());
+    for (uint32_t index : victims) {
+        vectors.append(replica.row(index));
+        metadata.appendFrom(replica.metadata, index);
+        if (with_full) {
+            full_vectors.append(replica.full_vectors.row(index));
+        }
+    }
+    write_store(cold_path_, dimension_, vectors, existing + victims.size(),
+                [&](size_t i) {
+                    return i < existing ? replica.cold_store.summary(i) : replica.summary(victims[i - existing]);
+                },
+                nullptr, &metadata, {}, 0, reducer_.get(), with_full ? &full_vectors : nullptr);
+}
+
+void MemoryManager::open_cold_store(Replica& replica) {
+    replica.cold_vectors.clear();
+    replica.cold_full_vectors.clear();
+    replica.cold_metadata.clear();
+    replica.cold_store.close();
+    if (!fs::exists(cold_path_)) {
+        return;
+    }
+    replica.cold_store.open(cold_path_);
+    attach_cold_store(replica);
+}
+
+void MemoryManager::attach_cold_store(Replica& replica) {
+    if (!reducer_->matches(replica.cold_store)) {
+        size_t file_dimension = replica.cold_store.dimension();
+        replica.cold_store.close();
+        throw std::runtime_error("冷层记忆库 " + cold_path_ + " 的向量维度 (" + std::to_string(file_dimension)
+                                 + ") 或降维方式与当前配置 (" + std::to_string(dimension_) + " 维) 不一致。");
+    }
+    replica.cold_vectors.attach(replica.cold_store.vectors(), replica.cold_store.count());
+    attach_full_vectors(replica.cold_store, replica.cold_full_vectors, cold_path_);
+    if (!replica.cold_metadata.attach(replica.cold_store)) {
+        MemoryMetadata::Attributes defaults;
+        defaults.created = MemoryMetadata::now();
+        for (size_t i = 0; i < replica.cold_store.count(); ++i) {
+            replica.cold_metadata.append(defaults);
+        }
+    }
+    if (!replaying_) {
+        Logger::logInfo("已映射冷层记忆库 " + cold_path_ + "，共 " + std::to_string(replica.cold_store.count())
+                        + " 条记忆。");
+    }
+}
+
+void MemoryManager::build_hnsw(Replica& replica) {
+    Replica* owner = &replica;
+    replica.hnsw = std::make_unique<HNSWIndex>(dimension_, hnsw_params_, [owner](size_t i) { return owner->row(i); });
+    for (size_t i = 0; i < replica.rows(); ++i) {
+        replica.hnsw->insert(i);
+    }
+}
+
+void MemoryManager::rebuild_indexes(Replica& replica) {
+    if (lexical_enabled_) {
+        replica.lexical.clear();
+        for (size_t i = 0; i < replica.rows(); ++i) {
+            replica.lexical.add(replica.summary(i));
+        }
+    }
+    if (replica.hnsw) {
+        build_hnsw(replica);
+    }
+    if (replica.ivfpq) {
+        replica.ivfpq->clear();
+        for (size_t i = 0; i < replica.rows(); ++i) {
+            replica.ivfpq->add(i, replica.row(i));
+        }
+        // 索引文件中的行号已经失效，必须立即重写 (两份副本的内容相同，只写一次)；
+        // 写不成功就删掉，下次启动时提示重新训练而不是错配行号
+        if (!replaying_) {
+            try {
+                replica.ivfpq->save(ivfpq_path_);
+                ivfpq_saved_rows_ = replica.ivfpq->size();
+            } catch (const std::exception& e) {
+                Logger::logError("写入IVF-PQ索引失败: " + std::string(e.what()) + "，已删除过期的索引文件。");
+                std::error_code ignored;
+                fs::remove(ivfpq_path_, ignored);
+            }
+        }
+    }
+}
+
+size_t MemoryManager::size() const {
+    ReadSnapshot replica(*this);
+    return replica->rows();
+}
+
+size_t MemoryManager::coldSize() const {
+    ReadSnapshot replica(*this);
+    return replica->cold_vectors.rows();
 }
 
-std::vector<std::string> MemoryManager::retrieveMemories(const std::vector<float>& query_embedding, int top_k) {
-    if (memory_db_.empty()) {
+size_t MemoryManager::pendingCount() const {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    return pending_.size();
+}
+
+std::vector<std::string> MemoryManager::pendingSummaries(size_t max_count) const {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    size_t count = std::min(max_count, pending_.size());
+    std::vector<std::string> summaries;
+    summaries.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        summaries.push_back(pending_[i].summary);
+    }
+    return summaries;
+}
+
+uint32_t MemoryManager::deferPending(const std::string& summary) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto queued = std::find_if(pending_.begin(), pending_.end(),
+                               [&](const PendingEntry& entry) { return entry.summary == summary; });
+    if (queued == pending_.end()) {
+        return 0;
+    }
+    // 队列按加入顺序保存，合并时整体写入文件；这里只改变内存中的顺序
+    std::rotate(queued, queued + 1, pending_.end());
+    return ++pending_.back().failures;
+}
+
+bool MemoryManager::isValidEmbedding(const float* data, size_t dim, size_t expected_dim) {
+    if (dim == 0 || dim != expected_dim) {
+        return false;
+    }
+    // NaN/Inf 会传染到平方和；全零向量的平方和为0
+    float norm_sq = VectorMath::dot(data, data, dim);
+    return std::isfinite(norm_sq) && norm_sq > 0.0f;
+}
+
+void MemoryManager::rerank_full(const Replica& replica, const float* query, std::vector<ScoredIndex>& hits, size_t k,
+                                int64_t when) const {
+    const bool scoring = replica.metadata.scoring();
+    TopK selector(k);
+    for (const auto& hit : hits) {
+        float score = VectorMath::dot(query, replica.full_vectors.row(hit.index), embedding_dimension_);
+        if (scoring) score += replica.metadata.bonus(hit.index, when);
+        selector.push(score, hit.index);
+    }
+    hits = selector.take_sorted();
+}
+
+std::vector<ScoredIndex> MemoryManager::cold_search(const Replica& replica, const float* query, size_t k, int64_t when,
+                                                    const MemoryMetadata::Selection& selection) const {
+    if (selection.empty()) {
         return {};
     }
+    // 冷层只在兜底时扫描，不维护索引与量化编码，逐行精确计算
+    const MemoryMetadata& metadata = replica.cold_metadata;
+    const bool scoring = metadata.scoring();
+    TopK selector(k);
+    replica.cold_vectors.for_each_block(0, replica.cold_vectors.rows(), [&](size_t first, const float* data, size_t count) {
+        for (size_t i = 0; i < count; ++i, data += dimension_) {
+            size_t index = first + i;
+            if (!selection.unrestricted() && !selection.matches(index)) continue;
+            float score = VectorMath::dot(query, data, dimension_);
+            if (scoring) score += metadata.bonus(index, when);
+            selector.push(score, index | kColdRow);
+        }
+    });
+    return selector.take_sorted();
+}
 
-    // 创建一个结构来存储相似度和对应的文本
-    struct MemoryScore {
-        float score;
-        std::string summary;
+bool MemoryManager::prepare_embedding(const float* data, size_t dim, std::vector<float>& full,
+                                      std::vector<float>& reduced) const {
+    // 向量维度由 EMBEDDING_VECTOR_DIMENSION 决定，其它维度的向量来自不同的模型，无法比较；
+    // 零向量与 NaN 向量与任何查询的相似度都没有意义，只会浪费扫描时间
+    if (!isValidEmbedding(data, dim, embedding_dimension_)) {
+        return false;
+    }
+    // 入库时归一化一次，之后的相似度计算只需要一次点积
+    full.assign(data, data + dim);
+    VectorMath::normalize(full.data(), dim);
+    reduced.resize(dimension_);
+    reducer_->reduce(full.data(), reduced.data());
+    // 投影后可能恰好为零向量 (与所有主成分都正交)，同样无法参与检索
+    if (!isValidEmbedding(reduced.data(), dimension_, dimension_)) {
+        return false;
+    }
+    VectorMath::normalize(reduced.data(), dimension_);
+    return true;
+}
+
+void MemoryManager::append_row(Replica& replica, const std::string& summary, const float* reduced, const float* full,
+                               const MemoryMetadata::Attributes& attributes) {
+    if (has_full_vectors(replica)) {
+        replica.full_vectors.append(full);
+    }
+    replica.vectors.append(reduced);
+    replica.quantized.append(reduced);
+    replica.metadata.append(attributes);
+    replica.tail_summaries.push_back(summary);
+    if (lexical_enabled_) {
+        replica.lexical.add(summary);
+    }
+}
+
+MemoryManager::InsertResult MemoryManager::insert_entry(const std::string& summary, const float* data, size_t dim,
+                                                        MemoryMetadata::Attributes& attributes, bool deduplicate,
+                                                        size_t* merged_into) {
+    auto queued = std::find_if(pending_.begin(), pending_.end(),
+                               [&](const PendingEntry& entry) { return entry.summary == summary; });
+    if (attributes.created == 0) {
+        // 后台重新生成向量时只知道摘要：会话、角色、标签等沿用最初入队时的属性
+        if (queued != pending_.end()) {
+            attributes = queued->attributes;
+        }
+        if (attributes.created == 0) {
+            attributes.created = MemoryMetadata::now();
+        }
+    }
+    std::vector<float> full;
+    std::vector<float> reduced;
+    const bool valid = prepare_embedding(data, dim, full, reduced);
+    if (deduplicate && dedup_threshold_ > 0.0f && dedup_threshold_ <= 1.0f && valid) {
+        size_t duplicate = find_duplicate(current(), reduced.data(), full.data(), attributes);
+        if (duplicate < current().rows()) {
+            publish([&](Replica& replica) { replica.metadata.merge(duplicate); });
+            // 已在文件中的行直接改写合并次数；尚未合并进文件的行随下次合并写入
+            const Replica& replica = current();
+            if (duplicate < replica.store.count()) {
+                uint32_t merges = replica.metadata.row(duplicate).merge_count;
+                if (!replica.store.patch(MemoryStoreFile::MergeCount, sizeof(uint32_t), {duplicate}, &merges)) {
+                    store_stale_ = true;
+                }
+            }
+            if (queued != pending_.end()) {
+                pending_.erase(queued);
+            }
+            if (merged_into) *merged_into = duplicate;
+            return InsertResult::Merged;
+        }
+    }
+    if (!valid) {
+        if (queued == pending_.end()) {
+            pending_.push_back({summary, attributes});
+        }
+        return InsertResult::Pending;
+    }
+    publish([&](Replica& replica) {
+        append_row(replica, summary, reduced.data(), full.data(), attributes);
+        size_t added = replica.rows() - 1;
+        if (replica.hnsw) {
+            replica.hnsw->insert(added);
+        }
+        if (replica.ivfpq) {
+            replica.ivfpq->add(added, replica.row(added));
+        }
+    });
+    // 同一摘要重新生成了有效向量：它已入库，不再需要等待
+    if (queued != pending_.end()) {
+        pending_.erase(queued);
+    }
+    return InsertResult::Appended;
+}
+
+size_t MemoryManager::find_duplicate(const Replica& replica, const float* reduced, const float* full,
+                                     const MemoryMetadata::Attributes& attributes) const {
+    if (replica.rows() == 0) {
+        return replica.rows();
+    }
+    // 只在同一会话、同一角色的记忆中查找；会话或角色为空时过滤不到“为空”，由下面的逐条比较排除
+    MemoryFilter filter;
+    filter.session = attributes.session;
+    filter.character = attributes.character;
+    const MemoryMetadata::Selection selection = replica.metadata.select(filter);
+    auto hits = vector_search(replica, reduced, 1, kDuplicateCandidates, 0, selection, false);
+    // 降维后的相似度只是近似值：有原始向量时用它判断是否达到阈值，候选之间的顺序可能因此改变
+    const bool full_scores = has_full_vectors(replica);
+    for (const auto& hit : hits.front()) {
+        float score = full_scores ? VectorMath::dot(full, replica.full_vectors.row(hit.index), embedding_dimension_)
+                                  : hit.score;
+        if (score < dedup_threshold_) {
+            if (full_scores) continue;
+            break;
+        }
+        MemoryMetadata::Attributes existing = replica.metadata.attributes(hit.index);
+        if (existing.session == attributes.session && existing.character == attributes.character) {
+            return hit.index;
+        }
+    }
+    return replica.rows();
+}
+
+void MemoryManager::read_legacy_json(const std::string& path,
+                                     const std::function<void(const std::string&, const std::vector<float>&)>& on_entry) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("无法打开旧版记忆文件 " + path);
+    }
+    // 大块读取缓冲；nlohmann 的流适配器逐字符读取，默认的小缓冲会让大文件的解析明显变慢
+    std::vector<char> read_buffer(1 << 20);
+    file.rdbuf()->pubsetbuf(read_buffer.data(), static_cast<std::streamsize>(read_buffer.size()));
+
+    LegacyMemorySax handler(on_entry);
+    nlohmann::json::sax_parse(file, &handler);
+    if (!handler.error().empty()) {
+        throw std::runtime_error("旧版记忆文件 " + path + " 格式无效: " + handler.error());
+    }
+}
+
+void MemoryManager::write_store(const std::string& path, size_t dimension, const MappedColumn<float>& vectors, size_t count,
+                                const std::function<std::string_view(size_t)>& summary_at,
+                                const QuantizedVectors* quantized, const MemoryMetadata* metadata,
+                                const std::vector<PendingEntry>& pending, uint64_t wal_checkpoint,
+                                const EmbeddingReducer* reducer, const MappedColumn<float>* full_vectors,
+                                const std::vector<uint32_t>* keep) {
+    MemoryStoreWriter writer(path, dimension, keep ? keep->size() : count);
+    auto for_each_row = [&](auto&& fn) {
+        if (keep) {
+            for (uint32_t i : *keep) fn(i);
+        } else {
+            for (size_t i = 0; i < count; ++i) fn(i);
+        }
     };
-    std::vector<MemoryScore> scored_memories;
-
-    // --- 核心的暴力搜索逻辑 ---
-    for (const auto& memory_entry : memory_db_) {
-        // 从JSON中提取向量
-        std::vector<float> entry_embedding = memory_entry["embedding"].get<std::vector<float>>();
-        
-        // 计算相似度
-        float score = cosine_similarity(query_embedding, entry_embedding);
-        
-        scored_memories.push_back({score, memory_entry["summary"]});
-    }
-
-    // 根据分数降序排序
-    std::sort(scored_memories.begin(), scored_memories.end(), 
-        [](const MemoryScore& a, const MemoryScore& b) {
-            return a.score > b.score;
+
+    writer.beginSection(MemoryStoreFile::Vectors);
+    vectors.for_each_kept_block(count, keep, [&](size_t, const float* data, size_t rows) {
+        writer.write(data, rows * dimension * sizeof(float));
     });
 
-    // 提取前 top_k 个结果的文本
-    std::vector<std::string> top_memories;
-    for (int i = 0; i < std::min((int)scored_memories.size(), top_k); ++i) {
-        top_memories.push_back(scored_memories[i].summary);
+    writer.beginSection(MemoryStoreFile::SummaryOffsets);
+    uint64_t offset = 0;
+    for_each_row([&](size_t i) {
+        writer.write(&offset, sizeof(offset));
+        offset += summary_at(i).size();
+    });
+    writer.write(&offset, sizeof(offset));
+
+    writer.beginSection(MemoryStoreFile::SummaryHeap);
+    for_each_row([&](size_t i) {
+        std::string_view text = summary_at(i);
+        writer.write(text.data(), text.size());
+    });
+    writer.endSection();
+
+    if (quantized && quantized->enabled()) {
+        quantized->writeSections(writer, count, keep);
     }
-    
-    Logger::logInfo("已检索到 " + std::to_string(top_memories.size()) + " 条最相关的记忆。");
-    return top_memories;
+    if (metadata) {
+        metadata->writeSections(writer, count, keep);
+    }
+    if (full_vectors) {
+        writer.beginSection(MemoryStoreFile::FullVectors);
+        full_vectors->for_each_kept_block(count, keep, [&](size_t, const float* data, size_t rows) {
+            writer.write(data, rows * full_vectors->width() * sizeof(float));
+        });
+        writer.endSection();
+    }
+    if (reducer) {
+        reducer->writeSections(writer);
+    }
+    writer.beginSection(MemoryStoreFile::PendingSummaries);
+    for (const auto& entry : pending) {
+        uint32_t length = static_cast<uint32_t>(entry.summary.size());
+        writer.write(&length, sizeof(length));
+        writer.write(entry.summary.data(), entry.summary.size());
+    }
+    writer.beginSection(MemoryStoreFile::PendingAttributes);
+    for (const auto& entry : pending) {
+        std::string encoded = entry.attributes.encode();
+        uint32_t length = static_cast<uint32_t>(encoded.size());
+        writer.write(&length, sizeof(length));
+        writer.write(encoded.data(), encoded.size());
+    }
+    writer.beginSection(MemoryStoreFile::WalCheckpoint);
+    writer.write(&wal_checkpoint, sizeof(wal_checkpoint));
+    writer.endSection();
+    writer.commit();
+}
+
+size_t MemoryManager::importLegacyJson(const std::string& json_path, const std::string& store_path, size_t dimension) {
+    MappedColumn<float> vectors(dimension);
+    std::vector<std::string> summaries;
+    std::vector<PendingEntry> pending;
+    // 旧文件没有时间信息，统一以导入时刻作为创建时间
+    MemoryMetadata metadata{MemoryMetadata::Weights{}};
+    MemoryMetadata::Attributes attributes;
+    attributes.created = MemoryMetadata::now();
+    read_legacy_json(json_path, [&](const std::string& summary, const std::vector<float>& embedding) {
+        if (!isValidEmbedding(embedding.data(), embedding.size(), dimension)) {
+            pending.push_back({summary, attributes});
+            return;
+        }
+        float* dst = vectors.append_row();
+        std::copy(embedding.begin(), embedding.end(), dst);
+        VectorMath::normalize(dst, dimension);
+        metadata.append(attributes);
+        summaries.push_back(summary);
+    });
+    if (!pending.empty()) {
+        Logger::logError("有 " + std::to_string(pending.size())
+                         + " 条记忆的向量为零、含NaN或维度不一致，已放入待重新生成embedding的队列。");
+    }
+
+    write_store(store_path, dimension, vectors, summaries.size(),
+                [&](size_t i) { return std::string_view(summaries[i]); }, nullptr, &metadata, pending, 0, nullptr,
+                nullptr);
+    Logger::logInfo("已从 " + json_path + " 导入 " + std::to_string(summaries.size()) + " 条记忆到 " + store_path);
+    return summaries.size();
+}
+
+bool MemoryManager::addMemory(const std::string& text_summary, const std::vector<float>& embedding,
+                              MemoryMetadata::Attributes attributes) {
+    attributes.importance = std::clamp(attributes.importance, 0.0f, 1.0f);
+
+    std::unique_lock<std::mutex> lock(write_mutex_);
+    // 将新记忆的向量追加到矩阵末尾，摘要追加到平行数组中；无效向量进入待处理队列。
+    // 与已有记忆重复时只累加那条记忆的合并次数，不写WAL (合并次数原地写入记忆库文件)
+    size_t duplicate = 0;
+    InsertResult result = insert_entry(text_summary, embedding.data(), embedding.size(), attributes, true, &duplicate);
+    if (result == InsertResult::Merged) {
+        uint32_t merges = current().metadata.row(duplicate).merge_count;
+        lock.unlock();
+        Logger::logInfo("新记忆与第 " + std::to_string(duplicate) + " 条记忆重复 (相似度不低于 "
+                        + std::to_string(dedup_threshold_) + ")，已合并，该记忆累计合并 " + std::to_string(merges) + " 次。");
+        return true;
+    }
+    bool indexed = result == InsertResult::Appended;
+    size_t total = current().rows();
+    size_t pending = pending_.size();
+
+    // 持久化只需向WAL追加一条记录 (无效向量也要记录，重启后才能恢复待处理队列)；整库重写交给后台合并线程。
+    // 记录的是实际生效的属性 (可能沿用自待处理队列)，回放时无需再依赖队列的状态
+    bool compact_due = false;
+    bool persisted = false;
+    try {
+        wal_->append(text_summary, embedding.data(), embedding.size(), attributes.encode());
+        persisted = true;
+        compact_due = wal_->bytes() >= compact_threshold_bytes_;
+    } catch (const std::exception& e) {
+        Logger::logError("写入WAL失败: " + std::string(e.what()) + " (记忆只保存在内存中)");
+    }
+    compact_due = compact_due || (capacity_ > 0 && total > capacity_);
+    lock.unlock();
+
+    if (compact_due) {
+        request_compaction();
+    }
+    if (indexed) {
+        Logger::logInfo("已添加一条新记忆。当前总数: " + std::to_string(total));
+    } else {
+        Logger::logError("新记忆的向量无效 (零向量、含NaN或维度为 " + std::to_string(embedding.size())
+                         + ")，已放入待重新生成embedding的队列。当前待处理: " + std::to_string(pending));
+    }
+    return persisted;
+}
+
+void MemoryManager::request_compaction() {
+    std::lock_guard<std::mutex> compactor_lock(compactor_mutex_);
+    compact_requested_ = true;
+    compactor_cv_.notify_one();
+}
+
+std::vector<MemoryCluster> MemoryManager::findConsolidationClusters(const ConsolidationOptions& options,
+                                                                    size_t* next_row) const {
+    std::vector<MemoryCluster> clusters;
+    ReadSnapshot snapshot(*this);
+    const Replica& replica = *snapshot;
+    size_t total = replica.rows();
+    size_t first = options.first_row < total ? options.first_row : 0;
+    if (next_row) *next_row = first;
+    if (total == 0 || options.max_clusters == 0 || options.min_size == 0) {
+        return clusters;
+    }
+
+    // 贪心聚类：每个种子检索一次与它最相似的旧记忆 (走与常规检索相同的索引)，够数就成簇，
+    // 簇中的记忆不再作为种子或成员。种子按行号 (大致即创建顺序) 轮转，孤立的旧记忆不会每次都被重新尝试
+    std::vector<bool> used(total, false);
+    size_t depth = std::max(options.max_size, options.min_size) * 2;
+    size_t seeds = 0;
+    size_t index = first;
+    for (size_t visited = 0; visited < total && seeds < options.max_seeds && clusters.size() < options.max_clusters;
+         ++visited, index = index + 1 < total ? index + 1 : 0) {
+        if (used[index] || replica.is_retired(index)) continue;
+        MemoryMetadata::Attributes seed = replica.metadata.attributes(index);
+        if (seed.created >= options.created_before) continue;
+        ++seeds;
+
+        MemoryFilter filter;
+        filter.session = seed.session;
+        filter.character = seed.character;
+        filter.created_before = options.created_before;
+        const MemoryMetadata::Selection selection = replica.metadata.select(filter);
+        auto hits = vector_search(replica, replica.row(index), 1, depth, 0, selection, false);
+
+        MemoryCluster cluster;
+        cluster.rows.push_back(index);
+        for (const auto& hit : hits.front()) {
+            if (cluster.rows.size() >= options.max_size || hit.score < options.similarity) break;
+            if (hit.index == index || used[hit.index] || replica.is_retired(hit.index)) continue;
+            // 会话或角色为空时过滤不到“为空”，逐条比较排除属于其他会话或角色的记忆
+            MemoryMetadata::Attributes other = replica.metadata.attributes(hit.index);
+            if (other.session == seed.session && other.character == seed.character) {
+                cluster.rows.push_back(hit.index);
+            }
+        }
+        if (cluster.rows.size() < options.min_size) continue;
+        std::sort(cluster.rows.begin(), cluster.rows.end());
+        for (size_t member : cluster.rows) {
+            used[member] = true;
+            cluster.summaries.emplace_back(replica.summary(member));
+        }
+        clusters.push_back(std::move(cluster));
+    }
+    if (next_row) *next_row = index;
+    return clusters;
+}
+
+size_t MemoryManager::consolidateMemories(const std::vector<MemoryCluster>& clusters) {
+    // 持有 write_mutex_：登记期间不会有合并改变行号，登记的行也一定在下次合并的第一阶段之前
+    std::unique_lock<std::mutex> lock(write_mutex_);
+    const Replica& replica = current();
+
+    // 先在公开副本上校验各簇并算好整合后的属性，再用一次 publish 把所有新记忆写入两份副本
+    struct Accepted {
+        const MemoryCluster* cluster;
+        std::vector<float> full;
+        std::vector<float> reduced;
+        MemoryMetadata::Attributes attributes;
+        int64_t last_access;
+        uint32_t access_count;
+        uint32_t merge_count;
+    };
+    std::vector<Accepted> accepted;
+    std::vector<uint32_t> claimed;
+    size_t skipped = 0;
+    for (const auto& cluster : clusters) {
+        std::vector<float> full;
+        std::vector<float> reduced;
+        bool valid = !cluster.rows.empty() && cluster.rows.size() == cluster.summaries.size()
+                     && prepare_embedding(cluster.embedding.data(), cluster.embedding.size(), full, reduced);
+        for (size_t i = 0; valid && i < cluster.rows.size(); ++i) {
+            size_t index = cluster.rows[i];
+            valid = index < replica.rows() && (i == 0 || index > cluster.rows[i - 1]) && !replica.is_retired(index)
+                    && !std::binary_search(claimed.begin(), claimed.end(), index)
+                    && replica.summary(index) == cluster.summaries[i];
+        }
+        if (!valid) {
+            ++skipped;
+            continue;
+        }
+
+        Accepted entry{&cluster, std::move(full), std::move(reduced), replica.metadata.attributes(cluster.rows.front()),
+                       0, 0, 0};
+        for (size_t index : cluster.rows) {
+            MemoryMetadata::Row source = replica.metadata.row(index);
+            entry.attributes.created = std::min(entry.attributes.created, source.created);
+            entry.attributes.importance = std::max(entry.attributes.importance, source.importance);
+            entry.attributes.tags |= source.tags;
+            entry.last_access = std::max(entry.last_access, source.last_access);
+            entry.access_count += source.access_count;
+            entry.merge_count += source.merge_count;
+        }
+        size_t middle = claimed.size();
+        claimed.insert(claimed.end(), cluster.rows.begin(), cluster.rows.end());
+        std::inplace_merge(claimed.begin(), claimed.begin() + middle, claimed.end());
+        accepted.push_back(std::move(entry));
+    }
+
+    if (!accepted.empty()) {
+        publish([&](Replica& target) {
+            for (const auto& entry : accepted) {
+                const MemoryCluster& cluster = *entry.cluster;
+                append_row(target, cluster.summary, entry.reduced.data(), entry.full.data(), entry.attributes);
+                size_t added = target.rows() - 1;
+                target.metadata.setAccess(added, entry.last_access, entry.access_count);
+                target.metadata.setMergeCount(added, entry.merge_count);
+                if (target.hnsw) {
+                    target.hnsw->insert(added);
+                }
+                if (target.ivfpq) {
+                    target.ivfpq->add(added, target.row(added));
+                }
+            }
+            // 被替换的行与新记忆在同一次切换中生效：此后编译的过滤条件都排除它们
+            for (uint32_t index : claimed) {
+                target.metadata.retire(index);
+            }
+        });
+        store_stale_ = true;
+    }
+    lock.unlock();
+
+    if (skipped > 0) {
+        Logger::logInfo("有 " + std::to_string(skipped) + " 组待整合的记忆已发生变化或整合结果的向量无效，已跳过。");
+    }
+    if (!claimed.empty()) {
+        // 整合结果不写WAL，由合并与移除被替换的行一起写入新文件 (合并前崩溃则本轮整合丢失，原记忆保留)
+        request_compaction();
+        Logger::logInfo("已将 " + std::to_string(claimed.size()) + " 条旧记忆整合为 "
+                        + std::to_string(accepted.size()) + " 条，等待合并后移除原记忆。");
+    }
+    return claimed.size();
 }
 
-void MemoryManager::save_memories_to_file() {
-    std::ofstream file(file_path_);
-    if (file.is_open()) {
-        // 将内存中的JSON对象格式化后写入文件
-        file << memory_db_.dump(4); // 使用4个空格进行缩进，方便阅读
-        Logger::logInfo("已成功将 " + std::to_string(memory_db_.size()) + " 条记忆保存到 " + file_path_);
+std::vector<std::vector<ScoredIndex>> MemoryManager::vector_search(const Replica& replica, const float* queries,
+                                                                 size_t count, size_t k, int64_t when,
+                                                                 const MemoryMetadata::Selection& selection,
+                                                                 bool with_bonus) const {
+    const MemoryMetadata& metadata = replica.metadata;
+    const QuantizedVectors& quantized = replica.quantized;
+    const size_t rows = replica.rows();
+    std::vector<std::vector<ScoredIndex>> results(count);
+    if (selection.empty() || count == 0) {
+        return results;
+    }
+    const bool scoring = with_bonus && metadata.scoring();
+    auto query = [&](size_t q) { return queries + q * dimension_; };
+
+    // 一行向量与全部查询的得分：每4个查询一组共用一次行读取，剩余的逐个计算
+    auto score_row = [&](const float* vector, float* scores) {
+        size_t q = 0;
+        for (; q + 4 <= count; q += 4) {
+            VectorMath::dot4(query(q), dimension_, vector, dimension_, scores + q);
+        }
+        for (; q < count; ++q) {
+            scores[q] = VectorMath::dot(query(q), vector, dimension_);
+        }
+    };
+    std::vector<float> scores(count);
+
+    // 按会话/角色过滤且涉及的行只占一小部分时，直接在这些行上精确打分：
+    // 开销与该会话/角色的记忆数成正比，与库中其他记忆的数量无关
+    const std::vector<uint32_t>* candidates = selection.candidates();
+    if (candidates && candidates->size() * kSparseSelectionRatio <= rows) {
+        std::vector<TopK> selectors(count, TopK(k));
+        for (uint32_t index : *candidates) {
+            if (!selection.matches(index)) continue;
+            score_row(replica.row(index), scores.data());
+            float bonus = scoring ? metadata.bonus(index, when) : 0.0f;
+            for (size_t q = 0; q < count; ++q) {
+                selectors[q].push(scores[q] + bonus, index);
+            }
+        }
+        for (size_t q = 0; q < count; ++q) {
+            results[q] = selectors[q].take_sorted();
+        }
+        return results;
+    }
+
+    HNSWIndex::Filter accept;
+    if (!selection.unrestricted()) {
+        accept = [&selection](size_t index) { return selection.matches(index); };
+    }
+    if (replica.hnsw) {
+        const HNSWIndex& hnsw = *replica.hnsw;
+        // 近似检索：只访问图上与查询相近的一小部分节点；图只按相似度组织，
+        // 因此先取 ef_search 个候选，再叠加时间衰减与重要度选出前 k 个。
+        // 过滤条件在图遍历时判断，不满足的节点只用于导航，不占用候选名额。
+        // 图遍历是随机访问，多个查询之间没有可以共享的顺序读取，逐个查询即可
+        for (size_t q = 0; q < count; ++q) {
+            if (!scoring) {
+                results[q] = hnsw.search(query(q), k, 0, accept);
+                continue;
+            }
+            TopK selector(k);
+            for (const auto& hit : hnsw.search(query(q), std::max(k, hnsw.params().ef_search), 0, accept)) {
+                selector.push(hit.score + metadata.bonus(hit.index, when), hit.index);
+            }
+            results[q] = selector.take_sorted();
+        }
+        return results;
+    }
+
+    if (replica.ivfpq) {
+        // 近似检索：只扫描与查询最相近的 nprobe 个倒排列表，按查表得到的近似得分取 RERANK_CANDIDATES 个候选，
+        // 再用全精度向量重新计算相似度并叠加附加得分，选出前 k 个
+        size_t depth = std::max(k, rerank_candidates_);
+        for (size_t q = 0; q < count; ++q) {
+            TopK selector(k);
+            for (const auto& hit : replica.ivfpq->search(query(q), depth, ivfpq_nprobe_, accept)) {
+                float score = VectorMath::dot(query(q), replica.row(hit.index), dimension_);
+                selector.push(score + (scoring ? metadata.bonus(hit.index, when) : 0.0f), hit.index);
+            }
+            results[q] = selector.take_sorted();
+        }
+        return results;
+    }
+
+    // 暴力扫描按块进行：先为一块行计算附加得分与过滤位图，紧接着扫描同一块向量，
+    // 附加得分在扫描循环内直接相加，位图为0的行不计算点积，整块都不满足时跳过。
+    // 块内再切成能留在L2中的小片：同一片依次与所有查询计算，整个矩阵只从内存读取一遍
+    const bool filtering = !selection.unrestricted();
+    auto for_each_scored_tile = [&](size_t range_begin, size_t range_end, size_t row_bytes, auto&& scan_tile) {
+        float bias[kScoreBlockRows];
+        uint64_t mask[kScoreBlockRows / 64];
+        size_t tile_rows = std::clamp<size_t>(kBatchTileBytes / row_bytes / 64 * 64, 64, kScoreBlockRows);
+        for (size_t begin = range_begin; begin < range_end; begin += kScoreBlockRows) {
+            size_t end = std::min(begin + kScoreBlockRows, range_end);
+            if (filtering && !selection.mask(begin, end - begin, mask)) {
+                continue;
+            }
+            if (scoring) {
+                metadata.bonuses(begin, end - begin, when, bias);
+            }
+            for (size_t tile = begin; tile < end; tile += tile_rows) {
+                size_t offset = tile - begin;
+                scan_tile(tile, std::min(tile + tile_rows, end), scoring ? bias + offset : nullptr,
+                          filtering ? mask + offset / 64 : nullptr);
+            }
+        }
+    };
+
+    // 行数足够多时把矩阵按块边界切成若干分片，由扫描线程池并行扫描：每个分片有自己的一组TopK，
+    // 分片之间不共享任何可写状态，全部完成后再合并为每个查询的前 keep 个
+    auto partitioned_scan = [&](size_t keep, auto&& scan_range) {
+        size_t parts = 1;
+        if (scan_pool_ && rows >= parallel_scan_min_rows_) {
+            size_t blocks = (rows + kScoreBlockRows - 1) / kScoreBlockRows;
+            parts = std::min(scan_pool_->workers() + 1, blocks);
+        }
+        std::vector<std::vector<TopK>> partial(parts, std::vector<TopK>(count, TopK(keep)));
+        if (parts == 1) {
+            scan_range(0, rows, partial[0]);
+            return std::move(partial[0]);
+        }
+        size_t blocks_per_part = ((rows + kScoreBlockRows - 1) / kScoreBlockRows + parts - 1) / parts;
+        scan_pool_->run(parts, [&](size_t part) {
+            size_t begin = part * blocks_per_part * kScoreBlockRows;
+            size_t end = std::min(begin + blocks_per_part * kScoreBlockRows, rows);
+            if (begin < end) {
+                scan_range(begin, end, partial[part]);
+            }
+        });
+        std::vector<TopK> merged(count, TopK(keep));
+        for (auto& selectors : partial) {
+            for (size_t q = 0; q < count; ++q) {
+                for (const auto& hit : selectors[q].take_sorted()) {
+                    merged[q].push(hit.score, hit.index);
+                }
+            }
+        }
+        return merged;
+    };
+
+    if (quantized.enabled()) {
+        // 第一遍在量化编码上扫描，内存带宽只有float32的 1/4 (int8) 或 1/2 (fp16)
+        std::vector<QuantizedVectors::Query> encoded;
+        for (size_t q = 0; q < count; ++q) {
+            encoded.push_back(quantized.encodeQuery(query(q)));
+        }
+        auto coarse = partitioned_scan(std::max(k, rerank_candidates_), [&](size_t range_begin, size_t range_end,
+                                                                            std::vector<TopK>& selectors) {
+            for_each_scored_tile(range_begin, range_end, quantized.bytesPerRow(),
+                                 [&](size_t begin, size_t end, const float* tile_bias, const uint64_t* tile_mask) {
+                for (size_t q = 0; q < count; ++q) {
+                    quantized.scan(encoded[q], begin, end, selectors[q], tile_bias, tile_mask);
+                }
+            });
+        });
+        // 第二遍只对少量候选用全精度向量重新打分，消除量化误差对排序的影响
+        for (size_t q = 0; q < count; ++q) {
+            TopK selector(k);
+            for (const auto& candidate : coarse[q].take_sorted()) {
+                float score = VectorMath::dot(query(q), replica.row(candidate.index), dimension_);
+                if (scoring) {
+                    score += metadata.bonus(candidate.index, when);
+                }
+                selector.push(score, candidate.index);
+            }
+            results[q] = selector.take_sorted();
+        }
+        return results;
+    }
+
+    // --- 核心的暴力搜索逻辑：顺序扫描连续矩阵，每行一次点积即为余弦相似度 ---
+    // 扫描期间只记录下标和分数，由有界最小堆为每个查询保留前 top_k 个。
+    // 4个查询一组扫过同一片：每段行向量只加载一次，同时与4个查询相乘 (类似矩阵乘法的分块)
+    auto scan_tile = [&](std::vector<TopK>& selectors, size_t begin, size_t end, const float* tile_bias,
+                         const uint64_t* tile_mask, size_t first_query, size_t query_count) {
+        replica.vectors.for_each_block(begin, end, [&](size_t first, const float* block, size_t block_rows) {
+            for (size_t i = 0; i < block_rows; ++i) {
+                size_t offset = first + i - begin;
+                if (tile_mask && !((tile_mask[offset / 64] >> (offset % 64)) & 1)) {
+                    continue;
+                }
+                const float* vector = block + i * dimension_;
+                float group[4];
+                if (query_count == 4) {
+                    VectorMath::dot4(query(first_query), dimension_, vector, dimension_, group);
+                } else {
+                    group[0] = VectorMath::dot(query(first_query), vector, dimension_);
+                }
+                float bonus = tile_bias ? tile_bias[offset] : 0.0f;
+                for (size_t j = 0; j < query_count; ++j) {
+                    selectors[first_query + j].push(group[j] + bonus, first + i);
+                }
+            }
+        });
+    };
+    auto selectors = partitioned_scan(k, [&](size_t range_begin, size_t range_end, std::vector<TopK>& selectors) {
+        for_each_scored_tile(range_begin, range_end, dimension_ * sizeof(float),
+                             [&](size_t begin, size_t end, const float* tile_bias, const uint64_t* tile_mask) {
+            size_t q = 0;
+            for (; q + 4 <= count; q += 4) {
+                scan_tile(selectors, begin, end, tile_bias, tile_mask, q, 4);
+            }
+            for (; q < count; ++q) {
+                scan_tile(selectors, begin, end, tile_bias, tile_mask, q, 1);
+            }
+        });
+    });
+    for (size_t q = 0; q < count; ++q) {
+        results[q] = selectors[q].take_sorted();
+    }
+    return results;
+}
+
+std::vector<std::string> MemoryManager::retrieveMemories(const std::string& query_text,
+                                                         const std::vector<float>& query_embedding, int top_k,
+                                                         const MemoryFilter& filter) {
+    return std::move(retrieveMemoriesBatch({MemoryQuery{query_text, query_embedding}}, top_k, filter).front());
+}
+
+std::vector<std::vector<std::string>> MemoryManager::retrieveMemoriesBatch(const std::vector<MemoryQuery>& queries,
+                                                                           int top_k, const MemoryFilter& filter) {
+    std::vector<std::vector<std::string>> top_memories(queries.size());
+    std::vector<Touch> touches;
+    const int64_t when = MemoryMetadata::now();
+    {
+        // 不加锁：登记公开副本后，写入方不会修改它，直到本次检索复制完摘要、撤销登记
+        ReadSnapshot snapshot(*this);
+        const Replica& replica = *snapshot;
+        if (replica.rows() == 0 || queries.empty()) {
+            return top_memories;
+        }
+        const MemoryMetadata::Selection selection = replica.metadata.select(filter);
+        std::function<bool(size_t)> accept;
+        if (!selection.unrestricted()) {
+            accept = [&selection](size_t index) { return selection.matches(index); };
+        }
+
+        size_t k = static_cast<size_t>(std::max(top_k, 0));
+        auto use_lexical = [&](const MemoryQuery& q) { return lexical_enabled_ && !q.text.empty(); };
+
+        // 有效的查询向量归一化 (并降维) 后排成连续的查询矩阵 (矩阵中的行在入库时已经归一化)，一次扫描全部打分；
+        // 有原始向量时另存一份原始查询，用于对候选全精度重排
+        const bool rerank = has_full_vectors(replica);
+        std::vector<float> matrix;
+        std::vector<float> full_matrix;
+        std::vector<float> full;
+        std::vector<float> reduced;
+        std::vector<size_t> vector_queries;
+        size_t depth = k;
+        for (size_t q = 0; q < queries.size(); ++q) {
+            if (retrieval_mode_ == RetrievalMode::Lexical) break;
+            const auto& embedding = queries[q].embedding;
+            if (!prepare_embedding(embedding.data(), embedding.size(), full, reduced)) {
+                if (use_lexical(queries[q])) {
+                    Logger::logInfo("查询向量无效 (embedding可能获取失败)，仅使用字面检索。");
+                } else {
+                    Logger::logError("查询向量无效 (embedding可能获取失败)，跳过记忆检索。");
+                }
+                continue;
+            }
+            matrix.insert(matrix.end(), reduced.begin(), reduced.end());
+            if (rerank) {
+                full_matrix.insert(full_matrix.end(), full.begin(), full.end());
+            }
+            vector_queries.push_back(q);
+            if (use_lexical(queries[q])) {
+                depth = std::max(k, fusion_candidates_);
+            }
+        }
+        auto vector_hits = vector_search(replica, matrix.data(), vector_queries.size(),
+                                         rerank ? std::max(depth, rerank_candidates_) : depth, when, selection);
+        if (rerank) {
+            for (size_t i = 0; i < vector_queries.size(); ++i) {
+                rerank_full(replica, full_matrix.data() + i * embedding_dimension_, vector_hits[i], depth, when);
+            }
+        }
+
+        // 热层中没有足够相关的记忆时，再到冷层里找：两层的得分口径相同 (余弦 + 附加得分)，合并后重新排序
+        if (replica.cold_vectors.rows() > 0) {
+            const MemoryMetadata::Selection cold_selection = replica.cold_metadata.select(filter);
+            for (size_t i = 0; i < vector_queries.size(); ++i) {
+                auto& ranked = vector_hits[i];
+                if (!ranked.empty() && ranked.front().score >= cold_threshold_) continue;
+                auto cold = cold_search(replica, matrix.data() + i * dimension_, depth, when, cold_selection);
+                if (cold.empty()) continue;
+                ranked.insert(ranked.end(), cold.begin(), cold.end());
+                std::sort(ranked.begin(), ranked.end(), [](const ScoredIndex& a, const ScoredIndex& b) {
+                    return a.score > b.score;
+                });
+                ranked.resize(std::min(ranked.size(), depth));
+            }
+        }
+
+        std::vector<std::vector<ScoredIndex>> hits(queries.size());
+        for (size_t i = 0; i < vector_queries.size(); ++i) {
+            const MemoryQuery& q = queries[vector_queries[i]];
+            auto& ranked = vector_hits[i];
+            if (!use_lexical(q)) {
+                ranked.resize(std::min(ranked.size(), k));
+                hits[vector_queries[i]] = std::move(ranked);
+                continue;
+            }
+            // 倒数排名融合：两路各取若干候选，得分只取决于名次，无需对余弦与BM25的量纲做校准
+            std::unordered_map<size_t, float> fused;
+            for (const auto& ranking : {ranked, replica.lexical.search(q.text, depth, accept)}) {
+                for (size_t rank = 0; rank < ranking.size(); ++rank) {
+                    fused[ranking[rank].index] += 1.0f / (rrf_k_ + static_cast<float>(rank + 1));
+                }
+            }
+            TopK selector(k);
+            for (const auto& [index, score] : fused) {
+                selector.push(score, index);
+            }
+            hits[vector_queries[i]] = selector.take_sorted();
+        }
+        for (size_t q = 0, next = 0; q < queries.size(); ++q) {
+            if (next < vector_queries.size() && vector_queries[next] == q) {
+                ++next;
+            } else if (use_lexical(queries[q])) {
+                hits[q] = replica.lexical.search(queries[q].text, k, accept);
+            }
+        }
+
+        // 只有最终胜出的 k 条记忆才会复制摘要文本
+        for (size_t q = 0; q < queries.size(); ++q) {
+            for (const auto& hit : hits[q]) {
+                top_memories[q].emplace_back(replica.hit_summary(hit.index));
+                touches.push_back({hit.index, when, replica.generation});
+            }
+        }
+    }
+
+    // 记录命中：刷新最近访问时间 (时间衰减从这里重新计起) 并累加访问次数，下次合并时写回文件。
+    // 副本只能由写入方修改，这里只把命中排入队列
+    size_t total = touches.size();
+    record_touches(std::move(touches));
+
+    if (queries.size() == 1) {
+        Logger::logInfo("已检索到 " + std::to_string(total) + " 条最相关的记忆。");
     } else {
-        Logger::logError("无法打开文件 " + file_path_ + " 进行写入！");
+        Logger::logInfo("已为 " + std::to_string(queries.size()) + " 条查询批量检索到 " + std::to_string(total)
+                        + " 条记忆。");
     }
-}
\ No newline at end of file
+    return top_memories;
+}
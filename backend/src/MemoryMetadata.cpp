@@ -0,0 +1,416 @@
+#include "MemoryMetadata.hpp"
+#include "MemoryStoreFile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+template <typename T>
+void put(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool take(std::string_view& in, T& value) {
+    if (in.size() < sizeof(T)) return false;
+    std::memcpy(&value, in.data(), sizeof(T));
+    in.remove_prefix(sizeof(T));
+    return true;
+}
+
+void put_string(std::string& out, const std::string& value) {
+    put(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+bool take_string(std::string_view& in, std::string& value) {
+    uint32_t length = 0;
+    if (!take(in, length) || in.size() < length) return false;
+    value.assign(in.data(), length);
+    in.remove_prefix(length);
+    return true;
+}
+
+template <typename T>
+const T* typed_section(const MemoryStoreFile& store, uint32_t id, size_t rows) {
+    size_t size = 0;
+    const void* data = store.section(id, &size);
+    return data && size == rows * sizeof(T) ? static_cast<const T*>(data) : nullptr;
+}
+
+} // namespace
+
+// ==================== Attributes ====================
+
+std::string MemoryMetadata::Attributes::encode() const {
+    std::string out;
+    put(out, created);
+    put(out, importance);
+    put(out, tags);
+    put_string(out, session);
+    put_string(out, character);
+    return out;
+}
+
+MemoryMetadata::Attributes MemoryMetadata::Attributes::decode(std::string_view data) {
+    Attributes attributes;
+    take(data, attributes.created) && take(data, attributes.importance) && take(data, attributes.tags)
+        && take_string(data, attributes.session) && take_string(data, attributes.character);
+    return attributes;
+}
+
+// ==================== Selection ====================
+
+bool MemoryMetadata::Selection::retired(size_t index) const {
+    return (retired_word(index) & 1u) != 0;
+}
+
+uint64_t MemoryMetadata::Selection::retired_word(size_t index) const {
+    const std::vector<uint64_t>& bits = metadata_->retired_bits_;
+    size_t word = index / 64;
+    size_t shift = index % 64;
+    uint64_t value = word < bits.size() ? bits[word] >> shift : 0;
+    if (shift != 0 && word + 1 < bits.size()) {
+        value |= bits[word + 1] << (64 - shift);
+    }
+    return value;
+}
+
+bool MemoryMetadata::Selection::matches(size_t index) const {
+    const MemoryMetadata& m = *metadata_;
+    if (m.retired_count_ > 0 && retired(index)) return false;
+    if (only_retired_) return true;
+    if (session_ != 0 && *m.session_.row(index) != session_) return false;
+    if (character_ != 0 && *m.character_.row(index) != character_) return false;
+    int64_t created = *m.created_.row(index);
+    if (created < created_after_ || created >= created_before_) return false;
+    uint64_t tags = *m.tags_.row(index);
+    if ((tags & tags_all_) != tags_all_) return false;
+    return tags_any_ == 0 || (tags & tags_any_) != 0;
+}
+
+bool MemoryMetadata::Selection::mask(size_t begin, size_t count, uint64_t* bits) const {
+    size_t words = (count + 63) / 64;
+    if (impossible_) {
+        std::fill(bits, bits + words, 0);
+        return false;
+    }
+    if (unrestricted_) {
+        std::fill(bits, bits + words, ~uint64_t{0});
+        return count > 0;
+    }
+    bool any = false;
+    if (only_retired_) {
+        // 只需排除被整合替换的行：直接取反位图，不逐行判断
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t word = ~retired_word(begin + w * 64);
+            size_t valid = std::min<size_t>(64, count - w * 64);
+            if (valid < 64) word &= (uint64_t{1} << valid) - 1;
+            bits[w] = word;
+            any |= word != 0;
+        }
+        return any;
+    }
+    for (size_t w = 0; w < words; ++w) {
+        uint64_t word = 0;
+        size_t first = w * 64;
+        size_t last = std::min(first + 64, count);
+        for (size_t i = first; i < last; ++i) {
+            word |= static_cast<uint64_t>(matches(begin + i)) << (i - first);
+        }
+        bits[w] = word;
+        any |= word != 0;
+    }
+    return any;
+}
+
+// ==================== MemoryMetadata ====================
+
+MemoryMetadata::MemoryMetadata(const Weights& weights) : weights_(weights) {
+    labels_.emplace_back();
+    label_ids_.emplace(std::string(), 0);
+    session_rows_.resize(1);
+    character_rows_.resize(1);
+}
+
+uint32_t MemoryMetadata::intern(const std::string& label) {
+    auto it = label_ids_.find(label);
+    if (it != label_ids_.end()) return it->second;
+    uint32_t id = static_cast<uint32_t>(labels_.size());
+    labels_.push_back(label);
+    label_ids_.emplace(label, id);
+    session_rows_.emplace_back();
+    character_rows_.emplace_back();
+    return id;
+}
+
+uint32_t MemoryMetadata::find_label(const std::string& label) const {
+    auto it = label_ids_.find(label);
+    return it == label_ids_.end() ? 0 : it->second;
+}
+
+void MemoryMetadata::index_row(size_t index, uint32_t session, uint32_t character) {
+    if (session >= labels_.size() || character >= labels_.size()) {
+        throw std::runtime_error("记忆元数据引用了不存在的标签编号");
+    }
+    if (session != 0) session_rows_[session].push_back(static_cast<uint32_t>(index));
+    if (character != 0) character_rows_[character].push_back(static_cast<uint32_t>(index));
+}
+
+MemoryMetadata::Selection MemoryMetadata::select(const MemoryFilter& filter) const {
+    Selection selection;
+    selection.metadata_ = this;
+    selection.session_ = filter.session.empty() ? 0 : find_label(filter.session);
+    selection.character_ = filter.character.empty() ? 0 : find_label(filter.character);
+    selection.created_after_ = filter.created_after;
+    selection.created_before_ = filter.created_before;
+    selection.tags_all_ = filter.tags_all;
+    selection.tags_any_ = filter.tags_any;
+    selection.unrestricted_ = filter.session.empty() && filter.character.empty()
+                              && filter.created_after == std::numeric_limits<int64_t>::min()
+                              && filter.created_before == std::numeric_limits<int64_t>::max()
+                              && filter.tags_all == 0 && filter.tags_any == 0;
+
+    // 会话/角色条件先缩小到对应的行表，两者都有时取较短的一份，另一项逐行判断
+    if (selection.session_ != 0) {
+        selection.candidates_ = &session_rows_[selection.session_];
+    }
+    if (selection.character_ != 0 && (!selection.candidates_
+                                       || character_rows_[selection.character_].size() < selection.candidates_->size())) {
+        selection.candidates_ = &character_rows_[selection.character_];
+    }
+    selection.impossible_ = (!filter.session.empty() && selection.session_ == 0)
+                            || (!filter.character.empty() && selection.character_ == 0)
+                            || (selection.candidates_ && selection.candidates_->empty())
+                            || filter.created_after >= filter.created_before;
+    if (retired_count_ > 0 && selection.unrestricted_) {
+        selection.unrestricted_ = false;
+        selection.only_retired_ = true;
+    }
+    return selection;
+}
+
+int64_t MemoryMetadata::now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void MemoryMetadata::append(const Row& row) {
+    index_row(size(), row.session, row.character);
+    created_.append(&row.created);
+    importance_.append(&row.importance);
+    tags_.append(&row.tags);
+    session_.append(&row.session);
+    character_.append(&row.character);
+    last_access_.push_back(row.last_access);
+    access_count_.push_back(row.access_count);
+    merge_count_.push_back(row.merge_count);
+}
+
+void MemoryMetadata::append(const Attributes& attributes) {
+    append(Row{attributes.created, attributes.created, 0, attributes.importance, attributes.tags,
+               intern(attributes.session), intern(attributes.character)});
+}
+
+void MemoryMetadata::appendFrom(const MemoryMetadata& other, size_t index) {
+    Row copy = other.row(index);
+    copy.session = intern(other.labels_[copy.session]);
+    copy.character = intern(other.labels_[copy.character]);
+    append(copy);
+}
+
+MemoryMetadata::Row MemoryMetadata::row(size_t index) const {
+    return {*created_.row(index), last_access_[index], access_count_[index], *importance_.row(index),
+            *tags_.row(index), *session_.row(index), *character_.row(index), merge_count_[index]};
+}
+
+MemoryMetadata::Attributes MemoryMetadata::attributes(size_t index) const {
+    Attributes attributes;
+    attributes.created = *created_.row(index);
+    attributes.importance = *importance_.row(index);
+    attributes.tags = *tags_.row(index);
+    attributes.session = labels_[*session_.row(index)];
+    attributes.character = labels_[*character_.row(index)];
+    return attributes;
+}
+
+void MemoryMetadata::clear() {
+    created_.clear();
+    importance_.clear();
+    tags_.clear();
+    session_.clear();
+    character_.clear();
+    last_access_.clear();
+    access_count_.clear();
+    merge_count_.clear();
+    retired_bits_.clear();
+    retired_count_ = 0;
+    for (auto& rows : session_rows_) rows.clear();
+    for (auto& rows : character_rows_) rows.clear();
+}
+
+void MemoryMetadata::touch(size_t index, int64_t when) {
+    if (index >= last_access_.size()) return;
+    last_access_[index] = std::max(last_access_[index], when);
+    ++access_count_[index];
+}
+
+void MemoryMetadata::setAccess(size_t index, int64_t last_access, uint32_t access_count) {
+    if (index >= last_access_.size()) return;
+    last_access_[index] = last_access;
+    access_count_[index] = access_count;
+}
+
+void MemoryMetadata::merge(size_t index) {
+    if (index >= merge_count_.size()) return;
+    ++merge_count_[index];
+}
+
+void MemoryMetadata::setMergeCount(size_t index, uint32_t merge_count) {
+    if (index >= merge_count_.size()) return;
+    merge_count_[index] = merge_count;
+}
+
+void MemoryMetadata::retire(size_t index) {
+    if (index >= size() || retired(index)) return;
+    if (index / 64 >= retired_bits_.size()) {
+        retired_bits_.resize(index / 64 + 1, 0);
+    }
+    retired_bits_[index / 64] |= uint64_t{1} << (index % 64);
+    ++retired_count_;
+}
+
+bool MemoryMetadata::retired(size_t index) const {
+    return index / 64 < retired_bits_.size() && ((retired_bits_[index / 64] >> (index % 64)) & 1u) != 0;
+}
+
+float MemoryMetadata::bonus(size_t index, int64_t when) const {
+    float hours = static_cast<float>(std::max<int64_t>(when - last_access_[index], 0)) / 3600.0f;
+    return weights_.recency * std::exp2(-hours / weights_.half_life_hours)
+           + weights_.importance * *importance_.row(index);
+}
+
+void MemoryMetadata::bonuses(size_t begin, size_t count, int64_t when, float* out) const {
+    // 按块逐段计算，调用方在扫描同一段向量前调用，数据始终在缓存中
+    const float inv_half_life = 1.0f / (weights_.half_life_hours * 3600.0f);
+    const int64_t* last_access = last_access_.data() + begin;
+    importance_.for_each_block(begin, begin + count, [&](size_t first, const float* importance, size_t rows) {
+        float* dst = out + (first - begin);
+        const int64_t* accessed = last_access + (first - begin);
+        for (size_t i = 0; i < rows; ++i) {
+            float age = static_cast<float>(std::max<int64_t>(when - accessed[i], 0));
+            dst[i] = weights_.recency * std::exp2(-age * inv_half_life) + weights_.importance * importance[i];
+        }
+    });
+}
+
+bool MemoryMetadata::attach(const MemoryStoreFile& store) {
+    clear();
+    size_t rows = store.count();
+    const auto* created = typed_section<int64_t>(store, MemoryStoreFile::CreatedAt, rows);
+    const auto* last_access = typed_section<int64_t>(store, MemoryStoreFile::LastAccess, rows);
+    const auto* access_count = typed_section<uint32_t>(store, MemoryStoreFile::AccessCount, rows);
+    const auto* importance = typed_section<float>(store, MemoryStoreFile::Importance, rows);
+    if (!created || !last_access || !access_count || !importance) {
+        return false;
+    }
+    created_.attach(created, rows);
+    importance_.attach(importance, rows);
+    last_access_.assign(last_access, last_access + rows);
+    access_count_.assign(access_count, access_count + rows);
+    // 合并次数是后来加入的分段，较早的文件没有它
+    const auto* merge_count = typed_section<uint32_t>(store, MemoryStoreFile::MergeCount, rows);
+    if (merge_count) {
+        merge_count_.assign(merge_count, merge_count + rows);
+    } else {
+        merge_count_.assign(rows, 0);
+    }
+
+    // 标签字典只增不减：文件中的字典总是内存中字典的前缀或扩展 (首次打开时内存中只有空标签)
+    size_t size = 0;
+    const char* data = static_cast<const char*>(store.section(MemoryStoreFile::Labels, &size));
+    std::string_view labels(data ? data : "", data ? size : 0);
+    for (uint32_t id = 1; !labels.empty(); ++id) {
+        std::string label;
+        if (!take_string(labels, label)) {
+            throw std::runtime_error("记忆库的标签字典分段已损坏");
+        }
+        if (id < labels_.size() ? labels_[id] != label : intern(label) != id) {
+            throw std::runtime_error("记忆库的标签字典与内存中的不一致");
+        }
+    }
+
+    const auto* tags = typed_section<uint64_t>(store, MemoryStoreFile::Tags, rows);
+    const auto* session = typed_section<uint32_t>(store, MemoryStoreFile::SessionIds, rows);
+    const auto* character = typed_section<uint32_t>(store, MemoryStoreFile::CharacterIds, rows);
+    if (tags && session && character) {
+        tags_.attach(tags, rows);
+        session_.attach(session, rows);
+        character_.attach(character, rows);
+        for (size_t i = 0; i < rows; ++i) {
+            index_row(i, session[i], character[i]);
+        }
+    } else {
+        // 引入会话/角色/标签之前写出的文件：所有行都不属于任何会话或角色
+        const uint64_t no_tags = 0;
+        const uint32_t no_label = 0;
+        for (size_t i = 0; i < rows; ++i) {
+            tags_.append(&no_tags);
+            session_.append(&no_label);
+            character_.append(&no_label);
+        }
+    }
+    return true;
+}
+
+void MemoryMetadata::writeSections(MemoryStoreWriter& writer, size_t rows, const std::vector<uint32_t>* keep) const {
+    writer.beginSection(MemoryStoreFile::CreatedAt);
+    created_.for_each_kept_block(rows, keep, [&](size_t, const int64_t* data, size_t count) {
+        writer.write(data, count * sizeof(int64_t));
+    });
+    writer.beginSection(MemoryStoreFile::LastAccess);
+    if (keep) {
+        for (uint32_t index : *keep) writer.write(&last_access_[index], sizeof(int64_t));
+    } else {
+        writer.write(last_access_.data(), rows * sizeof(int64_t));
+    }
+    writer.beginSection(MemoryStoreFile::AccessCount);
+    if (keep) {
+        for (uint32_t index : *keep) writer.write(&access_count_[index], sizeof(uint32_t));
+    } else {
+        writer.write(access_count_.data(), rows * sizeof(uint32_t));
+    }
+    writer.beginSection(MemoryStoreFile::MergeCount);
+    if (keep) {
+        for (uint32_t index : *keep) writer.write(&merge_count_[index], sizeof(uint32_t));
+    } else {
+        writer.write(merge_count_.data(), rows * sizeof(uint32_t));
+    }
+    writer.beginSection(MemoryStoreFile::Importance);
+    importance_.for_each_kept_block(rows, keep, [&](size_t, const float* data, size_t count) {
+        writer.write(data, count * sizeof(float));
+    });
+    writer.beginSection(MemoryStoreFile::Tags);
+    tags_.for_each_kept_block(rows, keep, [&](size_t, const uint64_t* data, size_t count) {
+        writer.write(data, count * sizeof(uint64_t));
+    });
+    writer.beginSection(MemoryStoreFile::SessionIds);
+    session_.for_each_kept_block(rows, keep, [&](size_t, const uint32_t* data, size_t count) {
+        writer.write(data, count * sizeof(uint32_t));
+    });
+    writer.beginSection(MemoryStoreFile::CharacterIds);
+    character_.for_each_kept_block(rows, keep, [&](size_t, const uint32_t* data, size_t count) {
+        writer.write(data, count * sizeof(uint32_t));
+    });
+    writer.beginSection(MemoryStoreFile::Labels);
+    for (size_t id = 1; id < labels_.size(); ++id) {
+        uint32_t length = static_cast<uint32_t>(labels_[id].size());
+        writer.write(&length, sizeof(length));
+        writer.write(labels_[id].data(), labels_[id].size());
+    }
+    writer.endSection();
+}
@@ -0,0 +1,337 @@
+#include "MemoryStoreFile.hpp"
+#include "FileUtil.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'L', 'I', 'N', 'G', 'M', 'E', 'M', '\0'};
+constexpr size_t kSectionAlignment = 64;
+
+// 文件头 (定长)，紧随其后的是 kMaxSections 个目录项
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dimension;
+    uint64_t count;
+    uint32_t section_count;
+    uint32_t reserved;
+};
+
+constexpr size_t kDirectoryEntrySize = 24;
+constexpr size_t kHeaderSize = sizeof(FileHeader) + MemoryStoreFile::kMaxSections * kDirectoryEntrySize;
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+std::string errno_text() {
+    return std::strerror(errno);
+}
+
+} // namespace
+
+// ==================== MemoryStoreFile ====================
+
+MemoryStoreFile::~MemoryStoreFile() {
+    close();
+}
+
+void MemoryStoreFile::close() {
+    if (base_) {
+        munmap(base_, mapped_size_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = -1;
+    base_ = nullptr;
+    mapped_size_ = 0;
+    path_.clear();
+    device_ = 0;
+    inode_ = 0;
+    dimension_ = 0;
+    count_ = 0;
+    sections_.clear();
+    summary_offsets_ = nullptr;
+    summary_heap_ = nullptr;
+}
+
+bool MemoryStoreFile::isStoreFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(kMagic)] = {};
+    if (!file.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+void MemoryStoreFile::open(const std::string& path) {
+    map_file(path);
+
+    // 校验三个必需分段的大小
+    size_t vectors_size = 0, offsets_size = 0, heap_size = 0;
+    const void* vectors_data = section(Vectors, &vectors_size);
+    summary_offsets_ = static_cast<const uint64_t*>(section(SummaryOffsets, &offsets_size));
+    summary_heap_ = static_cast<const char*>(section(SummaryHeap, &heap_size));
+    if (!vectors_data || !summary_offsets_ || !summary_heap_
+        || vectors_size != count_ * dimension_ * sizeof(float)
+        || offsets_size != (count_ + 1) * sizeof(uint64_t)
+        || summary_offsets_[count_] != heap_size) {
+        close();
+        throw std::runtime_error("记忆库文件 " + path + " 缺少必需的分段或分段大小不符。");
+    }
+}
+
+void MemoryStoreFile::openAuxiliary(const std::string& path) {
+    map_file(path);
+}
+
+void MemoryStoreFile::share(const MemoryStoreFile& other) {
+    if (this == &other) {
+        return;
+    }
+    close();
+    if (!other.isOpen()) {
+        return;
+    }
+    int fd = ::dup(other.fd_);
+    if (fd < 0) {
+        throw std::runtime_error("无法复制记忆库文件 " + other.path_ + " 的描述符: " + errno_text());
+    }
+    map_descriptor(fd, other.path_);
+    if (other.summary_offsets_) {
+        // 同一个文件在 other 打开时已经校验过必需分段
+        summary_offsets_ = static_cast<const uint64_t*>(section(SummaryOffsets, nullptr));
+        summary_heap_ = static_cast<const char*>(section(SummaryHeap, nullptr));
+    }
+}
+
+void MemoryStoreFile::map_file(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("无法打开记忆库文件 " + path + ": " + errno_text());
+    }
+    map_descriptor(fd, path);
+}
+
+void MemoryStoreFile::map_descriptor(int fd, const std::string& path) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("无法读取记忆库文件信息 " + path + ": " + errno_text());
+    }
+    size_t file_size = static_cast<size_t>(st.st_size);
+    if (file_size < sizeof(FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("记忆库文件 " + path + " 过小，可能已损坏。");
+    }
+    void* base = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        std::string error = errno_text();
+        ::close(fd);
+        throw std::runtime_error("无法映射记忆库文件 " + path + ": " + error);
+    }
+    fd_ = fd;
+    base_ = base;
+    mapped_size_ = file_size;
+    path_ = path;
+    device_ = st.st_dev;
+    inode_ = st.st_ino;
+
+    static_assert(sizeof(SectionEntry) == kDirectoryEntrySize, "目录项大小必须与文件格式一致");
+    const char* bytes = static_cast<const char*>(base_);
+    FileHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        close();
+        throw std::runtime_error("文件 " + path + " 不是记忆库文件。");
+    }
+    if (header.version != kVersion) {
+        close();
+        throw std::runtime_error("记忆库文件 " + path + " 的格式版本 (" + std::to_string(header.version)
+                                 + ") 不受支持。");
+    }
+    // 目录项数以文件头为准 (旧文件预留的目录较小)，只要求目录本身落在文件范围内
+    if (header.section_count > kMaxSections || sizeof(FileHeader) + header.section_count * kDirectoryEntrySize > file_size) {
+        close();
+        throw std::runtime_error("记忆库文件 " + path + " 的分段目录已损坏。");
+    }
+
+    for (uint32_t i = 0; i < header.section_count; ++i) {
+        SectionEntry entry;
+        std::memcpy(&entry, bytes + sizeof(FileHeader) + i * kDirectoryEntrySize, sizeof(entry));
+        if (entry.offset > file_size || entry.size > file_size - entry.offset) {
+            close();
+            throw std::runtime_error("记忆库文件 " + path + " 的分段越界，可能已损坏。");
+        }
+        sections_.push_back(entry);
+    }
+    dimension_ = header.dimension;
+    count_ = header.count;
+}
+
+const float* MemoryStoreFile::vectors() const {
+    return static_cast<const float*>(section(Vectors, nullptr));
+}
+
+std::string_view MemoryStoreFile::summary(size_t index) const {
+    uint64_t begin = summary_offsets_[index];
+    uint64_t end = summary_offsets_[index + 1];
+    return std::string_view(summary_heap_ + begin, end - begin);
+}
+
+uint64_t MemoryStoreFile::walCheckpoint() const {
+    size_t size = 0;
+    const void* data = section(WalCheckpoint, &size);
+    if (!data || size != sizeof(uint64_t)) {
+        return 0;
+    }
+    uint64_t checkpoint;
+    std::memcpy(&checkpoint, data, sizeof(checkpoint));
+    return checkpoint;
+}
+
+const void* MemoryStoreFile::section(uint32_t id, size_t* size) const {
+    for (const auto& entry : sections_) {
+        if (entry.id == id) {
+            if (size) *size = entry.size;
+            return static_cast<const char*>(base_) + entry.offset;
+        }
+    }
+    if (size) *size = 0;
+    return nullptr;
+}
+
+bool MemoryStoreFile::patch(uint32_t id, size_t element_size, const std::vector<size_t>& indices,
+                            const void* values) const {
+    const SectionEntry* target = nullptr;
+    for (const auto& entry : sections_) {
+        if (entry.id == id) target = &entry;
+    }
+    if (!target || target->size != count_ * element_size) {
+        return false;
+    }
+    int fd = ::open(path_.c_str(), O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_dev == device_ && st.st_ino == inode_;
+    const char* data = static_cast<const char*>(values);
+    for (size_t i = 0; ok && i < indices.size(); ++i) {
+        ok = indices[i] < count_
+             && pwrite(fd, data + i * element_size, element_size,
+                       static_cast<off_t>(target->offset + indices[i] * element_size))
+                    == static_cast<ssize_t>(element_size);
+    }
+    ::close(fd);
+    return ok;
+}
+
+// ==================== MemoryStoreWriter ====================
+
+MemoryStoreWriter::MemoryStoreWriter(const std::string& path, size_t dimension, size_t count)
+    : path_(path), temp_path_(path + ".tmp"), dimension_(dimension), count_(count)
+{
+    fd_ = ::open(temp_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("无法创建记忆库临时文件 " + temp_path_ + ": " + errno_text());
+    }
+    buffer_.reserve(1 << 20);
+    // 先为文件头和目录预留空间，commit 时再回填
+    buffer_.assign(kHeaderSize, 0);
+    position_ = kHeaderSize;
+}
+
+MemoryStoreWriter::~MemoryStoreWriter() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    if (!committed_) {
+        ::unlink(temp_path_.c_str());
+    }
+}
+
+void MemoryStoreWriter::write_fully(const char* data, size_t bytes) {
+    FileUtil::writeFully(fd_, data, bytes, "记忆库文件");
+}
+
+void MemoryStoreWriter::flush() {
+    write_fully(buffer_.data(), buffer_.size());
+    buffer_.clear();
+}
+
+void MemoryStoreWriter::write(const void* data, size_t bytes) {
+    const char* chars = static_cast<const char*>(data);
+    if (buffer_.size() + bytes > buffer_.capacity()) {
+        flush();
+    }
+    if (bytes >= buffer_.capacity()) {
+        // 大块数据直接写入，不经过缓冲区
+        write_fully(chars, bytes);
+    } else {
+        buffer_.insert(buffer_.end(), chars, chars + bytes);
+    }
+    position_ += bytes;
+}
+
+void MemoryStoreWriter::beginSection(uint32_t id) {
+    if (in_section_) endSection();
+    if (sections_.size() >= MemoryStoreFile::kMaxSections) {
+        throw std::runtime_error("记忆库文件的分段数量超过上限。");
+    }
+    // 每个分段从64字节边界开始，映射后可以直接作为对齐的数组使用
+    uint64_t aligned = align_up(position_, kSectionAlignment);
+    static const char zeros[kSectionAlignment] = {};
+    write(zeros, aligned - position_);
+    sections_.push_back({id, 0, position_, 0});
+    in_section_ = true;
+}
+
+void MemoryStoreWriter::endSection() {
+    if (!in_section_) return;
+    sections_.back().size = position_ - sections_.back().offset;
+    in_section_ = false;
+}
+
+void MemoryStoreWriter::commit() {
+    endSection();
+    flush();
+
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = MemoryStoreFile::kVersion;
+    header.dimension = static_cast<uint32_t>(dimension_);
+    header.count = count_;
+    header.section_count = static_cast<uint32_t>(sections_.size());
+
+    std::vector<char> head(kHeaderSize, 0);
+    std::memcpy(head.data(), &header, sizeof(header));
+    for (size_t i = 0; i < sections_.size(); ++i) {
+        std::memcpy(head.data() + sizeof(FileHeader) + i * kDirectoryEntrySize, &sections_[i], kDirectoryEntrySize);
+    }
+    if (pwrite(fd_, head.data(), head.size(), 0) != static_cast<ssize_t>(head.size())) {
+        throw std::runtime_error("写入记忆库文件头失败: " + errno_text());
+    }
+    if (fsync(fd_) != 0) {
+        throw std::runtime_error("记忆库文件落盘失败: " + errno_text());
+    }
+    ::close(fd_);
+    fd_ = -1;
+    if (std::rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error("无法用新文件替换记忆库 " + path_ + ": " + errno_text());
+    }
+    FileUtil::fsyncParentDir(path_);
+    committed_ = true;
+}
@@ -0,0 +1,103 @@
+#include "PromptTemplate.hpp"
+#include "Logger.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+PromptTemplate::PromptTemplate(std::string path)
+    : path_(std::move(path)), compiled_(compile("")) {}
+
+std::shared_ptr<const PromptTemplate::Compiled> PromptTemplate::compile(const std::string& text) {
+    struct Placeholder {
+        std::string_view token;
+        Slot slot;
+    };
+    static const Placeholder placeholders[] = {
+        {"[CONVERSATION_MEMORY]", Slot::Memory},
+        {"[SCENE]", Slot::Scene},
+        {"[TIME]", Slot::Time},
+        {"[CHARACTER_NAME]", Slot::Character},
+    };
+    auto compiled = std::make_shared<Compiled>();
+    size_t offset = 0;
+    while (true) {
+        // 取最靠前的一个占位符
+        size_t found = std::string::npos;
+        const Placeholder* match = nullptr;
+        for (const auto& placeholder : placeholders) {
+            size_t pos = text.find(placeholder.token.data(), offset, placeholder.token.size());
+            if (pos < found) {
+                found = pos;
+                match = &placeholder;
+            }
+        }
+        if (!match) {
+            compiled->parts.push_back({text.substr(offset), Slot::None});
+            compiled->literal_bytes += text.size() - offset;
+            return compiled;
+        }
+        compiled->parts.push_back({text.substr(offset, found - offset), match->slot});
+        compiled->literal_bytes += found - offset;
+        offset = found + match->token.size();
+    }
+}
+
+std::shared_ptr<const PromptTemplate::Compiled> PromptTemplate::current() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    if (path_.empty() || now < next_check_) {
+        return compiled_;
+    }
+    next_check_ = now + kReloadCheckInterval;
+
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(path_, ec);
+    if (ec) {
+        if (!missing_logged_) {
+            Logger::logError("无法读取系统提示词文件 " + path_ + ": " + ec.message());
+            missing_logged_ = true;
+        }
+        return compiled_;
+    }
+    missing_logged_ = false;
+    if (mtime == mtime_) {
+        return compiled_;
+    }
+    std::ifstream file(path_, std::ios::binary);
+    if (!file) {
+        return compiled_;
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    compiled_ = compile(text);
+    if (mtime_ != std::filesystem::file_time_type{}) {
+        Logger::logInfo("系统提示词文件 " + path_ + " 已修改，已重新加载。");
+    }
+    mtime_ = mtime;
+    return compiled_;
+}
+
+std::string PromptTemplate::render(const Values& values) {
+    std::shared_ptr<const Compiled> compiled = current();
+    auto value_of = [&values](Slot slot) {
+        switch (slot) {
+        case Slot::Memory: return values.memory;
+        case Slot::Scene: return values.scene;
+        case Slot::Time: return values.time;
+        case Slot::Character: return values.character;
+        case Slot::None: break;
+        }
+        return std::string_view();
+    };
+    size_t size = compiled->literal_bytes;
+    for (const auto& part : compiled->parts) {
+        size += value_of(part.slot).size();
+    }
+    std::string prompt;
+    prompt.reserve(size);
+    for (const auto& part : compiled->parts) {
+        prompt += part.literal;
+        prompt += value_of(part.slot);
+    }
+    return prompt;
+}
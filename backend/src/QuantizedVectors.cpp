@@ -0,0 +1,142 @@
+#include "QuantizedVectors.hpp"
+#include "MemoryStoreFile.hpp"
+#include "VectorMath.hpp"
+#include <algorithm>
+
+QuantizedVectors::QuantizedVectors(Mode mode, size_t dimension)
+    : mode_(mode), dimension_(dimension),
+      int8_codes_(dimension), int8_scales_(1), half_codes_(dimension) {}
+
+QuantizedVectors::Mode QuantizedVectors::parseMode(const std::string& value) {
+    std::string lower = value;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    if (lower == "int8") return Mode::Int8;
+    if (lower == "fp16") return Mode::Fp16;
+    return Mode::None;
+}
+
+const char* QuantizedVectors::modeName(Mode mode) {
+    switch (mode) {
+        case Mode::Int8: return "int8";
+        case Mode::Fp16: return "fp16";
+        default: return "none";
+    }
+}
+
+size_t QuantizedVectors::bytesPerRow() const {
+    switch (mode_) {
+        case Mode::Int8: return dimension_ * sizeof(int8_t) + sizeof(float);
+        case Mode::Fp16: return dimension_ * sizeof(uint16_t);
+        default: return 0;
+    }
+}
+
+size_t QuantizedVectors::size() const {
+    switch (mode_) {
+        case Mode::Int8: return int8_scales_.rows();
+        case Mode::Fp16: return half_codes_.rows();
+        default: return 0;
+    }
+}
+
+void QuantizedVectors::append(const float* row) {
+    if (mode_ == Mode::Int8) {
+        float scale = VectorMath::quantizeInt8(row, int8_codes_.append_row(), dimension_);
+        int8_scales_.append(&scale);
+    } else if (mode_ == Mode::Fp16) {
+        uint16_t* codes = half_codes_.append_row();
+        for (size_t i = 0; i < dimension_; ++i) {
+            codes[i] = VectorMath::floatToHalf(row[i]);
+        }
+    }
+}
+
+void QuantizedVectors::clear() {
+    int8_codes_.clear();
+    int8_scales_.clear();
+    half_codes_.clear();
+}
+
+bool QuantizedVectors::attach(const MemoryStoreFile& store) {
+    clear();
+    size_t rows = store.count();
+    if (mode_ == Mode::Int8) {
+        size_t codes_size = 0, scales_size = 0;
+        const void* codes = store.section(MemoryStoreFile::Int8Codes, &codes_size);
+        const void* scales = store.section(MemoryStoreFile::Int8Scales, &scales_size);
+        if (!codes || !scales || codes_size != rows * dimension_ || scales_size != rows * sizeof(float)) {
+            return false;
+        }
+        int8_codes_.attach(static_cast<const int8_t*>(codes), rows);
+        int8_scales_.attach(static_cast<const float*>(scales), rows);
+        return true;
+    }
+    if (mode_ == Mode::Fp16) {
+        size_t codes_size = 0;
+        const void* codes = store.section(MemoryStoreFile::HalfCodes, &codes_size);
+        if (!codes || codes_size != rows * dimension_ * sizeof(uint16_t)) {
+            return false;
+        }
+        half_codes_.attach(static_cast<const uint16_t*>(codes), rows);
+        return true;
+    }
+    return false;
+}
+
+void QuantizedVectors::writeSections(MemoryStoreWriter& writer, size_t rows, const std::vector<uint32_t>* keep) const {
+    if (mode_ == Mode::Int8) {
+        writer.beginSection(MemoryStoreFile::Int8Codes);
+        int8_codes_.for_each_kept_block(rows, keep, [&](size_t, const int8_t* data, size_t count) {
+            writer.write(data, count * dimension_);
+        });
+        writer.beginSection(MemoryStoreFile::Int8Scales);
+        int8_scales_.for_each_kept_block(rows, keep, [&](size_t, const float* data, size_t count) {
+            writer.write(data, count * sizeof(float));
+        });
+        writer.endSection();
+    } else if (mode_ == Mode::Fp16) {
+        writer.beginSection(MemoryStoreFile::HalfCodes);
+        half_codes_.for_each_kept_block(rows, keep, [&](size_t, const uint16_t* data, size_t count) {
+            writer.write(data, count * dimension_ * sizeof(uint16_t));
+        });
+        writer.endSection();
+    }
+}
+
+QuantizedVectors::Query QuantizedVectors::encodeQuery(const float* query) const {
+    Query encoded;
+    encoded.values = query;
+    if (mode_ == Mode::Int8) {
+        encoded.codes.resize(dimension_);
+        encoded.scale = VectorMath::quantizeInt8(query, encoded.codes.data(), dimension_);
+    }
+    return encoded;
+}
+
+void QuantizedVectors::scan(const Query& query, size_t begin, size_t end, TopK& selector, const float* bias,
+                            const uint64_t* mask) const {
+    auto adjust = [&](size_t index) { return bias ? bias[index - begin] : 0.0f; };
+    auto skipped = [&](size_t index) {
+        size_t offset = index - begin;
+        return mask && !((mask[offset / 64] >> (offset % 64)) & 1);
+    };
+    if (mode_ == Mode::Int8) {
+        int8_codes_.for_each_block(begin, end, [&](size_t first, const int8_t* codes, size_t count) {
+            const float* scales = int8_scales_.row(first);
+            for (size_t i = 0; i < count; ++i) {
+                if (skipped(first + i)) continue;
+                int32_t raw = VectorMath::dotInt8(query.codes.data(), codes + i * dimension_, dimension_);
+                selector.push(static_cast<float>(raw) * query.scale * scales[i] + adjust(first + i), first + i);
+            }
+        });
+    } else if (mode_ == Mode::Fp16) {
+        half_codes_.for_each_block(begin, end, [&](size_t first, const uint16_t* codes, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                if (skipped(first + i)) continue;
+                selector.push(VectorMath::dotHalf(query.values, codes + i * dimension_, dimension_) + adjust(first + i),
+                              first + i);
+            }
+        });
+    }
+}
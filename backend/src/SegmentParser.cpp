@@ -0,0 +1,114 @@
+#include "SegmentParser.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// "【" 与 "】" 的UTF-8编码只有第三个字节不同
+constexpr unsigned char kBracketLead = 0xE3;
+constexpr unsigned char kBracketMid = 0x80;
+constexpr unsigned char kOpenBracketLast = 0x90;
+constexpr char kCloseBracket[] = "\xE3\x80\x91";
+constexpr size_t kBracketBytes = 3;
+
+constexpr const char* kWhitespace = " \t\n\r\f\v";
+
+std::string_view trimmed(std::string_view text) {
+    size_t first = text.find_first_not_of(kWhitespace);
+    if (first == std::string_view::npos) return {};
+    size_t last = text.find_last_not_of(kWhitespace);
+    return text.substr(first, last - first + 1);
+}
+
+bool ends_with_close_bracket(const std::string& text) {
+    return text.size() >= kBracketBytes
+           && text.compare(text.size() - kBracketBytes, kBracketBytes, kCloseBracket) == 0;
+}
+
+} // namespace
+
+size_t SegmentParser::feed(std::string_view text, const Callback& on_segment) {
+    size_t emitted = 0;
+    for (char c : text) {
+        const unsigned char byte = static_cast<unsigned char>(c);
+        if (state_ != State::Seek && (c == '\n' || c == '\r')) {
+            // 正则中的 '.' 不匹配换行：这一句作废，从换行之后重新寻找
+            state_ = State::Seek;
+            marker_ = 0;
+            continue;
+        }
+        switch (state_) {
+        case State::Seek:
+            if (marker_ == 1 && byte == kBracketMid) {
+                marker_ = 2;
+            } else if (marker_ == 2 && byte == kOpenBracketLast) {
+                marker_ = 0;
+                expression_.clear();
+                state_ = State::Expression;
+            } else {
+                marker_ = byte == kBracketLead ? 1 : 0;
+            }
+            break;
+        case State::Expression:
+            expression_.push_back(c);
+            // 与 ".+?" 一致：表情至少一个字符，紧跟在 "【" 之后的 "】" 算作表情的内容
+            if (expression_.size() > kBracketBytes && ends_with_close_bracket(expression_)) {
+                expression_.resize(expression_.size() - kBracketBytes);
+                middle_.clear();
+                state_ = State::Middle;
+            }
+            break;
+        case State::Middle:
+            if (c == '<' && !middle_.empty()) {
+                japanese_.clear();
+                state_ = State::Japanese;
+            } else {
+                middle_.push_back(c);
+            }
+            break;
+        case State::Japanese:
+            if (c == '>' && !japanese_.empty()) {
+                emit(on_segment);
+                ++emitted;
+                state_ = State::Seek;
+            } else {
+                japanese_.push_back(c);
+            }
+            break;
+        }
+    }
+    return emitted;
+}
+
+void SegmentParser::reset() {
+    state_ = State::Seek;
+    marker_ = 0;
+}
+
+void SegmentParser::emit(const Callback& on_segment) {
+    segment_.expression.assign(trimmed(expression_));
+    segment_.text_jp.assign(trimmed(japanese_));
+
+    // 与正则 "\((.+?)\)" 一致：第一对非空括号中的内容作为动作，所有非空括号部分从台词中去掉
+    std::string_view middle = trimmed(middle_);
+    segment_.action.clear();
+    segment_.text_cn.clear();
+    bool found = false;
+    size_t copied = 0;
+    for (size_t open = middle.find('('); open != std::string_view::npos; open = middle.find('(', copied)) {
+        size_t close = middle.find(')', open + 2);
+        if (close == std::string_view::npos) break;
+        if (!found) {
+            segment_.action.assign(trimmed(middle.substr(open + 1, close - open - 1)));
+            found = true;
+        }
+        segment_.text_cn.append(middle.substr(copied, open - copied));
+        copied = close + 1;
+    }
+    segment_.text_cn.append(middle.substr(copied));
+    // 去掉括号后两端可能留下空白
+    std::string& text_cn = segment_.text_cn;
+    text_cn.erase(std::min(text_cn.size(), text_cn.find_last_not_of(kWhitespace) + 1));
+    text_cn.erase(0, std::min(text_cn.size(), text_cn.find_first_not_of(kWhitespace)));
+    on_segment(segment_);
+}
@@ -0,0 +1,101 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace {
+
+// 一次 run() 调用的共享状态：任务按编号原子领取，先领完的线程直接退出。
+// 排在队列里的协助者可能在 run() 返回之后才被取出，因此状态由 shared_ptr 持有
+struct Batch {
+    std::function<void(size_t)> task;
+    size_t count = 0;
+    std::atomic<size_t> next{0};
+    size_t finished = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable done;
+
+    void work() {
+        size_t completed = 0;
+        std::exception_ptr failure;
+        for (size_t index; (index = next.fetch_add(1)) < count;) {
+            try {
+                task(index);
+            } catch (...) {
+                if (!failure) failure = std::current_exception();
+            }
+            ++completed;
+        }
+        if (completed == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (failure && !error) error = failure;
+        finished += completed;
+        if (finished == count) done.notify_all();
+    }
+};
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t workers) {
+    workers_.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        auto job = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+    auto batch = std::make_shared<Batch>();
+    batch->task = task;
+    batch->count = count;
+
+    // 调用线程自己也领取任务，所以最多只需要 count - 1 个协助者
+    size_t helpers = std::min(workers_.size(), count - 1);
+    if (helpers > 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < helpers; ++i) {
+                queue_.emplace_back([batch] { batch->work(); });
+            }
+        }
+        helpers == 1 ? cv_.notify_one() : cv_.notify_all();
+    }
+    batch->work();
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->done.wait(lock, [&] { return batch->finished == batch->count; });
+    if (batch->error) {
+        std::rethrow_exception(batch->error);
+    }
+}
@@ -0,0 +1,508 @@
+#include "VectorMath.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VECTOR_MATH_X86 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VECTOR_MATH_NEON 1
+#endif
+
+namespace {
+
+using DotFn = float (*)(const float*, const float*, size_t);
+using DotInt8Fn = int32_t (*)(const int8_t*, const int8_t*, size_t);
+using DotHalfFn = float (*)(const float*, const uint16_t*, size_t);
+using Dot4Fn = void (*)(const float*, size_t, const float*, size_t, float*);
+
+// === IEEE 754 半精度与单精度之间的标量转换 ===
+uint16_t float_to_half(float value) {
+    uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000u;
+    uint32_t mantissa = x & 0x7FFFFFu;
+    int32_t exponent = static_cast<int32_t>((x >> 23) & 0xFFu);
+
+    if (exponent == 0xFF) {
+        return static_cast<uint16_t>(sign | 0x7C00u | (mantissa ? 0x200u : 0u)); // Inf / NaN
+    }
+    int32_t half_exponent = exponent - 127 + 15;
+    if (half_exponent >= 0x1F) {
+        return static_cast<uint16_t>(sign | 0x7C00u); // 上溢为无穷大
+    }
+    if (half_exponent <= 0) {
+        // 结果为非规格化数 (或下溢为0)
+        if (half_exponent < -10) return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - half_exponent);
+        uint32_t half_mantissa = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half_mantissa & 1u))) ++half_mantissa;
+        return static_cast<uint16_t>(sign | half_mantissa);
+    }
+    uint32_t half = sign | (static_cast<uint32_t>(half_exponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFFu;
+    // 就近舍入到偶数；尾数进位溢出时会自然进位到指数位
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) ++half;
+    return static_cast<uint16_t>(half);
+}
+
+float half_to_float(uint16_t half) {
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+    uint32_t x;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            x = sign;
+        } else {
+            // 非规格化数：左移尾数直到出现隐含的1
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400u)) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            x = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+        }
+    } else if (exponent == 0x1F) {
+        x = sign | 0x7F800000u | (mantissa << 13);
+    } else {
+        x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &x, sizeof(value));
+    return value;
+}
+
+// === 标量回退实现 ===
+// 使用4路独立累加器，避免每次乘加都等待上一次的结果
+float dot_scalar(const float* a, const float* b, size_t n) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; ++i) {
+        s0 += a[i] * b[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+// 4个查询共用 b 的每个元素：b 只读取一次，4路累加器互不依赖
+void dot4_scalar(const float* a, size_t stride, const float* b, size_t n, float* out) {
+    const float* a0 = a;
+    const float* a1 = a + stride;
+    const float* a2 = a + 2 * stride;
+    const float* a3 = a + 3 * stride;
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float v = b[i];
+        s0 += a0[i] * v;
+        s1 += a1[i] * v;
+        s2 += a2[i] * v;
+        s3 += a3[i] * v;
+    }
+    out[0] = s0;
+    out[1] = s1;
+    out[2] = s2;
+    out[3] = s3;
+}
+
+int32_t dot_int8_scalar(const int8_t* a, const int8_t* b, size_t n) {
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return sum;
+}
+
+float dot_half_scalar(const float* a, const uint16_t* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        sum += a[i] * half_to_float(b[i]);
+    }
+    return sum;
+}
+
+#if defined(VECTOR_MATH_X86)
+// === x86: AVX2 + FMA ===
+__attribute__((target("avx2,fma")))
+float dot_avx2(const float* a, const float* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+    __m128 lo = _mm256_castps256_ps128(acc);
+    __m128 hi = _mm256_extractf128_ps(acc, 1);
+    __m128 sum = _mm_add_ps(lo, hi);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    float result = _mm_cvtss_f32(sum);
+    for (; i < n; ++i) {
+        result += a[i] * b[i];
+    }
+    return result;
+}
+
+// 4个查询对同一行：每段 b 只加载一次，分别与4个查询相乘累加；最后用 hadd 一次规约出4个结果
+__attribute__((target("avx2,fma")))
+void dot4_avx2(const float* a, size_t stride, const float* b, size_t n, float* out) {
+    const float* a0 = a;
+    const float* a1 = a + stride;
+    const float* a2 = a + 2 * stride;
+    const float* a3 = a + 3 * stride;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vb = _mm256_loadu_ps(b + i);
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a0 + i), vb, acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a1 + i), vb, acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a2 + i), vb, acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a3 + i), vb, acc3);
+    }
+    __m256 pairs = _mm256_hadd_ps(_mm256_hadd_ps(acc0, acc1), _mm256_hadd_ps(acc2, acc3));
+    __m128 sums = _mm_add_ps(_mm256_castps256_ps128(pairs), _mm256_extractf128_ps(pairs, 1));
+    _mm_storeu_ps(out, sums);
+    for (; i < n; ++i) {
+        out[0] += a0[i] * b[i];
+        out[1] += a1[i] * b[i];
+        out[2] += a2[i] * b[i];
+        out[3] += a3[i] * b[i];
+    }
+}
+
+// === x86: AVX-512F ===
+__attribute__((target("avx512f")))
+float dot_avx512(const float* a, const float* b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    // 尾部用掩码加载，不足16个的元素补0
+    for (; i < n; i += 16) {
+        size_t remaining = n - i;
+        __mmask16 mask = remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);
+        acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), acc0);
+    }
+    // 手动规约为标量 (GCC 的 _mm512_reduce_add_ps 在 -Wall 下会产生未初始化告警)
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, _mm512_add_ps(acc0, acc1));
+    float result = 0.0f;
+    for (float lane : lanes) {
+        result += lane;
+    }
+    return result;
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+void dot4_avx512(const float* a, size_t stride, const float* b, size_t n, float* out) {
+    const float* a0 = a;
+    const float* a1 = a + stride;
+    const float* a2 = a + 2 * stride;
+    const float* a3 = a + 3 * stride;
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps();
+    __m512 acc3 = _mm512_setzero_ps();
+    for (size_t i = 0; i < n; i += 16) {
+        size_t remaining = n - i;
+        __mmask16 mask = remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);
+        __m512 vb = _mm512_maskz_loadu_ps(mask, b + i);
+        acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a0 + i), vb, acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a1 + i), vb, acc1);
+        acc2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a2 + i), vb, acc2);
+        acc3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a3 + i), vb, acc3);
+    }
+    // 经内存把每个512位累加器的高低两半相加 (理由同 dot_avx512 的规约)，再按AVX2的方式规约
+    alignas(64) float lanes[4][16];
+    _mm512_store_ps(lanes[0], acc0);
+    _mm512_store_ps(lanes[1], acc1);
+    _mm512_store_ps(lanes[2], acc2);
+    _mm512_store_ps(lanes[3], acc3);
+    __m256 halves[4];
+    for (int j = 0; j < 4; ++j) {
+        halves[j] = _mm256_add_ps(_mm256_load_ps(lanes[j]), _mm256_load_ps(lanes[j] + 8));
+    }
+    __m256 pairs = _mm256_hadd_ps(_mm256_hadd_ps(halves[0], halves[1]), _mm256_hadd_ps(halves[2], halves[3]));
+    _mm_storeu_ps(out, _mm_add_ps(_mm256_castps256_ps128(pairs), _mm256_extractf128_ps(pairs, 1)));
+}
+
+// === x86: int8 点积 (AVX2)，先符号扩展为16位，再用 madd 两两相乘相加为32位 ===
+__attribute__((target("avx2")))
+int32_t dot_int8_avx2(const int8_t* a, const int8_t* b, size_t n) {
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        __m256i b0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        __m256i a1 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 16)));
+        __m256i b1 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 16)));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(a0, b0));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(a1, b1));
+    }
+    __m256i acc = _mm256_add_epi32(acc0, acc1);
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    int32_t result = _mm_cvtsi128_si32(sum);
+    for (; i < n; ++i) {
+        result += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return result;
+}
+
+// === x86: float 与 fp16 的混合点积 (F16C 负责把半精度展开为单精度) ===
+__attribute__((target("avx2,fma,f16c")))
+float dot_half_avx2(const float* a, const uint16_t* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 b0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        __m256 b1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 8)));
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), b0, acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), b1, acc1);
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    float result = _mm_cvtss_f32(sum);
+    for (; i < n; ++i) {
+        result += a[i] * half_to_float(b[i]);
+    }
+    return result;
+}
+#endif
+
+#if defined(VECTOR_MATH_NEON)
+// === ARM: NEON (Termux 上的 aarch64 / armv7) ===
+float dot_neon(const float* a, const float* b, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    float32x4_t acc2 = vdupq_n_f32(0.0f);
+    float32x4_t acc3 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+#if defined(__aarch64__)
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc2 = vfmaq_f32(acc2, vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+        acc3 = vfmaq_f32(acc3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+#else
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc2 = vmlaq_f32(acc2, vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+        acc3 = vmlaq_f32(acc3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+#endif
+    }
+    float32x4_t acc = vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3));
+#if defined(__aarch64__)
+    float result = vaddvq_f32(acc);
+#else
+    float32x2_t pair = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    float result = vget_lane_f32(vpadd_f32(pair, pair), 0);
+#endif
+    for (; i < n; ++i) {
+        result += a[i] * b[i];
+    }
+    return result;
+}
+
+void dot4_neon(const float* a, size_t stride, const float* b, size_t n, float* out) {
+    const float* rows[4] = {a, a + stride, a + 2 * stride, a + 3 * stride};
+    float32x4_t acc[4] = {vdupq_n_f32(0.0f), vdupq_n_f32(0.0f), vdupq_n_f32(0.0f), vdupq_n_f32(0.0f)};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t vb = vld1q_f32(b + i);
+        for (int j = 0; j < 4; ++j) {
+#if defined(__aarch64__)
+            acc[j] = vfmaq_f32(acc[j], vld1q_f32(rows[j] + i), vb);
+#else
+            acc[j] = vmlaq_f32(acc[j], vld1q_f32(rows[j] + i), vb);
+#endif
+        }
+    }
+    for (int j = 0; j < 4; ++j) {
+#if defined(__aarch64__)
+        float result = vaddvq_f32(acc[j]);
+#else
+        float32x2_t pair = vadd_f32(vget_low_f32(acc[j]), vget_high_f32(acc[j]));
+        float result = vget_lane_f32(vpadd_f32(pair, pair), 0);
+#endif
+        for (size_t t = i; t < n; ++t) {
+            result += rows[j][t] * b[t];
+        }
+        out[j] = result;
+    }
+}
+
+// int8 点积：vmull_s8 得到16位乘积，vpadalq_s16 两两相加累积到32位
+int32_t dot_int8_neon(const int8_t* a, const int8_t* b, size_t n) {
+    int32x4_t acc = vdupq_n_s32(0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        int8x16_t va = vld1q_s8(a + i);
+        int8x16_t vb = vld1q_s8(b + i);
+        acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        acc = vpadalq_s16(acc, vmull_s8(vget_high_s8(va), vget_high_s8(vb)));
+    }
+#if defined(__aarch64__)
+    int32_t result = vaddvq_s32(acc);
+#else
+    int32_t result = vgetq_lane_s32(acc, 0) + vgetq_lane_s32(acc, 1) + vgetq_lane_s32(acc, 2) + vgetq_lane_s32(acc, 3);
+#endif
+    for (; i < n; ++i) {
+        result += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return result;
+}
+
+#if defined(__aarch64__)
+// fp16 展开指令 vcvt_f32_f16 只在 aarch64 上保证可用，armv7 回退到标量实现
+float dot_half_neon(const float* a, const uint16_t* b, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t b0 = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(b + i)));
+        float32x4_t b1 = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(b + i + 4)));
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), b0);
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), b1);
+    }
+    float result = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; ++i) {
+        result += a[i] * half_to_float(b[i]);
+    }
+    return result;
+}
+#endif
+#endif
+
+struct Kernels {
+    DotFn dot;
+    DotInt8Fn dot_int8;
+    DotHalfFn dot_half;
+    Dot4Fn dot4;
+    const char* name;
+};
+
+// 只在第一次使用时探测一次CPU特性
+Kernels select_kernels() {
+    Kernels kernels{dot_scalar, dot_int8_scalar, dot_half_scalar, dot4_scalar, "scalar"};
+#if defined(VECTOR_MATH_X86)
+    __builtin_cpu_init();
+    bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (has_avx2) {
+        kernels = {dot_avx2, dot_int8_avx2, dot_half_avx2, dot4_avx2, "avx2"};
+        // fp16 点积还需要 F16C (部分虚拟机隐藏了该特性)，否则保留标量实现
+        if (!__builtin_cpu_supports("f16c")) {
+            kernels.dot_half = dot_half_scalar;
+        }
+    }
+    if (has_avx2 && __builtin_cpu_supports("avx512f")) {
+        // int8/fp16 仍使用AVX2实现，只有float点积换成AVX-512
+        kernels.dot = dot_avx512;
+        kernels.dot4 = dot4_avx512;
+        kernels.name = "avx512";
+    }
+#elif defined(VECTOR_MATH_NEON)
+    kernels.dot = dot_neon;
+    kernels.dot4 = dot4_neon;
+    kernels.dot_int8 = dot_int8_neon;
+#if defined(__aarch64__)
+    kernels.dot_half = dot_half_neon;
+#endif
+    kernels.name = "neon";
+#endif
+    return kernels;
+}
+
+const Kernels& kernels() {
+    static const Kernels selected = select_kernels();
+    return selected;
+}
+
+} // namespace
+
+float VectorMath::dot(const float* a, const float* b, size_t n) {
+    return kernels().dot(a, b, n);
+}
+
+void VectorMath::dot4(const float* a, size_t stride, const float* b, size_t n, float* out) {
+    kernels().dot4(a, stride, b, n, out);
+}
+
+int32_t VectorMath::dotInt8(const int8_t* a, const int8_t* b, size_t n) {
+    return kernels().dot_int8(a, b, n);
+}
+
+float VectorMath::dotHalf(const float* a, const uint16_t* b, size_t n) {
+    return kernels().dot_half(a, b, n);
+}
+
+float VectorMath::quantizeInt8(const float* v, int8_t* codes, size_t n) {
+    float max_abs = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        max_abs = std::max(max_abs, std::fabs(v[i]));
+    }
+    if (max_abs == 0.0f || !std::isfinite(max_abs)) {
+        std::fill(codes, codes + n, static_cast<int8_t>(0));
+        return 0.0f;
+    }
+    float scale = max_abs / 127.0f;
+    float inv = 1.0f / scale;
+    for (size_t i = 0; i < n; ++i) {
+        float q = std::nearbyint(v[i] * inv);
+        codes[i] = static_cast<int8_t>(std::clamp(q, -127.0f, 127.0f));
+    }
+    return scale;
+}
+
+uint16_t VectorMath::floatToHalf(float value) {
+    return float_to_half(value);
+}
+
+float VectorMath::halfToFloat(uint16_t value) {
+    return half_to_float(value);
+}
+
+float VectorMath::normalize(float* v, size_t n) {
+    float norm = std::sqrt(dot(v, v, n));
+    if (norm > 0.0f && std::isfinite(norm)) {
+        float inv = 1.0f / norm;
+        for (size_t i = 0; i < n; ++i) {
+            v[i] *= inv;
+        }
+    }
+    return norm;
+}
+
+const char* VectorMath::kernelName() {
+    return kernels().name;
+}
@@ -1,28 +1,80 @@
 #include "WebSocketServer.hpp"
 #include "ConfigManager.hpp"
 #include "Logger.hpp"
+#include "SegmentParser.hpp"
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 #include <nlohmann/json.hpp>
 #include <unistd.h>
 #include <limits.h>
 #include <string>
 #include <vector>
-#include <regex>
 #include <chrono>
 #include <iomanip>
 #include <sstream>
 #include <fstream> 
 
-// 辅助函数：去除字符串首尾的空白字符
-static std::string trim_string(const std::string& s) {
-    const char* ws = " \t\n\r\f\v";
-    size_t first = s.find_first_not_of(ws);
-    if (std::string::npos == first) return "";
-    size_t last = s.find_last_not_of(ws);
-    return s.substr(first, (last - first + 1));
-}
+namespace {
+
+// 一次回复的语音合成队列：在单独的线程中按句子顺序调用合成接口，不阻塞回复的流式接收
+// (片段在cURL的写回调中解析出来，回调里等待合成会让LLM的响应停止读取)
+class SpeechQueue {
+public:
+    // on_ready(index, audio_url) 在合成线程中调用
+    explicit SpeechQueue(std::function<std::string(const std::string&)> synthesize,
+                         std::function<void(size_t, const std::string&)> on_ready)
+        : synthesize_(std::move(synthesize)), on_ready_(std::move(on_ready)),
+          thread_([this] { run(); }) {}
+
+    ~SpeechQueue() { finish(); }
+
+    void push(size_t index, const std::string& text_jp) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.emplace_back(index, text_jp);
+        cv_.notify_one();
+    }
+
+    // 合成完队列中剩余的句子后返回
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+            cv_.notify_one();
+        }
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this] { return done_ || !tasks_.empty(); });
+            if (tasks_.empty()) return;
+            auto task = std::move(tasks_.front());
+            tasks_.pop_front();
+            lock.unlock();
+            on_ready_(task.first, synthesize_(task.second));
+            lock.lock();
+        }
+    }
+
+    std::function<std::string(const std::string&)> synthesize_;
+    std::function<void(size_t, const std::string&)> on_ready_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::pair<size_t, std::string>> tasks_;
+    bool done_ = false;
+    std::thread thread_;
+};
+
+} // namespace
 
 // CivetWeb回调函数转发器
 int WebSocketServer::websocket_connect_handler(const mg_connection* conn, void* ws_server_ptr) { 
@@ -44,11 +96,39 @@ int WebSocketServer::civetweb_error_log_handler(const mg_connection *conn, const
     return 0; 
 }
 
+int WebSocketServer::metrics_handler(mg_connection* conn, void* ws_server_ptr) {
+    auto stats = static_cast<WebSocketServer*>(ws_server_ptr)->engine_.embeddingCacheStats();
+    uint64_t lookups = stats.hits + stats.misses;
+    std::ostringstream body;
+    body << "# HELP embedding_cache_hits_total Embedding lookups served from the cache.\n"
+         << "# TYPE embedding_cache_hits_total counter\n"
+         << "embedding_cache_hits_total " << stats.hits << "\n"
+         << "# HELP embedding_cache_misses_total Embedding lookups that called the embedding API.\n"
+         << "# TYPE embedding_cache_misses_total counter\n"
+         << "embedding_cache_misses_total " << stats.misses << "\n"
+         << "# HELP embedding_cache_hit_ratio Share of embedding lookups served from the cache.\n"
+         << "# TYPE embedding_cache_hit_ratio gauge\n"
+         << "embedding_cache_hit_ratio " << (lookups > 0 ? static_cast<double>(stats.hits) / lookups : 0.0) << "\n"
+         << "# HELP embedding_cache_entries Embeddings currently cached.\n"
+         << "# TYPE embedding_cache_entries gauge\n"
+         << "embedding_cache_entries " << stats.entries << "\n"
+         << "# HELP embedding_cache_bytes Estimated memory used by cached embeddings.\n"
+         << "# TYPE embedding_cache_bytes gauge\n"
+         << "embedding_cache_bytes " << stats.bytes << "\n"
+         << "# HELP embedding_cache_capacity_bytes Configured cache size (EMBEDDING_CACHE_MB).\n"
+         << "# TYPE embedding_cache_capacity_bytes gauge\n"
+         << "embedding_cache_capacity_bytes " << stats.capacity_bytes << "\n";
+    std::string text = body.str();
+    mg_send_http_ok(conn, "text/plain; version=0.0.4", static_cast<long long>(text.size()));
+    mg_write(conn, text.data(), text.size());
+    return 200;
+}
+
 // 构造函数：初始化所有核心服务
 WebSocketServer::WebSocketServer(ConfigManager& config) 
     : config_(config), 
-      // 初始化 MemoryManager，使用.env中定义的文件路径
-      memory_manager_(config.get("Database", "MEMORY_DB_PATH", "memory.json")),
+      // 初始化 MemoryManager，使用.env中 [Database] 节的配置
+      memory_manager_(config),
       // 将 config 和 memory_manager 传入 AIEngine
       engine_(config, memory_manager_), 
       // 初始化 SessionManager
@@ -94,6 +174,8 @@ void WebSocketServer::start() {
         websocket_data_handler, websocket_close_handler, this
     );
     log_info("WebSocket 端点已注册: /websocket");
+    mg_set_request_handler(ctx_, "/metrics$", metrics_handler, this);
+    log_info("运行指标端点已注册: /metrics");
 }
 
 void WebSocketServer::stop() { 
@@ -176,43 +258,79 @@ int WebSocketServer::handle_websocket_data(mg_connection* conn, int flags, char*
         session_manager_.addMessage("user", user_input);
         
         log_info("正在调用 AI 引擎...");
-        std::string ai_raw_response = engine_.processPlayerInput(user_input, session_manager_);
+        // 回复边生成边解析：每句台词的 '>' 一到就 (不带语音) 发给前端，前端可以在后面的句子生成时先显示前面的；
+        // 语音在合成线程中按句子顺序生成，每句合成完再以 ai_segment_audio (按片段序号) 补发。
+        // 尚未成句的部分另外作为预览转发
+        const std::string voice_api_url = config_.get("Voice", "VOICE_API_URL", "");
+        SegmentParser parser;
+        nlohmann::json segments = nlohmann::json::array();
+        std::mutex audio_mutex;
+        std::vector<std::pair<size_t, std::string>> audio_urls; // 合成线程的结果，最终消息发出前并入 segments
+        size_t streamed_segments = 0; // 已作为 ai_segment 发出的片段数，只有这些片段的语音需要补发
+        SpeechQueue speech(
+            [&](const std::string& text_jp) { return engine_.synthesizeSpeech(text_jp, voice_api_url); },
+            [&](size_t index, const std::string& audio_url) {
+                bool announce = false;
+                {
+                    std::lock_guard<std::mutex> lock(audio_mutex);
+                    audio_urls.emplace_back(index, audio_url);
+                    announce = index < streamed_segments;
+                }
+                if (announce && !audio_url.empty()) {
+                    nlohmann::json audio_msg = {{"type", "ai_segment_audio"},
+                                                {"payload", {{"index", index}, {"audio_url", audio_url}}}};
+                    send_websocket_message(conn, audio_msg.dump());
+                }
+            });
+        std::vector<std::string> texts_jp; // 与 segments 一一对应
+        auto on_segment = [&](const ReplySegment& segment) {
+            segments.push_back({
+                {"expression", segment.expression}, {"action", segment.action},
+                {"text_cn", segment.text_cn}, {"audio_url", ""}
+            });
+            texts_jp.push_back(segment.text_jp);
+        };
+        // 片段发出之后才交给合成线程，前端总是先收到片段、再收到它的语音
+        auto synthesize_from = [&](size_t begin) {
+            for (size_t i = begin; i < texts_jp.size(); ++i) {
+                if (!voice_api_url.empty() && !texts_jp[i].empty()) {
+                    speech.push(i, texts_jp[i]);
+                }
+            }
+        };
+        bool streamed = false;
+        auto forward_delta = [&](const std::string& delta) {
+            streamed = true;
+            nlohmann::json chunk = {{"type", "ai_stream"}, {"payload", {{"delta", delta}}}};
+            send_websocket_message(conn, chunk.dump(), false);
+            size_t before = segments.size();
+            if (parser.feed(delta, on_segment) > 0) {
+                {
+                    std::lock_guard<std::mutex> lock(audio_mutex);
+                    streamed_segments = segments.size();
+                }
+                for (size_t i = before; i < segments.size(); ++i) {
+                    nlohmann::json payload = segments[i];
+                    payload["index"] = i;
+                    nlohmann::json segment_msg = {{"type", "ai_segment"}, {"payload", payload}};
+                    send_websocket_message(conn, segment_msg.dump());
+                }
+                synthesize_from(before);
+            }
+        };
+        std::string ai_raw_response = engine_.processPlayerInput(user_input, session_manager_, forward_delta);
         log_info("AI 引擎返回: " + ai_raw_response);
         
         session_manager_.addMessage("assistant", ai_raw_response);
 
-        nlohmann::json segments = nlohmann::json::array();
-        std::regex re_main("【(.+?)】(.+?)<(.+?)>");
-        
-        auto sentences_begin = std::sregex_iterator(ai_raw_response.begin(), ai_raw_response.end(), re_main);
-        auto sentences_end = std::sregex_iterator();
-
-        for (std::sregex_iterator i = sentences_begin; i != sentences_end; ++i) {
-            std::smatch match = *i;
-            if (match.size() < 4) continue;
-
-            std::string expression = trim_string(match[1].str());
-            std::string middle_content = trim_string(match[2].str());
-            std::string text_jp = trim_string(match[3].str());
-            std::string action = "";
-            std::string text_cn = "";
-
-            std::smatch action_match;
-            std::regex re_action("\\((.+?)\\)");
-            if (std::regex_search(middle_content, action_match, re_action) && action_match.size() > 1) {
-                action = trim_string(action_match[1].str());
-                text_cn = trim_string(std::regex_replace(middle_content, re_action, ""));
-            } else {
-                text_cn = middle_content;
-            }
-
-            std::string audio_url = engine_.synthesizeSpeech(
-                text_jp, config_.get("Voice", "VOICE_API_URL", "")
-            );
-            segments.push_back({
-                {"expression", expression}, {"action", action},
-                {"text_cn", text_cn}, {"audio_url", audio_url}
-            });
+        if (!streamed) {
+            parser.feed(ai_raw_response, on_segment);
+            synthesize_from(0);
+        }
+        // 等合成线程处理完剩余的句子，最终消息中的每个片段都带上语音
+        speech.finish();
+        for (const auto& [index, audio_url] : audio_urls) {
+            segments[index]["audio_url"] = audio_url;
         }
 
         if (segments.empty()) {
@@ -223,9 +341,10 @@ int WebSocketServer::handle_websocket_data(mg_connection* conn, int flags, char*
             });
         }
         
+        // 已经逐句发出的片段在最终消息中仍然完整列出，streamed 为其中已发出的条数
         nlohmann::json response_to_frontend = {
             {"type", (msg_type == "system_command") ? "narration" : "ai_response"}, 
-            {"payload", {{"segments", segments}}}
+            {"payload", {{"segments", segments}, {"streamed", streamed_segments}}}
         };
         send_websocket_message(conn, response_to_frontend.dump());
 
@@ -235,10 +354,12 @@ int WebSocketServer::handle_websocket_data(mg_connection* conn, int flags, char*
     return 1;
 }
 
-void WebSocketServer::send_websocket_message(mg_connection* conn, const std::string& message) { 
+void WebSocketServer::send_websocket_message(mg_connection* conn, const std::string& message, bool verbose) { 
     if (conn) { 
         mg_websocket_write(conn, MG_WEBSOCKET_OPCODE_TEXT, message.c_str(), message.length()); 
-        log_info("发送 WebSocket 数据: " + message.substr(0, 200) + "...");
+        if (verbose) {
+            log_info("发送 WebSocket 数据: " + message.substr(0, 200) + "...");
+        }
     } 
 }
 
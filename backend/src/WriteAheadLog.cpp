@@ -0,0 +1,231 @@
+#include "WriteAheadLog.hpp"
+#include "FileUtil.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+struct Record {
+    uint64_t seq = 0;
+    std::string summary;
+    std::vector<float> embedding;
+    std::string extra;
+};
+
+// 解码一条记录的负载，格式错误时返回 false
+bool decode_payload(const char* data, size_t size, Record& record) {
+    const char* cursor = data;
+    const char* end = data + size;
+    uint32_t summary_size = 0, dimension = 0;
+    if (!FileUtil::take(cursor, end, record.seq) || !FileUtil::take(cursor, end, summary_size)
+        || static_cast<size_t>(end - cursor) < summary_size) {
+        return false;
+    }
+    record.summary.assign(cursor, summary_size);
+    cursor += summary_size;
+    if (!FileUtil::take(cursor, end, dimension) || static_cast<size_t>(end - cursor) < dimension * sizeof(float)) {
+        return false;
+    }
+    record.embedding.resize(dimension);
+    std::memcpy(record.embedding.data(), cursor, dimension * sizeof(float));
+    cursor += dimension * sizeof(float);
+
+    // 附加数据是可选的尾部 (早期版本的记录到此为止)
+    record.extra.clear();
+    if (cursor == end) {
+        return true;
+    }
+    uint32_t extra_size = 0;
+    if (!FileUtil::take(cursor, end, extra_size) || static_cast<size_t>(end - cursor) != extra_size) {
+        return false;
+    }
+    record.extra.assign(cursor, extra_size);
+    return true;
+}
+
+// 读取整个日志文件，逐条校验；返回最后一条完整记录之后的偏移
+size_t scan_records(const std::vector<char>& content, const std::function<void(size_t offset, const Record&)>& on_record) {
+    Record record;
+    return FileUtil::scanFrames(content.data(), content.size(), [&](size_t offset, const char* payload, size_t size) {
+        if (!decode_payload(payload, size, record)) {
+            return false;
+        }
+        on_record(offset, record);
+        return true;
+    });
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& path, FsyncPolicy policy, unsigned fsync_interval_ms)
+    : path_(path), policy_(policy), fsync_interval_ms_(std::max(fsync_interval_ms, 1u))
+{
+    open_for_append();
+    if (policy_ == FsyncPolicy::Interval) {
+        flusher_ = std::thread(&WriteAheadLog::flusher_loop, this);
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+    if (fd_ >= 0) {
+        if (unsynced_) fdatasync(fd_);
+        ::close(fd_);
+    }
+}
+
+WriteAheadLog::FsyncPolicy WriteAheadLog::parsePolicy(const std::string& value) {
+    std::string lower = value;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    if (lower == "always") return FsyncPolicy::Always;
+    if (lower == "never") return FsyncPolicy::Never;
+    return FsyncPolicy::Interval;
+}
+
+void WriteAheadLog::open_for_append() {
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("无法打开WAL文件 " + path_ + ": " + std::strerror(errno));
+    }
+    bytes_ = static_cast<uint64_t>(lseek(fd_, 0, SEEK_END));
+}
+
+void WriteAheadLog::replay(uint64_t after_seq, const ReplayFn& on_record) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<char> content = FileUtil::readFile(path_);
+    uint64_t max_seq = after_seq;
+    size_t replayed = 0;
+    size_t valid_end = scan_records(content, [&](size_t, const Record& record) {
+        max_seq = std::max(max_seq, record.seq);
+        if (record.seq > after_seq) {
+            on_record(record.seq, record.summary, record.embedding, record.extra);
+            ++replayed;
+        }
+    });
+    next_seq_ = max_seq + 1;
+
+    if (valid_end < content.size()) {
+        // 尾部是写到一半的记录：截掉它，之后的追加才能接在完整记录后面
+        Logger::logError("WAL " + path_ + " 尾部有 " + std::to_string(content.size() - valid_end)
+                         + " 字节不完整或校验失败的数据，已截断。");
+        if (ftruncate(fd_, static_cast<off_t>(valid_end)) != 0) {
+            throw std::runtime_error("截断WAL失败: " + std::string(std::strerror(errno)));
+        }
+        bytes_ = valid_end;
+    }
+    if (replayed > 0) {
+        Logger::logInfo("已从WAL回放 " + std::to_string(replayed) + " 条尚未合并的记忆。");
+    }
+}
+
+uint64_t WriteAheadLog::append(const std::string& summary, const float* embedding, size_t dimension,
+                               std::string_view extra) {
+    std::string frame;
+    frame.reserve(FileUtil::kFrameHeaderSize + 20 + summary.size() + dimension * sizeof(float) + extra.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t seq = next_seq_;
+    FileUtil::beginFrame(frame);
+    FileUtil::put(frame, seq);
+    FileUtil::put(frame, static_cast<uint32_t>(summary.size()));
+    frame += summary;
+    FileUtil::put(frame, static_cast<uint32_t>(dimension));
+    frame.append(reinterpret_cast<const char*>(embedding), dimension * sizeof(float));
+    FileUtil::put(frame, static_cast<uint32_t>(extra.size()));
+    frame += extra;
+    FileUtil::finishFrame(frame, 0);
+
+    // O_APPEND 保证整帧一次性追加到文件末尾
+    FileUtil::writeFully(fd_, frame.data(), frame.size(), "WAL");
+    if (policy_ == FsyncPolicy::Always) {
+        if (fdatasync(fd_) != 0) {
+            throw std::runtime_error("WAL落盘失败: " + std::string(std::strerror(errno)));
+        }
+    } else {
+        unsynced_ = true;
+    }
+    bytes_ += frame.size();
+    ++next_seq_;
+    return seq;
+}
+
+void WriteAheadLog::truncateThrough(uint64_t seq) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<char> content = FileUtil::readFile(path_);
+    size_t keep_from = std::string::npos;
+    size_t valid_end = scan_records(content, [&](size_t offset, const Record& record) {
+        if (record.seq > seq && keep_from == std::string::npos) {
+            keep_from = offset;
+        }
+    });
+    if (keep_from == std::string::npos) keep_from = valid_end;
+
+    // 把需要保留的记录写入新文件，再原子地替换旧日志
+    std::string temp_path = path_ + ".tmp";
+    int temp_fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (temp_fd < 0) {
+        throw std::runtime_error("无法创建WAL临时文件 " + temp_path + ": " + std::strerror(errno));
+    }
+    try {
+        FileUtil::writeFully(temp_fd, content.data() + keep_from, valid_end - keep_from, "WAL");
+        if (fdatasync(temp_fd) != 0) {
+            throw std::runtime_error("WAL落盘失败: " + std::string(std::strerror(errno)));
+        }
+    } catch (...) {
+        ::close(temp_fd);
+        ::unlink(temp_path.c_str());
+        throw;
+    }
+    ::close(temp_fd);
+    if (std::rename(temp_path.c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error("无法替换WAL文件 " + path_ + ": " + std::strerror(errno));
+    }
+    FileUtil::fsyncParentDir(path_);
+    ::close(fd_);
+    unsynced_ = false;
+    open_for_append();
+}
+
+uint64_t WriteAheadLog::lastSeq() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_seq_ - 1;
+}
+
+uint64_t WriteAheadLog::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+void WriteAheadLog::flusher_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        stop_cv_.wait_for(lock, std::chrono::milliseconds(fsync_interval_ms_));
+        if (unsynced_ && fd_ >= 0) {
+            // 落盘期间不持有锁，append 不必等待；复制描述符，防止 truncateThrough 在此期间关闭 fd_
+            int fd = ::dup(fd_);
+            unsynced_ = false;
+            lock.unlock();
+            if (fd >= 0) {
+                fdatasync(fd);
+                ::close(fd);
+            }
+            lock.lock();
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #include "ConfigManager.hpp"
 #include "WebSocketServer.hpp"
+#include "CommandLineTools.hpp"
 #include "civetweb.h"
 
 #include <iostream>
@@ -19,7 +20,12 @@ void signal_handler(int signum) {
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // 带参数运行时执行离线维护/基准命令，不启动服务器
+    if (argc > 1) {
+        return CommandLineTools::run(argc, argv);
+    }
+
     std::signal(SIGINT, signal_handler);
     std::signal(SIGTERM, signal_handler);
 
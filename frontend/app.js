@@ -10,6 +10,10 @@ class ChatApp {
         this.conversationQueue = [];  // 对话片段队列
         this.currentSegment = null;   // 当前正在处理的对话片段
         this.typewriterTimeout = null;// 用于存储打字机的setTimeout ID，以便可以清除它
+        this.isStreaming = false;     // 回复是否仍在流式生成（之后可能还有片段到达）
+        this.streamText = '';         // 已收到的流式回复原文，第一句台词完整之前用于预览
+        this.awaitingSegment = false; // 已显示完收到的片段，正在等待下一句生成
+        this.streamedSegments = [];   // 本次回复逐句收到的片段（按服务器的片段序号），语音随后单独到达
 
         this.initElements();
         this.connectWebSocket();
@@ -66,7 +70,10 @@ class ChatApp {
 
     // 【核心重构】主交互逻辑分发
     handleMainAction() {
-        if (!this.isSpeaking) {
+        if (this.isStreaming && (!this.currentSegment || this.awaitingSegment)) {
+            // 只有预览或正在等待下一句生成，没有可以推进的内容
+            return;
+        } else if (!this.isSpeaking) {
             // 如果不在对话中，且可以输入，则尝试发送消息
              this.sendMessage();
         } else if (this.isTyping) {
@@ -100,13 +107,36 @@ class ChatApp {
                 this.setDialogText('（连接成功。）');
                 this.setSpeakingState(false);
                 break;
+            case 'ai_stream':
+                this.appendStreamText(msg.payload.delta);
+                break;
+            case 'ai_segment':
+                // 生成过程中完整的一句台词：立即开始显示，之后的句子排队；语音稍后由 ai_segment_audio 补上
+                this.isStreaming = true;
+                this.streamedSegments[msg.payload.index] = msg.payload;
+                this.conversationQueue.push(msg.payload);
+                this.resumeConversation();
+                break;
+            case 'ai_segment_audio': {
+                const segment = this.streamedSegments[msg.payload.index];
+                if (!segment) break;
+                segment.audio_url = msg.payload.audio_url;
+                // 这一句正在显示且还没有播放过语音时立即播放；已经翻过去的句子不再补播
+                if (segment === this.currentSegment && !segment.voicePlayed) {
+                    segment.voicePlayed = true;
+                    this.playVoice(segment.audio_url);
+                }
+                break;
+            }
             case 'ai_response':
             case 'narration':
-                this.conversationQueue = msg.payload.segments;
-                this.setSpeakingState(true);
-                this.displayNextSegment();
+                // 前 streamed 个片段已经逐句收到
+                this.endStream();
+                this.conversationQueue.push(...msg.payload.segments.slice(msg.payload.streamed || 0));
+                this.resumeConversation();
                 break;
             case 'error':
+                 this.endStream();
                  this.setDialogText(`${msg.payload.message} (${msg.payload.code})`, '错误');
                  this.setSpeakingState(false);
                  break;
@@ -122,6 +152,38 @@ class ChatApp {
         this.setSpeakingState(true, true); // 进入思考状态
     }
 
+    // 流式预览：显示已生成部分的台词，去掉【表情】与<日语>标记（包括尚未闭合的）
+    appendStreamText(delta) {
+        if (this.currentSegment) return; // 已经开始逐句显示
+        this.streamText += delta;
+        const preview = this.streamText.replace(/【[^】]*(】|$)/g, '').replace(/<[^>]*(>|$)/g, '').trim();
+        if (preview === '') return;
+        if (!this.isStreaming) {
+            this.isStreaming = true;
+            this.setSpeakingState(true); // 收起思考动画
+            this.speakerName.textContent = this.config.character_name;
+        }
+        this.dialogText.textContent = preview;
+    }
+
+    endStream() {
+        // 服务器在最终消息之前发完所有 ai_segment_audio
+        this.isStreaming = false;
+        this.streamText = '';
+        this.streamedSegments = [];
+    }
+
+    // 有新片段到达：还没开始显示或正在等待下一句时，显示下一句
+    resumeConversation() {
+        if (!this.currentSegment) {
+            this.setSpeakingState(true);
+            this.displayNextSegment();
+        } else if (this.awaitingSegment) {
+            this.awaitingSegment = false;
+            this.displayNextSegment();
+        }
+    }
+
     // 【核心重构】对话推进逻辑
     displayNextSegment() {
         if (this.conversationQueue.length > 0) {
@@ -134,10 +196,17 @@ class ChatApp {
             
             this.updateCharacter(this.currentSegment.expression);
             this.updateEmotionTag(this.currentSegment.expression); // 同步情绪标签
-            this.playVoice(this.currentSegment.audio_url);
+            if (this.currentSegment.audio_url) {
+                this.currentSegment.voicePlayed = true;
+                this.playVoice(this.currentSegment.audio_url);
+            }
             
             this.typewriter(fullText, this.config.character_name);
 
+        } else if (this.isStreaming) {
+            // 后面的句子还在生成
+            this.awaitingSegment = true;
+            this.showContinue(false);
         } else {
             // 所有对话结束
             this.setSpeakingState(false);
@@ -193,6 +262,8 @@ class ChatApp {
             this.body.classList.remove('speaking');
             this.emotionTag.classList.add('hidden'); // 对话结束时隐藏情绪标签
             this.currentSegment = null;
+            this.awaitingSegment = false;
+            this.conversationQueue = [];
         }
     }
     